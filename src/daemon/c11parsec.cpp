@@ -0,0 +1,169 @@
+// c11parsec.cpp
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "daemon/parse_daemon.h"
+#include "parser/command_line.h"
+
+using namespace std;
+
+using namespace c11parser;
+
+// exit status when the daemon cannot be reached, distinct from any parser return value
+constexpr int daemonUnavailable = 125;
+
+void usage() {
+  puts("Usage: c11parsec [-h | --help] [--atomic-permissive-syntax] [--enable-gcc-extensions] [--skip-function-bodies] [--timeout MS] [--socket PATH] [file | @listfile]...");
+  puts("It has c11parsed parse stdin or the given files and prints and exits the same as c11parse");
+  puts("");
+  puts("Options:");
+  puts("--atomic-permissive-syntax: disables strict C18 syntax, off by default");
+  puts("--enable-gcc-extensions: enable GCC extensions to C, disabled by default");
+  puts("--skip-function-bodies: skip over function bodies without parsing them, off by default");
+  puts("--timeout MS: stop the parse after MS milliseconds, no limit by default");
+  printf("--socket PATH: socket c11parsed listens on, %s by default\n", default_socket_path().c_str());
+  puts("--help | -h: prints usage help");
+  printf("Exits with %d if c11parsed cannot be reached\n", daemonUnavailable);
+}
+
+// diagnostics come back without filenames, they are all in the response's file
+void print_diagnostics(FrameResponse& response) {
+  for(auto& diagnostic: response.diagnostics) {
+    diagnostic.loc.begin.filename = diagnostic.loc.end.filename = &response.name;
+  }
+  print_diagnostics(response.diagnostics);
+}
+
+int main(int argc, char* argv[])
+{
+  ios_base::sync_with_stdio(false);
+
+// getopt_long option variables must be int not bool or any other type convertible to int
+  int atomicPermissiveSyntax = 0;
+  int enableGccExtensions = 0;
+  int skipFunctionBodies = 0;
+  optional<chrono::milliseconds> timeout;
+  auto socketPath = default_socket_path();
+
+  option opts[] = {
+    {"atomic-permissive-syntax", no_argument, &atomicPermissiveSyntax, 1},
+    {"enable-gcc-extensions", no_argument, &enableGccExtensions, 1},
+    {"skip-function-bodies", no_argument, &skipFunctionBodies, 1},
+    {"timeout", required_argument, 0, 'T'},
+    {"socket", required_argument, 0, 's'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  for(int i, optLetter; (optLetter = getopt_long(argc, argv, "h", opts, &i)) != -1;) {
+    optional<unsigned long> n;
+    switch(optLetter) {
+// 0 means long option variable in opts entry was set to its value
+    case 0:
+      break;
+    case 'T':
+      if(!(n = option_number(optarg))) {
+        return bad_number(optarg, usage);
+      }
+      timeout = chrono::milliseconds(*n);
+      break;
+    case 's':
+      socketPath = optarg;
+      break;
+    case 'h':
+      usage();
+      return 0;
+    case '?':
+      usage();
+      return 1;
+    default:
+      return 1;
+    }
+  }
+
+  FrameServerOptions options{
+    .lexerOptions = {.atomic_strict_syntax = !(bool)atomicPermissiveSyntax, .enableGccExtensions = (bool)enableGccExtensions},
+    .skipFunctionBodies = (bool)skipFunctionBodies,
+    .timeout = timeout,
+  };
+
+  vector<string> files;
+  if(!expand_file_list(argc, argv, optind, files)) {
+    return 1;
+  }
+
+  try {
+    DaemonClient client(socketPath);
+
+    if(files.empty()) {
+      auto response = client.parse({"stdin", string{istreambuf_iterator<char>(cin), {}}}, options);
+      print_diagnostics(response);
+      if(response.status != 0) {
+        fputs("parse failed\n", stderr);
+      }
+      return response.status;
+    }
+
+// same output as c11parse with files except for timings, which are the daemon's to know
+    size_t passed = 0, bytes = 0;
+    for(auto& filename: files) {
+      ifstream in(filename, ios::binary);
+      FrameResponse response;
+      if(in) {
+        FrameRequest request{filename, string{istreambuf_iterator<char>(in), {}}};
+        bytes += request.source.size();
+        response = client.parse(request, options);
+      } else {
+        response = {.name = filename, .status = -1, .diagnostics = {{location(), "cannot read file"}}};
+      }
+      print_diagnostics(response);
+      if(response.status != 0) {
+        fprintf(stderr, "%s: parse failed\n", filename.c_str());
+      } else {
+        ++passed;
+      }
+    }
+    printf("files %zu passed %zu failed %zu bytes %zu\n", files.size(), passed, files.size() - passed, bytes);
+    return passed == files.size()? 0: 1;
+
+  } catch(const system_error& e) {
+    fprintf(stderr, "c11parsec: cannot reach c11parsed: %s\n", e.what());
+    return daemonUnavailable;
+  } catch(const runtime_error& e) {
+    fprintf(stderr, "c11parsec: %s\n", e.what());
+    return daemonUnavailable;
+  }
+}
+
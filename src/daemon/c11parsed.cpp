@@ -0,0 +1,143 @@
+// c11parsed.cpp
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <limits>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include "daemon/parse_daemon.h"
+#include "parser/command_line.h"
+
+using namespace std;
+
+using namespace c11parser;
+
+void usage() {
+  puts("Usage: c11parsed [-h | --help] [--socket PATH] [-j N] [--cache-mb N] [--max-source-mb N] [--stats]");
+  puts("It serves parse requests from c11parsec on a unix domain socket until it gets SIGINT or SIGTERM");
+  puts("");
+  puts("Options:");
+  printf("--socket PATH: socket to listen on, %s by default\n", default_socket_path().c_str());
+  puts("--jobs N | -j N: serve N requests at once, 0 for all cores, all cores by default");
+  puts("--cache-mb N: megabytes of sources and results to keep for answering repeated requests, 0 turns it off, 64 by default");
+  puts("--max-source-mb N: largest source in megabytes a request can carry, a larger one drops its connection, 64 by default");
+  puts("--stats: print request and cache counts on exit, off by default");
+  puts("--help | -h: prints usage help");
+}
+
+int main(int argc, char* argv[])
+{
+  ParseDaemonOptions options;
+  int printStats = 0;
+
+  option opts[] = {
+    {"socket", required_argument, 0, 's'},
+    {"jobs", required_argument, 0, 'j'},
+    {"cache-mb", required_argument, 0, 'c'},
+    {"max-source-mb", required_argument, 0, 'm'},
+    {"stats", no_argument, &printStats, 1},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+
+  for(int i, optLetter; (optLetter = getopt_long(argc, argv, "hj:", opts, &i)) != -1;) {
+    optional<unsigned long> n;
+    switch(optLetter) {
+// 0 means long option variable in opts entry was set to its value
+    case 0:
+      break;
+    case 's':
+      options.socketPath = optarg;
+      break;
+    case 'j':
+      if(!(n = option_number(optarg))) {
+        return bad_number(optarg, usage);
+      }
+      options.threads = *n;
+      break;
+    case 'c':
+      if(!(n = option_number(optarg, numeric_limits<size_t>::max() >> 20))) {
+        return bad_number(optarg, usage);
+      }
+      options.cacheBytes = *n << 20;
+      break;
+    case 'm':
+      if(!(n = option_number(optarg, frame_max_source_bytes >> 20))) {
+        return bad_number(optarg, usage);
+      }
+      options.maxSourceBytes = *n << 20;
+      break;
+    case 'h':
+      usage();
+      return 0;
+    case '?':
+      usage();
+      return 1;
+    default:
+      return 1;
+    }
+  }
+
+// signals are taken by a thread of their own, blocked before any other thread starts so all threads inherit the mask
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  try {
+    ParseDaemon daemon(options);
+
+    jthread waiter([&] {
+      int signal;
+      sigwait(&signals, &signal);
+      daemon.stop();
+    });
+
+    daemon.run();
+// wake the waiter if the daemon stopped for any reason other than a signal
+    kill(getpid(), SIGTERM);
+    waiter.join();
+
+    if(printStats) {
+      auto stats = daemon.stats();
+      printf("connections %zu requests %zu cache_hits %zu cache_entries %zu cache_bytes %zu\n", stats.connections, stats.requests, stats.cacheHits, stats.cacheEntries, stats.cacheBytes);
+    }
+  } catch(const system_error& e) {
+    fprintf(stderr, "c11parsed: %s\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}
+
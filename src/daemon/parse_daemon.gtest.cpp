@@ -0,0 +1,196 @@
+// parse_daemon.gtest.cpp
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "daemon/parse_daemon.h"
+
+#include <unistd.h>
+
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+using namespace std;
+using namespace ::testing;
+
+namespace c11parser::testing {
+
+// daemon on a socket of its own running until the test ends
+struct RunningDaemon {
+  string socketPath;
+  ParseDaemon daemon;
+  jthread runner;
+
+  explicit RunningDaemon(ParseDaemonOptions options):
+    socketPath(options.socketPath),
+    daemon(options),
+    runner([this] { daemon.run(); }) {}
+
+  ~RunningDaemon() {
+    daemon.stop();
+    runner.join();
+  }
+};
+
+string test_socket_path(const string& name) {
+  return (filesystem::temp_directory_path() / ("c11parsed_" + name + "_" + to_string(getpid()) + ".sock")).string();
+}
+
+TEST(ParseDaemon, 100_requests_and_cache) {
+  RunningDaemon running({.socketPath = test_socket_path("100"), .threads = 2});
+
+  DaemonClient client(running.socketPath);
+
+  auto ok = client.parse({"a.c", "typedef int T;\nT x;\n"});
+  EXPECT_EQ(ok.name, "a.c");
+  EXPECT_EQ(ok.status, 0);
+  EXPECT_TRUE(ok.diagnostics.empty());
+
+  auto bad = client.parse({"b.c", "int x = ;\n"});
+  EXPECT_NE(bad.status, 0);
+  ASSERT_EQ(bad.diagnostics.size(), 1u);
+  EXPECT_EQ(bad.diagnostics[0].loc.begin.line, 1);
+  EXPECT_EQ(bad.diagnostics[0].loc.begin.column, 9);
+
+// options are per request
+  string gcc = "int x __attribute__((unused));\n";
+  EXPECT_NE(client.parse({"c.c", gcc}).status, 0);
+  EXPECT_EQ(client.parse({"c.c", gcc}, {.lexerOptions = {.enableGccExtensions = true}}).status, 0);
+
+// same source under another name is answered from the cache with the new name
+  auto again = client.parse({"again.c", "int x = ;\n"});
+  EXPECT_EQ(again.name, "again.c");
+  EXPECT_EQ(again.status, bad.status);
+  ASSERT_EQ(again.diagnostics.size(), 1u);
+  EXPECT_EQ(again.diagnostics[0].message, bad.diagnostics[0].message);
+
+  auto stats = running.daemon.stats();
+  EXPECT_EQ(stats.requests, 5u);
+  EXPECT_EQ(stats.cacheHits, 1u);
+  EXPECT_EQ(stats.cacheEntries, 4u);
+}
+
+TEST(ParseDaemon, 110_concurrent_clients) {
+  RunningDaemon running({.socketPath = test_socket_path("110"), .threads = 3, .cacheBytes = 0});
+
+  vector<int> failures(6);
+  {
+    vector<jthread> clients;
+    for(size_t c = 0; c < failures.size(); ++c) {
+      clients.emplace_back([&, c] {
+        DaemonClient client(running.socketPath);
+        for(auto i = 0; i < 20; ++i) {
+          auto valid = (i + c) % 3 != 0;
+          auto source = "typedef int T" + to_string(i) + ";\nT" + to_string(i) + (valid? " x;\n": " = ;\n");
+          auto response = client.parse({"c" + to_string(c) + "_" + to_string(i) + ".c", source});
+          failures[c] += (response.status == 0) != valid;
+        }
+      });
+    }
+  }
+  EXPECT_THAT(failures, Each(0));
+
+  auto stats = running.daemon.stats();
+  EXPECT_EQ(stats.connections, failures.size());
+  EXPECT_EQ(stats.requests, failures.size() * 20);
+  EXPECT_EQ(stats.cacheHits, 0u);
+}
+
+TEST(ParseDaemon, 120_stop_and_unavailable) {
+  auto socketPath = test_socket_path("120");
+  optional<DaemonClient> idle;
+  {
+    RunningDaemon running({.socketPath = socketPath, .threads = 1});
+    idle.emplace(socketPath);
+    EXPECT_EQ(idle->parse({"x.c", "int x;\n"}).status, 0);
+  }
+// an idle connection does not keep the daemon from stopping and sees it go away
+  EXPECT_THROW(idle->parse({"x.c", "int x;\n"}), runtime_error);
+  EXPECT_FALSE(filesystem::exists(socketPath));
+  EXPECT_THROW(DaemonClient{socketPath}, system_error);
+}
+
+// sends raw bytes and the end of input on a connection of its own and reads until the daemon closes it
+string send_raw(const string& socketPath, const string& bytes) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socketPath.c_str());
+  auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    ADD_FAILURE() << "cannot connect to " << socketPath;
+  } else {
+    send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+    shutdown(fd, SHUT_WR);
+  }
+  string received;
+  char buf[256];
+  for(ssize_t n; fd >= 0 && (n = recv(fd, buf, sizeof(buf), 0)) > 0;) {
+    received.append(buf, n);
+  }
+  close(fd);
+  return received;
+}
+
+TEST(ParseDaemon, 130_bad_requests) {
+  RunningDaemon running({.socketPath = test_socket_path("130"), .threads = 1, .maxSourceBytes = 1024});
+
+// a negative or huge size, or one past the bound, drops the connection and the next client is still served
+  for(auto bytes: {"0 0\n-1 0\n", "0 0\n0 99999999999999999\n", "0 0\n3 2000\nx.c", "0 0\n1 8\na"}) {
+    EXPECT_EQ(send_raw(running.socketPath, bytes), "") << bytes;
+    DaemonClient client(running.socketPath);
+    EXPECT_EQ(client.parse({"x.c", "int x;\n"}).status, 0);
+  }
+
+// a good request before the bad one is answered
+  auto received = send_raw(running.socketPath, "0 0\n3 6\nx.cint x;0 0\n-1 0\n");
+  EXPECT_TRUE(received.starts_with("3 0 0\nx.c")) << received;
+}
+
+TEST(ParseDaemon, 140_idle_connections) {
+  RunningDaemon running({.socketPath = test_socket_path("140"), .threads = 1});
+
+// idle connections do not hold the only thread, requests on them are still answered when they come
+  deque<DaemonClient> idle;
+  for(auto i = 0; i < 3; ++i) {
+    idle.emplace_back(running.socketPath);
+  }
+  EXPECT_EQ(idle[0].parse({"a.c", "int a;\n"}).status, 0);
+  for(auto i = 0; i < 3; ++i) {
+    DaemonClient client(running.socketPath);
+    EXPECT_EQ(client.parse({"b.c", "int b" + to_string(i) + ";\n"}).status, 0);
+  }
+  for(auto& client: idle) {
+    EXPECT_EQ(client.parse({"c.c", "int c;\n"}).status, 0);
+  }
+  EXPECT_EQ(running.daemon.stats().connections, 6u);
+}
+
+}
@@ -0,0 +1,522 @@
+#ifndef C11PARSER_PARSE_DAEMON_H
+#define C11PARSER_PARSE_DAEMON_H
+// daemon/parse_daemon.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// long-lived parse server on a unix domain socket and its client
+//
+// a connection carries any number of requests, each answered in turn, and requests from several connections are served at once on a pool of threads
+// a connection holds a thread only while one of its requests is read and answered, between requests it waits in poll with the other idle ones
+// each request is a line of parse options followed by a frame of parser/frame_protocol.h, the response is the frame protocol response
+//
+// request:   "<flags> <timeout ms>\n" "<name bytes> <source bytes>\n" name source
+//
+// flags add up 1 for permissive _Atomic syntax, 2 for GCC extensions and 4 to skip function bodies, a timeout of 0 means none
+//
+// every pool thread keeps one warm parser for all the requests it serves
+// results are cached by options and source across all connections so an unchanged file is answered without parsing
+// the cache holds the whole source of each entry to compare on a hit and is bounded by bytes, least recently used entries go first
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "parser/frame_protocol.h"
+
+namespace c11parser {
+using namespace std;
+
+// socket in the user's runtime directory, or in /tmp named for the user
+inline string default_socket_path() {
+  if(auto dir = getenv("XDG_RUNTIME_DIR"); dir && *dir) {
+    return string(dir) + "/c11parsed.sock";
+  }
+  return "/tmp/c11parsed-" + to_string(getuid()) + ".sock";
+}
+
+// stream buffer over a connected socket, does not own the socket
+class socket_streambuf: public streambuf {
+public:
+
+  explicit socket_streambuf(int fd): fd(fd) {
+    setg(in, in, in);
+    setp(out, out + sizeof(out));
+  }
+
+  ~socket_streambuf() override {
+    sync();
+  }
+
+protected:
+
+  int_type underflow() override {
+    ssize_t n;
+    while((n = recv(fd, in, sizeof(in), 0)) < 0 && errno == EINTR) {
+    }
+    if(n <= 0) {
+      return traits_type::eof();
+    }
+    setg(in, in, in + n);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  int_type overflow(int_type c) override {
+    if(sync() != 0) {
+      return traits_type::eof();
+    }
+    if(!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+// MSG_NOSIGNAL so a client that went away is a failed write and not a SIGPIPE
+  int sync() override {
+    for(auto p = pbase(); p != pptr();) {
+      auto n = send(fd, p, pptr() - p, MSG_NOSIGNAL);
+      if(n < 0 && errno == EINTR) {
+        continue;
+      }
+      if(n <= 0) {
+        return -1;
+      }
+      p += n;
+    }
+    setp(out, out + sizeof(out));
+    return 0;
+  }
+
+private:
+
+  int fd;
+  char in[64 * 1024];
+  char out[64 * 1024];
+};
+
+inline int request_flags(const FrameServerOptions& options) {
+  return (options.lexerOptions.atomic_strict_syntax? 0: 1) | options.lexerOptions.enableGccExtensions << 1 | options.skipFunctionBodies << 2;
+}
+
+inline void write_request(ostream& out, const FrameServerOptions& options, const FrameRequest& request) {
+  out << request_flags(options) << ' ' << (options.timeout? options.timeout->count(): 0) << '\n';
+  write_frame(out, request);
+}
+
+// false at end of input between requests, throws runtime_error for a malformed request or one with more source bytes than the bound
+inline bool read_request(istream& in, FrameServerOptions& options, FrameRequest& request, size_t maxSourceBytes = frame_max_source_bytes) {
+  int flags;
+  long long timeout;
+  if(!(in >> flags)) {
+    if(in.eof()) {
+      return false;
+    }
+    throw runtime_error("bad request header");
+  }
+  if(!(in >> timeout) || in.get() != '\n' || !read_frame(in, request, maxSourceBytes)) {
+    throw runtime_error("bad request header");
+  }
+  options = {
+    .lexerOptions = {.atomic_strict_syntax = !(flags & 1), .enableGccExtensions = (bool)(flags & 2)},
+    .skipFunctionBodies = (bool)(flags & 4),
+    .timeout = timeout > 0? optional(chrono::milliseconds(timeout)): nullopt,
+  };
+  return true;
+}
+
+struct ParseDaemonOptions {
+  string socketPath = default_socket_path();
+// requests served at once, 0 means hardware concurrency
+  unsigned threads = 0;
+// bytes of sources and results kept in the result cache, 0 turns it off
+  size_t cacheBytes = 64 << 20;
+// source bytes of one request, a larger request is malformed and its connection is dropped
+  size_t maxSourceBytes = 64 << 20;
+// longest wait on a client in the middle of a request or its response, a stalled client is dropped so it does not hold a thread
+  chrono::milliseconds requestTimeout{10'000};
+};
+
+struct ParseDaemonStats {
+  size_t connections = 0;
+  size_t requests = 0;
+  size_t cacheHits = 0;
+  size_t cacheEntries = 0;
+  size_t cacheBytes = 0;
+};
+
+class ParseDaemon {
+public:
+
+// listens on the socket path right away so clients can connect as soon as this returns, a stale socket file is replaced
+// throws system_error if the socket cannot be set up
+  explicit ParseDaemon(ParseDaemonOptions options = {}): options(std::move(options)) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if(this->options.socketPath.size() >= sizeof(addr.sun_path)) {
+      throw system_error(make_error_code(errc::filename_too_long), this->options.socketPath);
+    }
+    strcpy(addr.sun_path, this->options.socketPath.c_str());
+    if((listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+      throw system_error(errno, system_category(), "socket");
+    }
+    unlink(addr.sun_path);
+    if(bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+      auto e = errno;
+      close(listenFd);
+      throw system_error(e, system_category(), this->options.socketPath);
+    }
+    if((wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+      auto e = errno;
+      close(listenFd);
+      throw system_error(e, system_category(), "eventfd");
+    }
+  }
+
+  ParseDaemon(const ParseDaemon&) = delete;
+  ParseDaemon& operator=(const ParseDaemon&) = delete;
+
+// run must have returned before the daemon is destroyed
+  ~ParseDaemon() {
+    stop();
+    close(listenFd);
+    close(wakeFd);
+    unlink(options.socketPath.c_str());
+  }
+
+// accepts connections and polls the idle ones until stop is called, a connection with a request to read goes to the pool
+// then waits for requests being served to finish and closes every connection
+  void run() {
+    auto threads = options.threads? options.threads: max(thread::hardware_concurrency(), 1u);
+    vector<jthread> pool;
+    for(auto i = threads; i > 0; --i) {
+      pool.emplace_back([this] { serve_connections(); });
+    }
+
+    vector<pollfd> fds;
+    vector<Connection*> polled;
+    while(!stopped) {
+      fds.assign({{listenFd, POLLIN, 0}, {wakeFd, POLLIN, 0}});
+      polled.clear();
+      {
+        lock_guard guard(lock);
+        for(auto& [fd, connection]: connections) {
+          if(connection->idle) {
+            fds.push_back({fd, POLLIN, 0});
+            polled.push_back(connection.get());
+          }
+        }
+      }
+      if(poll(fds.data(), fds.size(), -1) < 0) {
+        if(errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      if(fds[1].revents) {
+        eventfd_t n;
+        eventfd_read(wakeFd, &n);
+      }
+
+      lock_guard guard(lock);
+      if(stopped) {
+        break;
+      }
+// readable or hung up, either way a thread reads what comes next
+      for(size_t i = 0; i < polled.size(); ++i) {
+        if(fds[i + 2].revents) {
+          polled[i]->idle = false;
+          readable.push_back(polled[i]);
+          ready.notify_one();
+        }
+      }
+      if(fds[0].revents) {
+        auto fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if(fd < 0) {
+          if(errno == EINTR || errno == ECONNABORTED) {
+            continue;
+          }
+          break;
+        }
+        timeval timeout{.tv_sec = options.requestTimeout.count() / 1000, .tv_usec = options.requestTimeout.count() % 1000 * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        connections.emplace(fd, make_unique<Connection>(fd));
+        ++counts.connections;
+      }
+    }
+
+    {
+      lock_guard guard(lock);
+      stopped = true;
+    }
+    ready.notify_all();
+    pool.clear();
+    connections.clear();
+  }
+
+// safe to call from any thread or more than once, connections are shut down so threads serving them see end of input
+// and idle clients see the daemon go away
+  void stop() {
+    {
+      lock_guard guard(lock);
+      if(stopped) {
+        return;
+      }
+      stopped = true;
+      for(auto& [fd, connection]: connections) {
+        shutdown(fd, SHUT_RDWR);
+      }
+    }
+    ready.notify_all();
+    eventfd_write(wakeFd, 1);
+    shutdown(listenFd, SHUT_RDWR);
+  }
+
+  ParseDaemonStats stats() const {
+    lock_guard guard(lock);
+    auto s = counts;
+    s.cacheEntries = cache.size();
+    s.cacheBytes = cacheBytes;
+    return s;
+  }
+
+private:
+
+  struct CachedResult {
+    string key;
+    int status = 0;
+    vector<Diagnostic> diagnostics{};
+    size_t bytes = 0;
+  };
+
+// accepted connection, its stream buffer keeps what was read past the request being served
+  struct Connection {
+    int fd;
+    socket_streambuf buf;
+    iostream stream;
+// waiting in poll for its next request, not queued or being served
+    bool idle = true;
+
+    explicit Connection(int fd): fd(fd), buf(fd), stream(&buf) {}
+
+    ~Connection() {
+      stream.flush();
+      close(fd);
+    }
+  };
+
+// serves one request at a time from whichever connection has one, then hands the connection back to poll
+  void serve_connections() {
+    FrameServer server;
+    FrameServerOptions requestOptions;
+    FrameRequest request;
+    string key;
+    CachedResult cached;
+    for(;;) {
+      Connection* connection;
+      {
+        unique_lock guard(lock);
+        ready.wait(guard, [&] { return stopped || !readable.empty(); });
+        if(readable.empty()) {
+          return;
+        }
+        connection = readable.front();
+        readable.pop_front();
+      }
+
+      auto& stream = connection->stream;
+      auto open = false;
+      try {
+        if(read_request(stream, requestOptions, request, options.maxSourceBytes)) {
+          key.assign(1, (char)request_flags(requestOptions)).append(request.source);
+          if(lookup(key, cached)) {
+            write_response(stream, request.name, cached.status, cached.diagnostics);
+          } else {
+            auto status = server.parse(request, requestOptions);
+            write_response(stream, request.name, status, server.diagnostics());
+// a parse stopped by its deadline says nothing about the source
+            if(status != parse_deadline_exceeded) {
+              insert(key, status, server.diagnostics());
+            }
+          }
+          open = (bool)stream.flush();
+        }
+      } catch(const exception&) {
+// malformed request or one that could not be read or parsed, only this connection goes
+      }
+
+      lock_guard guard(lock);
+      if(!open || stopped) {
+        connections.erase(connection->fd);
+      } else if(connection->buf.in_avail() > 0) {
+// next request is already buffered where poll cannot see it
+        readable.push_back(connection);
+        ready.notify_one();
+      } else {
+        connection->idle = true;
+        eventfd_write(wakeFd, 1);
+      }
+    }
+  }
+
+// copies out the cached result and moves its entry to the front if the key is in the cache
+// copied so the response is written without holding the lock
+  bool lookup(const string& key, CachedResult& result) {
+    lock_guard guard(lock);
+    ++counts.requests;
+    auto it = cache.find(key);
+    if(it == cache.end()) {
+      return false;
+    }
+    ++counts.cacheHits;
+    recent.splice(recent.begin(), recent, it->second);
+    result.status = it->second->status;
+    result.diagnostics = it->second->diagnostics;
+    return true;
+  }
+
+  void insert(const string& key, int status, const vector<Diagnostic>& diagnostics) {
+    CachedResult entry{.key = key, .status = status, .diagnostics = diagnostics};
+    entry.bytes = key.size() + sizeof(CachedResult);
+    for(auto& diagnostic: entry.diagnostics) {
+      diagnostic.loc.begin.filename = diagnostic.loc.end.filename = nullptr;
+      entry.bytes += sizeof(Diagnostic) + diagnostic.message.size();
+    }
+    if(entry.bytes > options.cacheBytes) {
+      return;
+    }
+
+    lock_guard guard(lock);
+    if(cache.contains(entry.key)) {
+      return;
+    }
+    cacheBytes += entry.bytes;
+    recent.push_front(std::move(entry));
+    cache.emplace(recent.front().key, recent.begin());
+    while(cacheBytes > options.cacheBytes) {
+      cacheBytes -= recent.back().bytes;
+      cache.erase(recent.back().key);
+      recent.pop_back();
+    }
+  }
+
+  ParseDaemonOptions options;
+  int listenFd = -1;
+// wakes run from poll to take back connections that went idle or to stop
+  int wakeFd = -1;
+
+  mutable mutex lock;
+  condition_variable ready;
+  atomic<bool> stopped = false;
+// every open connection, and those with a request waiting for a pool thread
+  unordered_map<int, unique_ptr<Connection>> connections;
+  deque<Connection*> readable;
+  ParseDaemonStats counts;
+
+// most recently used first, the map points into the list and its keys are views of the list entries
+  list<CachedResult> recent;
+  unordered_map<string_view, list<CachedResult>::iterator> cache;
+  size_t cacheBytes = 0;
+};
+
+// one connection to a daemon, requests on it are answered in order
+class DaemonClient {
+public:
+
+// throws system_error if no daemon is listening on the socket path
+  explicit DaemonClient(const string& socketPath = default_socket_path()) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if(socketPath.size() >= sizeof(addr.sun_path)) {
+      throw system_error(make_error_code(errc::filename_too_long), socketPath);
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+    if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+      throw system_error(errno, system_category(), "socket");
+    }
+    if(connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+      auto e = errno;
+      close(fd);
+      throw system_error(e, system_category(), socketPath);
+    }
+    buf = make_unique<socket_streambuf>(fd);
+    stream.rdbuf(buf.get());
+  }
+
+  DaemonClient(const DaemonClient&) = delete;
+  DaemonClient& operator=(const DaemonClient&) = delete;
+
+  ~DaemonClient() {
+    stream.rdbuf(nullptr);
+    buf.reset();
+    close(fd);
+  }
+
+// throws runtime_error if the daemon goes away or answers with anything but a response
+  FrameResponse parse(const FrameRequest& request, const FrameServerOptions& options = {}) {
+    write_request(stream, options, request);
+    FrameResponse response;
+    if(!stream.flush() || !read_response(stream, response)) {
+      throw runtime_error("no response from daemon");
+    }
+    return response;
+  }
+
+private:
+
+  int fd = -1;
+  unique_ptr<socket_streambuf> buf;
+  iostream stream{nullptr};
+};
+
+}
+
+#endif
+
@@ -26,37 +26,165 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <functional>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_set>
 
 namespace c11parser {
 using namespace std;
 
+// allocator for typedef contexts and identifiers in semantic values, memory comes from the parser's memory resource
+// same as pmr::polymorphic_allocator except moves take the allocator along so values moved between parser stack entries never copy
+// copies use the default resource unless given one, so a copy made outside the parser does not depend on the parser's memory
+template<typename T>
+class arena_allocator {
+public:
+  using value_type = T;
+  using propagate_on_container_move_assignment = true_type;
+  using propagate_on_container_swap = true_type;
+
+  arena_allocator() noexcept = default;
+
+  arena_allocator(pmr::memory_resource* resource) noexcept: memory(resource) {}
+
+  template<typename U>
+  arena_allocator(const arena_allocator<U>& other) noexcept: memory(other.resource()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(memory->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    memory->deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+// elements such as the names in a context get the same resource
+  template<typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    uninitialized_construct_using_allocator(p, *this, std::forward<Args>(args)...);
+  }
+
+  arena_allocator select_on_container_copy_construction() const {
+    return {};
+  }
+
+  pmr::memory_resource* resource() const {
+    return memory;
+  }
+
+private:
+  pmr::memory_resource* memory = pmr::get_default_resource();
+};
+
+template<typename T, typename U>
+bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) {
+  return *a.resource() == *b.resource();
+}
+
 struct Context {
-  using context = unordered_set<string>;
+  using name = basic_string<char, char_traits<char>, arena_allocator<char>>;
+
+// key for the hidden entry of an identifier, looks it up without building the entry's name
+  struct hidden_name {
+    string_view id;
+  };
+
+// lookups take any string type without converting it
+// a hidden entry hashes as its identifier with the bits flipped so hidden_name finds it from the identifier alone
+  struct name_hash {
+    using is_transparent = void;
+    size_t operator()(string_view a) const {
+      return a.starts_with('\0')? (*this)(hidden_name{a.substr(1)}): hash<string_view>()(a);
+    }
+    size_t operator()(hidden_name a) const {
+      return ~hash<string_view>()(a.id);
+    }
+  };
+
+  struct name_equal {
+    using is_transparent = void;
+    bool operator()(string_view a, string_view b) const {
+      return a == b;
+    }
+    bool operator()(string_view a, hidden_name b) const {
+      return a.starts_with('\0') && a.substr(1) == b.id;
+    }
+    bool operator()(hidden_name a, string_view b) const {
+      return (*this)(b, a);
+    }
+  };
+
+  using context = unordered_set<name, name_hash, name_equal, arena_allocator<name>>;
 
   context current;
 
-  bool is_typedefname(const string& id) {
-    return current.contains(id);
+// optional record of every name declared, used to check speculative parses that started from a predicted context
+  context* declared = nullptr;
+
+// optional read-only names visible below current, lets many snippets share one large context without copying it
+// names declared in current hide it, a variable hiding an enclosing typedef name is kept in current as a hidden entry so snapshots carry it
+  const context* enclosing = nullptr;
+
+  bool is_typedefname(string_view id) {
+    if(current.contains(id)) {
+      return true;
+    }
+    return enclosing && enclosing->contains(id) && !current.contains(hidden_name{id});
   }
 
-  void declare_typedefname(const string& id) {
-    current.insert(id);
+  void declare_typedefname(string_view id) {
+    current.emplace(id);
+    if(enclosing) {
+      erase(current, hidden_name{id});
+    }
+    if(declared) {
+      declared->emplace(id);
+    }
   }
 
-  void declare_varname(const string& id) {
-    current.erase(id);
+  void declare_varname(string_view id) {
+    erase(current, id);
+    if(enclosing && enclosing->contains(id)) {
+      current.emplace(hidden(id));
+    }
+    if(declared) {
+      declared->emplace(id);
+    }
   }
 
+// copy in the same memory as current
   context save_context() {
-    return current;
+    return context(current, current.get_allocator());
   }
 
   void restore_context(const context& snapshot) {
     current = snapshot;
   }
 
+// snapshot is not used again so its memory is taken over
+  void restore_context(context&& snapshot) {
+    current = std::move(snapshot);
+  }
+
+private:
+
+// cannot clash with an identifier, only built when a hidden entry is added
+  static string hidden(string_view id) {
+    return '\0' + string(id);
+  }
+
+// erase by any key type, unordered_set only has heterogeneous erase from c++23 library versions on
+  template<typename Key>
+  static void erase(context& ctx, const Key& id) {
+    if(auto it = ctx.find(id); it != ctx.end()) {
+      ctx.erase(it);
+    }
+  }
+
 };
 
 }
@@ -44,7 +44,9 @@ using namespace std;
 struct declarator;
 
 struct declarator_base {
-  string identifier;
+  Context::name identifier;
+// the derivation applied to the identifier first, innermost in the declarator, is a function so the identifier names a function and not a pointer or array
+  bool function = false;
 };
 
 struct identifier_declarator: public declarator_base {
@@ -53,22 +55,27 @@ struct identifier_declarator: public declarator_base {
 struct function_declarator: public declarator_base {
 
   Context::context ctx;
-  explicit function_declarator(const declarator&, const Context::context&);
+  explicit function_declarator(declarator&&, Context::context&&);
 
 };
 
 struct other_declarator: public declarator_base {
 
-  explicit other_declarator(const declarator& d);
+// identifierList for a function declarator with an identifier list and no prototype
+  explicit other_declarator(declarator&& d, bool identifierList = false);
 
 };
 
 struct declarator: variant<identifier_declarator, function_declarator, other_declarator> {
   using variant::variant;
 
-  string identifier() {
+  bool is_function() const {
+    return visit([](const auto& d) { return d.function; }, *this);
+  }
+
+  const Context::name& identifier() const {
     return visit(overload{
-      [](const auto& d) -> string {
+      [](const auto& d) -> const Context::name& {
         return d.identifier;
       },
     },
@@ -85,27 +92,36 @@ struct declarator: variant<identifier_declarator, function_declarator, other_dec
 
 };
 
-inline function_declarator::function_declarator(const declarator& d, const Context::context& savedCtx) {
+// declarators are built bottom-up from the parser stack and moved along so their identifier and context stay in parser memory
+inline function_declarator::function_declarator(declarator&& d, Context::context&& savedCtx) {
   visit(overload{
-    [this, &savedCtx](const identifier_declarator& d) -> void {
-      identifier = d.identifier;
-      ctx = savedCtx;
+    [this, &savedCtx](identifier_declarator& d) -> void {
+      identifier = std::move(d.identifier);
+      function = true;
+      ctx = std::move(savedCtx);
     },
-    [this](const function_declarator& d) -> void {
-      identifier = d.identifier;
-      ctx = d.ctx;
+    [this](function_declarator& d) -> void {
+      identifier = std::move(d.identifier);
+      function = d.function;
+      ctx = std::move(d.ctx);
     },
-    [this](const auto& d) -> void {
-      identifier = d.identifier;
+    [this](auto& d) -> void {
+      identifier = std::move(d.identifier);
+      function = d.function;
     }
   },
   d);
 }
 
-inline other_declarator::other_declarator(const declarator& d) {
+inline other_declarator::other_declarator(declarator&& d, bool identifierList) {
   visit(overload{
-    [this](const auto& d) -> void {
-      identifier = d.identifier;
+    [this, identifierList](identifier_declarator& d) -> void {
+      identifier = std::move(d.identifier);
+      function = identifierList;
+    },
+    [this](auto& d) -> void {
+      identifier = std::move(d.identifier);
+      function = d.function;
     }
   },
   d);
@@ -75,8 +75,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // add location parameter to symbol constructor
 %locations
 
-// generate header for location to be used outside of bison parser
-%define api.location.file "locations.bison.h"
+// own location type that also tracks byte offsets, see parser/location.h
+%define api.location.type {location}
 
 %define parse.error detailed
 
@@ -95,8 +95,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <variant>
 #include <optional>
 #include <memory>
-
-#include "locations.bison.h"
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "lexer/linemarker.h"
+#include "parser/diagnostic.h"
+#include "parser/location.h"
+#include "parser/name_resolution.h"
+#include "parser/parse_events.h"
 
 #include "declarator/context.h"
 #include "declarator/declarator.h"
@@ -105,14 +115,266 @@ namespace c11parser {
 using namespace std;
 using namespace chrono;
 
+// construct that parse() accepts, snippets such as an expression from an editor or debugger are parsed as-is without wrapping them in a translation unit
+enum class ParseEntry {
+  translation_unit,
+  expression,
+  statement,
+  declaration,
+  type_name,
+};
+
+// statuses of a parse stopped by BisonParam::Control, past bison's own 0 for success, 1 for failure and 2 for memory exhausted
+// a stopped parse ends through bison's error recovery and abort so parse() returns 1, BisonParam::status gives the reason
+enum ParseStop: int {
+  parse_cancelled = 3,
+  parse_deadline_exceeded = 4,
+  parse_memory_budget_exceeded = 5,
+};
+
 // info for parser to use
 struct BisonParam {
-  Context context{};
+// memory for typedef contexts and identifiers in semantic values
+// the default is a pool owned here that keeps freed memory for later parses, so a warmed parser takes nothing from the global heap
+// any other resource can be given instead, eg a monotonic arena released between parses
+  unique_ptr<pmr::memory_resource> pool = make_unique<pmr::unsynchronized_pool_resource>(pmr::pool_options{.largest_required_pool_block = 1 << 20});
+  pmr::memory_resource* resource = pool.get();
+// typedef names in scope, point context.enclosing at a shared read-only set to parse many snippets against it without copying it
+  Context context{Context::context(resource)};
+  ParseEntry entry = ParseEntry::translation_unit;
   struct Stats {
     duration<double> parseTimeTakenSec;
     time_point<steady_clock> parseStartTime;
     time_point<steady_clock> parseEndTime;
   } stats{};
+// optional sink for streaming parse events
+  ParseEvents* events = nullptr;
+// optional resolution of identifier uses to their declarations
+  NameResolver* resolver = nullptr;
+// declaration bookkeeping kept only with an events sink or a resolver
+// storage classes of the declaration specifiers whose declarations are being parsed, innermost last
+  vector<uint8_t> declarationSpecifiers{};
+// declarationSpecifiers sizes at the opening braces of the blocks being parsed
+  vector<size_t> blocks{};
+// between a function definition's declarator and its body, where the declarations of an identifier list go
+  bool functionParameters = false;
+// function declarator held until its declaration ends
+  optional<Declaration> pendingFunction{};
+  string pendingFunctionName{};
+// skip function bodies and only record their locations, for declaration-only scans
+  bool skipFunctionBodies = false;
+// locations of skipped function bodies including braces
+  vector<location> skippedFunctionBodies{};
+// lexical and syntax errors from the last parse in input order, parse fails if there are any
+  vector<Diagnostic> diagnostics{};
+// budgets for pathological input such as machine generated code with thousands of nesting levels, 0 means no limit
+  struct Limits {
+// parser stack entries, the stack grows with nesting of parentheses, braces, statements and right associative operators
+    size_t maxStackDepth = 0;
+// estimated bytes of typedef context snapshots that save_context keeps on the parser stack for nested scopes
+    size_t maxContextBytes = 0;
+  } limits{};
+// cooperative stopping and progress for services that bound the time and memory of each parse
+// checked every checkInterval tokens on the token path, a stopped parse records a diagnostic and keeps its ParseStop status in stopped
+  struct Control {
+// may be set from another thread
+    const atomic<bool>* cancel = nullptr;
+    time_point<steady_clock> deadline = time_point<steady_clock>::max();
+// estimated bytes of parser stack and typedef context, 0 means no limit
+    size_t maxMemoryBytes = 0;
+// called at every check with the input offset reached
+    function<void(size_t)> progress{};
+    size_t checkInterval = 1024;
+
+    bool active() const {
+      return cancel || deadline != time_point<steady_clock>::max() || maxMemoryBytes || progress;
+    }
+  } control{};
+// status a stop check ended the last parse with, 0 if none did
+  int stopped = 0;
+
+// parse() return value made the ParseStop status of a stopped parse, or 1 for one stopped by a limit
+  int status(int parsed) const {
+    return stopped? stopped: parsed;
+  }
+
+  void event_enter(ParseEventKind kind, const location& loc) {
+    if(events) {
+      events->enter(kind, loc);
+    }
+  }
+
+  void event_exit(ParseEventKind kind, const location& loc) {
+    if(events) {
+      events->exit(kind, loc);
+    }
+  }
+
+  bool tracking() const {
+    return events || resolver;
+  }
+
+  void push_declaration_specifiers(uint8_t storage) {
+    if(tracking()) {
+      declarationSpecifiers.push_back(storage);
+    }
+  }
+
+// at the end of a declaration, parameter declaration or function definition declarator
+  void pop_declaration_specifiers(bool definition = false) {
+    if(tracking()) {
+      send_pending_function(definition);
+// K&R parameter declarations between the declarator and the body pop too and keep it, the body or error recovery clears it
+      if(definition) {
+        functionParameters = true;
+      }
+      if(!declarationSpecifiers.empty()) {
+        declarationSpecifiers.pop_back();
+      }
+    }
+  }
+
+  void enter_block() {
+    if(tracking()) {
+      blocks.push_back(declarationSpecifiers.size());
+      if(resolver) {
+        resolver->enter_block(blocks.size(), functionParameters);
+      }
+      functionParameters = false;
+    }
+  }
+
+  void exit_block() {
+    if(tracking() && !blocks.empty()) {
+      declarationSpecifiers.resize(blocks.back());
+      blocks.pop_back();
+      if(resolver) {
+        resolver->exit_block(blocks.size());
+      }
+    }
+  }
+
+// error recovery discards declarations being parsed without reducing them, back to the innermost block or file scope
+  void recover_declarations(bool fileScope) {
+    if(tracking()) {
+      pendingFunction.reset();
+      functionParameters = false;
+      if(fileScope) {
+        blocks.clear();
+      }
+      declarationSpecifiers.resize(blocks.empty()? 0: blocks.back());
+      if(resolver) {
+        resolver->exit_block(blocks.size());
+      }
+    }
+  }
+
+// ownSpecifiers for a declarator whose declaration specifiers are on top, not for a tag or enumerator which is reduced inside them
+  void declare(DeclarationKind kind, string_view name, const location& loc, bool ownSpecifiers) {
+    if(!tracking() || name.empty()) {
+      return;
+    }
+    send_pending_function(false);
+    Declaration d{
+      .kind = kind,
+      .name = name,
+      .storage = ownSpecifiers && !declarationSpecifiers.empty()? declarationSpecifiers.back(): uint8_t(storage_none),
+      .depth = (int)(blocks.size() + declarationSpecifiers.size() + functionParameters) - (ownSpecifiers && !declarationSpecifiers.empty()? 1: 0),
+      .loc = loc,
+    };
+    if(kind != DeclarationKind::function) {
+      send(d);
+      return;
+    }
+    pendingFunctionName = name;
+    d.name = pendingFunctionName;
+    pendingFunction = d;
+  }
+
+  void send_pending_function(bool definition) {
+    if(pendingFunction) {
+      pendingFunction->definition = definition;
+      send(*pendingFunction);
+      pendingFunction.reset();
+    }
+  }
+
+  void send(const Declaration& d) {
+    if(resolver) {
+      resolver->declare(d);
+    }
+    if(events) {
+      events->declare(d);
+    }
+  }
+
+// an identifier in an expression or a typedef name in a type specifier
+  void use(string_view name, const location& loc) {
+    if(resolver) {
+      resolver->use(name, loc.begin.offset);
+    }
+  }
+
+// stack entries to reserve before the first parse, the depth follows nesting and not input size so a fixed amount covers real code
+  size_t stack_reserve() const {
+    return limits.maxStackDepth? min<size_t>(1024, limits.maxStackDepth + 1): 1024;
+  }
+// stack of the parser last reserved, a parser reserves on its first parse and keeps the capacity after
+  const void* reservedStack = nullptr;
+
+// checked before every token with a depth limit, the stack grows by a shift per token and only a few empty reductions between tokens
+  bool check_stack_depth(size_t depth, const location& loc) {
+    if(limits.maxStackDepth && depth > limits.maxStackDepth) {
+      diagnostics.push_back({loc, "nesting too deep, parser stack depth exceeds limit of " + to_string(limits.maxStackDepth)});
+      return false;
+    }
+    return true;
+  }
+
+// checked before every context snapshot, estimated as if every stack entry held a snapshot as big as the current context
+  bool check_context_bytes(size_t depth, const location& loc) {
+    if(limits.maxContextBytes && depth * context_bytes(context.current) > limits.maxContextBytes) {
+      diagnostics.push_back({loc, "nesting too deep, typedef context snapshots exceed limit of " + to_string(limits.maxContextBytes) + " bytes"});
+      return false;
+    }
+    return true;
+  }
+
+// returns 0 to go on or the status to stop the parse with
+  int check_control(const location& loc, size_t stackBytes) {
+    if(control.progress) {
+      control.progress(loc.end.offset);
+    }
+    if(control.cancel && control.cancel->load(memory_order_relaxed)) {
+      diagnostics.push_back({loc, "parse cancelled"});
+      return parse_cancelled;
+    }
+    if(control.deadline != time_point<steady_clock>::max() && steady_clock::now() >= control.deadline) {
+      diagnostics.push_back({loc, "parse deadline exceeded"});
+      return parse_deadline_exceeded;
+    }
+    if(control.maxMemoryBytes && stackBytes + context_bytes(context.current) > control.maxMemoryBytes) {
+      diagnostics.push_back({loc, "parse memory budget of " + to_string(control.maxMemoryBytes) + " bytes exceeded"});
+      return parse_memory_budget_exceeded;
+    }
+    return 0;
+  }
+
+  static size_t context_bytes(const Context::context& ctx) {
+    return ctx.size() * (sizeof(Context::context::value_type) + 2 * sizeof(void*)) + ctx.bucket_count() * sizeof(void*);
+  }
+
+// clear state from previous parse to reuse for next input, context keeps its allocated buckets
+  void reset() {
+    context.current.clear();
+    stats = {};
+    skippedFunctionBodies.clear();
+    diagnostics.clear();
+    declarationSpecifiers.clear();
+    blocks.clear();
+    functionParameters = false;
+    pendingFunction.reset();
+  }
 };
 
 // info for lexer to use in yylex
@@ -121,6 +383,73 @@ struct LexParam {
   location loc{};
 // lexical feedback callbacks
   function<bool(const string&)> is_typedefname{};
+// typedef names looked up directly without going through is_typedefname, set to the parser context unless is_typedefname is given
+  Context* context = nullptr;
+// set by parser after the opening brace of a function body has been read to have the lexer skip to its closing brace
+  bool skipFunctionBody = false;
+// where the lexer records its errors, set to the parser diagnostics unless given
+  vector<Diagnostic>* diagnostics = nullptr;
+// optional record of the linemarkers read, telling which file each part of the input came from
+  vector<Linemarker>* linemarkers = nullptr;
+// memory for identifier token values, set to the parser memory resource
+  pmr::memory_resource* resource = pmr::get_default_resource();
+// token kind returned ahead of the input to select the parser entry point, set by the parser from BisonParam::entry
+  int startToken = 0;
+// tokens returned in this parse and the count at which checkpoint runs next, set by the parser from BisonParam::control and limits
+  size_t tokens = 0;
+  size_t nextCheck = SIZE_MAX;
+  function<int()> checkpoint{};
+// status of a parse stopped at a checkpoint, the lexer function returns the error token and then end of input
+// so the parser stops in error recovery without reading further
+  int stop = 0;
+
+  bool lookup_typedefname(const string& id) {
+    return context? context->is_typedefname(id): is_typedefname(id);
+  }
+
+  void report(const location& errorLoc, const string& msg) {
+    if(diagnostics) {
+      diagnostics->push_back({errorLoc, msg});
+    }
+  }
+
+// rewind location to start of next input, keeps filename unless a new one is given
+  void reset(const string* filename = nullptr) {
+    loc.initialize(filename? filename: loc.begin.filename);
+  }
+};
+
+class Lexer;
+
+// lexer function the parser calls for each token
+// binding a Lexer makes a plain member call per token, any other callable such as a fake lexer in tests goes through function
+// template only so Lexer and symbol type can be complete where the call is made
+template<typename Symbol, typename L = Lexer>
+class LexFunction {
+public:
+
+  LexFunction(L& lexer): lexer(&lexer) {}
+
+  template<typename F>
+    requires (!is_same_v<decay_t<F>, LexFunction> && !is_same_v<decay_t<F>, L>)
+  LexFunction(F&& f): f(std::forward<F>(f)) {}
+
+  Symbol operator()(LexParam& lexParam) {
+    if(lexParam.startToken) {
+      return Symbol(exchange(lexParam.startToken, 0), lexParam.loc);
+    }
+    if(lexParam.stop) {
+      return Symbol(Symbol::kind_type::YYEOF, lexParam.loc);
+    }
+    if(++lexParam.tokens == lexParam.nextCheck && (lexParam.stop = lexParam.checkpoint())) {
+      return Symbol(Symbol::kind_type::YYerror, lexParam.loc);
+    }
+    return lexer? lexer->yylex(lexParam): f(lexParam);
+  }
+
+private:
+  L* lexer = nullptr;
+  function<Symbol(LexParam&)> f;
 };
 
 }
@@ -133,8 +462,8 @@ struct LexParam {
 %define api.parser.class {C11Parser}
 
 // parser constructor parameter 1
-// this is the yylex bison will call, it can have any signature we want since it's a lambda passed in by the client that wraps and hides the actual yylex call
-%parse-param {function<C11Parser::symbol_type(LexParam&)> yylex}
+// this is the yylex bison will call, either a Lexer called directly or any callable passed in by the client that wraps and hides the actual yylex call
+%parse-param {LexFunction<symbol_type> yylex}
 
 // parser constructor parameter 2
 %parse-param {BisonParam& bisonParam}
@@ -191,6 +520,9 @@ using namespace std;
 #include <string>
 #include <chrono>
 
+// complete Lexer type for LexFunction calls in parse()
+#include "lexer/c11parser_lexer.h"
+
 using namespace std;
 
 namespace {
@@ -198,7 +530,26 @@ namespace {
 }
 
 void c11parser::C11Parser::error(const location& loc, const string& msg) {
-  cerr << "error at " << loc << ": " << msg << "\n";
+  bisonParam.diagnostics.push_back({loc, msg});
+}
+
+namespace {
+
+// grow parser stack before parse starts, a stack with reserve is grown without constructing entries
+// bison's own stack has no reserve, entries are pushed and cleared to grow it, its capacity is kept for later parses
+template<typename Stack>
+void reserve_stack(Stack& stack, size_t n) {
+  if constexpr(requires { stack.reserve(n); }) {
+    stack.reserve(n);
+  } else {
+    using symbol = remove_cvref_t<decltype(stack[0])>;
+    while(size_t(stack.size()) < n) {
+      stack.push(symbol());
+    }
+    stack.clear();
+  }
+}
+
 }
 
 }
@@ -209,14 +560,52 @@ void c11parser::C11Parser::error(const location& loc, const string& msg) {
   bisonParam.stats.parseStartTime = steady_clock::now();
   auto& loc = lexParam.loc;
 
+// keep line and offset a caller may have set to start partway into a file
   if(loc.begin.filename == nullptr) {
-    loc.initialize(&defaultInputName);
+    loc.begin.filename = loc.end.filename = &defaultInputName;
   }
 
-  if(!lexParam.is_typedefname) {
-    lexParam.is_typedefname = [&context = bisonParam.context](const string& id) -> bool {
-      return context.is_typedefname(id);
-    };
+  if(!lexParam.is_typedefname && !lexParam.context) {
+    lexParam.context = &bisonParam.context;
+  }
+
+// once per parser, a stack keeps its capacity from one parse to the next
+  if(bisonParam.reservedStack != &yystack_) {
+    reserve_stack(yystack_, bisonParam.stack_reserve());
+    bisonParam.reservedStack = &yystack_;
+  }
+
+  bisonParam.diagnostics.clear();
+  if(!lexParam.diagnostics) {
+    lexParam.diagnostics = &bisonParam.diagnostics;
+  }
+
+  lexParam.resource = bisonParam.resource;
+  lexParam.stop = 0;
+  lexParam.tokens = 0;
+  bisonParam.stopped = 0;
+// a depth limit is checked before every token, control every checkInterval tokens
+  auto interval = max<size_t>(bisonParam.control.checkInterval, 1);
+  auto everyToken = bisonParam.limits.maxStackDepth != 0;
+  lexParam.nextCheck = everyToken? 1: bisonParam.control.active()? interval: SIZE_MAX;
+  lexParam.checkpoint = [this, &stack = yystack_, interval, everyToken, nextControl = interval]() mutable {
+    lexParam.nextCheck += everyToken? 1: interval;
+    if(!bisonParam.check_stack_depth(stack.size(), lexParam.loc)) {
+      return bisonParam.stopped = 1;
+    }
+    if(!bisonParam.control.active() || lexParam.tokens < nextControl) {
+      return 0;
+    }
+    nextControl += interval;
+    return bisonParam.stopped = bisonParam.check_control(lexParam.loc, stack.size() * sizeof(stack[0]));
+  };
+
+  switch(bisonParam.entry) {
+  case ParseEntry::translation_unit: lexParam.startToken = 0; break;
+  case ParseEntry::expression: lexParam.startToken = token::START_EXPRESSION; break;
+  case ParseEntry::statement: lexParam.startToken = token::START_STATEMENT; break;
+  case ParseEntry::declaration: lexParam.startToken = token::START_DECLARATION; break;
+  case ParseEntry::type_name: lexParam.startToken = token::START_TYPE_NAME; break;
   }
 }
 
@@ -318,9 +707,16 @@ void c11parser::C11Parser::error(const location& loc, const string& msg) {
 %token                               WHILE                    "while"
 %token                               XOR_ASSIGN               "^="
 
+// never in input, the first token the lexer function returns for an entry point other than translation unit
+
+%token                               START_EXPRESSION         "start of expression"
+%token                               START_STATEMENT          "start of statement"
+%token                               START_DECLARATION        "start of declaration"
+%token                               START_TYPE_NAME          "start of type name"
+
 // tokens with values
 
-%token <string>                      NAME
+%token <Context::name>                NAME
 
 // GCC extensions
 
@@ -351,16 +747,23 @@ void c11parser::C11Parser::error(const location& loc, const string& msg) {
 %nterm <declarator>                  declarator_varname
 %nterm <declarator>                  direct_declarator
 
-%nterm <string>                      enumeration_constant
+%nterm <Context::name>                enumeration_constant
 %nterm <Context::context>            function_definition1
-%nterm <string>                      general_identifier
+%nterm <Context::name>                general_identifier
+%nterm <Context::name>                option_general_identifier_
 %nterm <Context::context>            parameter_type_list
 %nterm <Context::context>            save_context
-%nterm <string>                      typedef_name
-%nterm <string>                      var_name
+%nterm <Context::name>                typedef_name
+%nterm <Context::name>                var_name
 
 %nterm <Context::context>            scoped_parameter_type_list_
 
+%nterm <uint8_t>                     declaration_specifier
+%nterm <uint8_t>                     list_declaration_specifier_
+%nterm <uint8_t>                     list_eq1_type_specifier_unique_declaration_specifier_
+%nterm <uint8_t>                     list_ge1_type_specifier_nonunique_declaration_specifier_
+%nterm <uint8_t>                     storage_class_specifier
+
 // %precedence order is lowest to highest going down
 // resolve dangling else shift-reduce conflict
 %precedence below_ELSE
@@ -370,30 +773,76 @@ void c11parser::C11Parser::error(const location& loc, const string& msg) {
 %precedence below_GCC_ATTRIBUTE
 %precedence "__attribute__"
 
+// binary operator precedence and associativity for the flattened binary_expression rule, same as the C standard's chain of expression rules
+%left "||"
+%left "&&"
+%left "|"
+%left "^"
+%left "&"
+%left "==" "!="
+%left "<" ">" "<=" ">="
+%left "<<" ">>"
+%left "+" "-"
+%left "*" "/" "%"
+
 // the start or root symbol of grammar
 %start translation_unit_file
 
 %%
 
 translation_unit_file:
-  external_declaration translation_unit_file postprocess
-| external_declaration YYEOF postprocess
+  external_declaration_list YYEOF postprocess
+// snippet entry points, alternatives here rather than a new start symbol so a translation unit reduces the same rules as before
+| START_EXPRESSION expression YYEOF postprocess
+| START_STATEMENT statement YYEOF postprocess
+| START_DECLARATION declaration YYEOF postprocess
+| START_TYPE_NAME type_name YYEOF postprocess
+// error recovery for snippets always has a state to shift the error token in, postprocess fails the parse
+| START_EXPRESSION error postprocess
+| START_STATEMENT error postprocess
+| START_DECLARATION error postprocess
+| START_TYPE_NAME error postprocess
+
+// left recursive so the parser stack does not grow with the number of declarations
+external_declaration_list:
+  external_declaration
+| external_declaration_list external_declaration
 
 external_declaration:
   function_definition
 | declaration
 | gcc_external_declaration
+// error recovery skips to the end of the declaration
+// names declared in scopes that recovery discards before their end stay in the typedef context
+| error ";" {
+  bisonParam.recover_declarations(true);
+}
 
-function_definition: function_definition1[ctx] option_declaration_list_ compound_statement {
-  bisonParam.context.restore_context($ctx);
+function_definition: function_definition1[ctx] option_declaration_list_ function_body_begin compound_statement[body] {
+  bisonParam.context.restore_context(move($ctx));
+  if(bisonParam.skipFunctionBodies) {
+    bisonParam.skippedFunctionBodies.push_back(@body);
+  }
+  bisonParam.event_exit(ParseEventKind::function_definition, @$);
 }
 
 function_definition1: declaration_specifiers declarator_varname[d] {
+  if(!bisonParam.check_context_bytes(yystack_.size(), @$)) {
+    YYABORT;
+  }
   auto ctx = bisonParam.context.save_context();
   $d.reinstall_function_context(bisonParam.context);
-  $$ = ctx;
+  $$ = move(ctx);
+  bisonParam.pop_declaration_specifiers(true);
+  bisonParam.event_enter(ParseEventKind::function_definition, @$);
 } %prec below_GCC_ATTRIBUTE
 
+// midrule action for skipping function bodies
+// reduced with the opening brace already read as lookahead so the lexer starts skipping at the next token
+function_body_begin: %empty {
+  lexParam.skipFunctionBody = bisonParam.skipFunctionBodies;
+}
+
 option_declaration_list_:
   %empty
 | declaration_list
@@ -402,31 +851,58 @@ declaration_list:
   declaration
 | declaration_list declaration
 
-declaration:
-  declaration_specifiers option_init_declarator_list_declarator_varname__ ";"
-| declaration_specifiers_typedef option_init_declarator_list_declarator_typedefname__ ";"
-| static_assert_declaration
+declaration: declaration_specifiers option_init_declarator_list_declarator_varname__ ";" {
+  bisonParam.pop_declaration_specifiers();
+  bisonParam.event_exit(ParseEventKind::declaration, @$);
+}
+| declaration_specifiers_typedef option_init_declarator_list_declarator_typedefname__ ";" {
+  bisonParam.pop_declaration_specifiers();
+  bisonParam.event_exit(ParseEventKind::declaration, @$);
+}
+| static_assert_declaration {
+  bisonParam.event_exit(ParseEventKind::declaration, @$);
+}
+;
 
-declaration_specifiers:
-  list_eq1_type_specifier_unique_declaration_specifier_
-| list_ge1_type_specifier_nonunique_declaration_specifier_
+// storage classes of the specifiers are pushed for the declarators after them and popped by the rule the declaration ends with
+declaration_specifiers: list_eq1_type_specifier_unique_declaration_specifier_[s] {
+  bisonParam.push_declaration_specifiers($s);
+}
+| list_ge1_type_specifier_nonunique_declaration_specifier_[s] {
+  bisonParam.push_declaration_specifiers($s);
+}
+;
 
-list_eq1_type_specifier_unique_declaration_specifier_:
-  type_specifier_unique list_declaration_specifier_
-| declaration_specifier list_eq1_type_specifier_unique_declaration_specifier_
+list_eq1_type_specifier_unique_declaration_specifier_: type_specifier_unique list_declaration_specifier_[s] {
+  $$ = $s;
+}
+| declaration_specifier[s] list_eq1_type_specifier_unique_declaration_specifier_[t] {
+  $$ = $s | $t;
+}
+;
 
-list_ge1_type_specifier_nonunique_declaration_specifier_:
-  type_specifier_nonunique list_declaration_specifier_
-| type_specifier_nonunique list_ge1_type_specifier_nonunique_declaration_specifier_
-| declaration_specifier list_ge1_type_specifier_nonunique_declaration_specifier_
+list_ge1_type_specifier_nonunique_declaration_specifier_: type_specifier_nonunique list_declaration_specifier_[s] {
+  $$ = $s;
+}
+| type_specifier_nonunique list_ge1_type_specifier_nonunique_declaration_specifier_[s] {
+  $$ = $s;
+}
+| declaration_specifier[s] list_ge1_type_specifier_nonunique_declaration_specifier_[t] {
+  $$ = $s | $t;
+}
+;
 
 option_init_declarator_list_declarator_varname__:
   %empty
 | init_declarator_list_declarator_varname_
 
-declaration_specifiers_typedef:
-  list_eq1_eq1_TYPEDEF_type_specifier_unique_declaration_specifier_
-| list_eq1_ge1_TYPEDEF_type_specifier_nonunique_declaration_specifier_
+declaration_specifiers_typedef: list_eq1_eq1_TYPEDEF_type_specifier_unique_declaration_specifier_ {
+  bisonParam.push_declaration_specifiers(storage_none);
+}
+| list_eq1_ge1_TYPEDEF_type_specifier_nonunique_declaration_specifier_ {
+  bisonParam.push_declaration_specifiers(storage_none);
+}
+;
 
 list_eq1_eq1_TYPEDEF_type_specifier_unique_declaration_specifier_:
   "typedef" list_eq1_type_specifier_unique_declaration_specifier_
@@ -465,16 +941,19 @@ init_declarator_declarator_varname_:
 
 declarator_varname: declarator[d] {
   bisonParam.context.declare_varname($d.identifier());
+  bisonParam.declare($d.is_function()? DeclarationKind::function: DeclarationKind::variable, $d.identifier(), @d, true);
   $$ = move($d);
 }
 // gcc extension
 | gnu_attributes declarator[d] {
   bisonParam.context.declare_varname($d.identifier());
+  bisonParam.declare($d.is_function()? DeclarationKind::function: DeclarationKind::variable, $d.identifier(), @d, true);
   $$ = move($d);
 }
 
 declarator_typedefname: declarator[d] {
   bisonParam.context.declare_typedefname($d.identifier());
+  bisonParam.declare(DeclarationKind::typedef_name, $d.identifier(), @d, true);
   $$ = move($d);
 }
 
@@ -485,33 +964,38 @@ option_declarator_:
 declarator: direct_declarator[d] {
   $$ = move($d);
 }
+// a pointer to a plain name is no longer a name that parameters after it in parentheses make a function, as in (*f)(int)
 | pointer direct_declarator[d] {
-  $$ = move($d);
+  if(holds_alternative<identifier_declarator>($d)) {
+    $$ = other_declarator(move($d));
+  } else {
+    $$ = move($d);
+  }
 }
 
 direct_declarator: general_identifier[i] {
-  $$ = identifier_declarator{$i};
+  $$ = identifier_declarator{move($i)};
 }
 | "(" save_context declarator[d] ")" {
   $$ = move($d);
 }
 | direct_declarator[d] "[" option_type_qualifier_list_ option_assignment_expression_ "]" {
-  $$ = other_declarator($d);
+  $$ = other_declarator(move($d));
 }
 | direct_declarator[d] "[" "static" option_type_qualifier_list_ assignment_expression "]" {
-  $$ = other_declarator($d);
+  $$ = other_declarator(move($d));
 }
 | direct_declarator[d] "[" type_qualifier_list "static" assignment_expression "]" {
-  $$ = other_declarator($d);
+  $$ = other_declarator(move($d));
 }
 | direct_declarator[d] "[" option_type_qualifier_list_ "*" "]" {
-  $$ = other_declarator($d);
+  $$ = other_declarator(move($d));
 }
 | direct_declarator[d] "(" scoped_parameter_type_list_[ctx] ")" {
-  $$ = function_declarator($d, $ctx);
+  $$ = function_declarator(move($d), move($ctx));
 }
 | direct_declarator[d] "(" save_context option_identifier_list_ ")" {
-  $$ = other_declarator($d);
+  $$ = other_declarator(move($d), true);
 }
 // gcc extension
 | "(" save_context gnu_attributes declarator[d] ")" {
@@ -523,7 +1007,7 @@ option_type_qualifier_list_:
 | type_qualifier_list
 
 scoped_parameter_type_list_: save_context[ctx] parameter_type_list[x] {
-  bisonParam.context.restore_context($ctx);
+  bisonParam.context.restore_context(move($ctx));
   $$ = move($x);
 }
 ;
@@ -531,18 +1015,36 @@ scoped_parameter_type_list_: save_context[ctx] parameter_type_list[x] {
 static_assert_declaration:
   "_Static_assert" "(" constant_expression "," string_literal ")" ";"
 
-declaration_specifier:
-  storage_class_specifier
-| type_qualifier
-| function_specifier
-| alignment_specifier
+declaration_specifier: storage_class_specifier[s] {
+  $$ = $s;
+}
+| type_qualifier {
+  $$ = storage_none;
+}
+| function_specifier {
+  $$ = storage_none;
+}
+| alignment_specifier {
+  $$ = storage_none;
+}
+;
 
-storage_class_specifier:
-  "extern"
-| "static"
-| "_Thread_local"
-| "auto"
-| "register"
+storage_class_specifier: "extern" {
+  $$ = storage_extern;
+}
+| "static" {
+  $$ = storage_static;
+}
+| "_Thread_local" {
+  $$ = storage_thread_local;
+}
+| "auto" {
+  $$ = storage_auto;
+}
+| "register" {
+  $$ = storage_register;
+}
+;
 
 type_qualifier:
   "const"
@@ -562,8 +1064,11 @@ alignment_specifier:
   "_Alignas" "(" type_name ")"
 | "_Alignas" "(" constant_expression ")"
 
-compound_statement:
-  "{" option_block_item_list_ "}"
+compound_statement: "{" { bisonParam.enter_block(); bisonParam.event_enter(ParseEventKind::block, @1); } option_block_item_list_ "}" {
+  bisonParam.exit_block();
+  bisonParam.event_exit(ParseEventKind::block, @$);
+}
+;
 
 option_block_item_list_:
   %empty
@@ -575,16 +1080,34 @@ block_item_list:
 block_item:
   declaration
 | statement
+// error recovery skips to the end of the statement or declaration
+| error ";" {
+  bisonParam.recover_declarations(false);
+}
 
-statement:
-  labeled_statement
-| scoped_compound_statement_
-| expression_statement
-| scoped_selection_statement_
-| scoped_iteration_statement_
-| jump_statement
+statement: labeled_statement {
+  bisonParam.event_exit(ParseEventKind::statement, @$);
+}
+| scoped_compound_statement_ {
+  bisonParam.event_exit(ParseEventKind::statement, @$);
+}
+| expression_statement {
+  bisonParam.event_exit(ParseEventKind::statement, @$);
+}
+| scoped_selection_statement_ {
+  bisonParam.event_exit(ParseEventKind::statement, @$);
+}
+| scoped_iteration_statement_ {
+  bisonParam.event_exit(ParseEventKind::statement, @$);
+}
+| jump_statement {
+  bisonParam.event_exit(ParseEventKind::statement, @$);
+}
 // gcc extension
-| gcc_asm_statement
+| gcc_asm_statement {
+  bisonParam.event_exit(ParseEventKind::statement, @$);
+}
+;
 
 labeled_statement:
   general_identifier ":" statement
@@ -592,7 +1115,7 @@ labeled_statement:
 | "default" ":" statement
 
 scoped_compound_statement_: save_context[ctx] compound_statement {
-  bisonParam.context.restore_context($ctx);
+  bisonParam.context.restore_context(move($ctx));
 }
 ;
 
@@ -605,13 +1128,16 @@ option_expression_:
   %empty
 | expression
 
-scoped_selection_statement_: save_context[ctx] selection_statement {
-  bisonParam.context.restore_context($ctx);
+// selection and iteration statements are blocks of their own, C11 6.8.4p3 and 6.8.5p5, so a for declaration goes out of scope after the loop
+scoped_selection_statement_: save_context[ctx] { bisonParam.enter_block(); } selection_statement {
+  bisonParam.exit_block();
+  bisonParam.context.restore_context(move($ctx));
 }
 ;
 
-scoped_iteration_statement_: save_context[ctx] iteration_statement {
-  bisonParam.context.restore_context($ctx);
+scoped_iteration_statement_: save_context[ctx] { bisonParam.enter_block(); } iteration_statement {
+  bisonParam.exit_block();
+  bisonParam.context.restore_context(move($ctx));
 }
 ;
 
@@ -633,7 +1159,7 @@ iteration_statement:
 | "for" "(" declaration option_expression_ ";" option_expression_ ")" scoped_statement_
 
 scoped_statement_: save_context[ctx] statement {
-  bisonParam.context.restore_context($ctx);
+  bisonParam.context.restore_context(move($ctx));
 }
 ;
 
@@ -655,9 +1181,13 @@ list___anonymous_1_:
 | type_qualifier list___anonymous_1_
 | alignment_specifier list___anonymous_1_
 
-list_declaration_specifier_:
-  %empty
-| declaration_specifier list_declaration_specifier_
+list_declaration_specifier_: %empty {
+  $$ = storage_none;
+}
+| declaration_specifier[s] list_declaration_specifier_[t] {
+  $$ = $s | $t;
+}
+;
 
 list_eq1_TYPEDEF_declaration_specifier_:
   "typedef" list_declaration_specifier_
@@ -674,15 +1204,20 @@ list_ge1_type_specifier_nonunique___anonymous_1_:
 | type_qualifier list_ge1_type_specifier_nonunique___anonymous_1_
 | alignment_specifier list_ge1_type_specifier_nonunique___anonymous_1_
 
-option_general_identifier_:
-  %empty
-| general_identifier
+option_general_identifier_: %empty {
+}
+| general_identifier[i] {
+  $$ = move($i);
+}
+;
 
 // CAUTION keep typedef_name_spec and general_identifier rules together with typedef_name_spec above general_identifier
 // this is required for the desired resolution of 3 reduce-reduce conflicts involving these two rules based on bison's default reduction using the earlier occurring rule
 // see the bison report generated in the build for more details
-typedef_name_spec:
-  typedef_name
+typedef_name_spec: typedef_name[i] {
+  bisonParam.use($i, @i);
+}
+;
 
 general_identifier: typedef_name[i] {
   $$ = move($i);
@@ -736,8 +1271,9 @@ postfix_expression:
 | gcc_postfix_expression
 
 
-primary_expression:
-  var_name
+primary_expression: var_name[i] {
+  bisonParam.use($i, @i);
+}
 | CONSTANT
 | string_literal
 | "(" expression ")"
@@ -745,9 +1281,13 @@ primary_expression:
 // gcc extension
 | gcc_primary_expression
 
-expression:
-  assignment_expression
-| expression "," assignment_expression
+expression: assignment_expression {
+  bisonParam.event_exit(ParseEventKind::expression, @$);
+}
+| expression "," assignment_expression {
+  bisonParam.event_exit(ParseEventKind::expression, @$);
+}
+;
 
 option_argument_expression_list_:
   %empty
@@ -776,75 +1316,35 @@ cast_expression:
   unary_expression
 | "(" type_name ")" cast_expression
 
-additive_expression:
-  multiplicative_expression
-| additive_expression additive_operator multiplicative_expression
-
-additive_operator:
-  "+"
-| "-"
-
-multiplicative_expression:
+// all binary operators in one rule resolved by operator precedence
+// a single unit reduction from cast_expression replaces the chain of ten from multiplicative_expression up to logical_or_expression
+binary_expression:
   cast_expression
-| multiplicative_expression multiplicative_operator cast_expression
-
-multiplicative_operator:
-  "*"
-| "/"
-| "%"
-
-relational_expression:
-  shift_expression
-| relational_expression relational_operator shift_expression
-
-relational_operator:
-  "<"
-| ">"
-| "<="
-| ">="
-
-shift_expression:
-  additive_expression
-| shift_expression shift_operator additive_expression
-
-shift_operator:
-  "<<"
-| ">>"
+| binary_expression "*" binary_expression
+| binary_expression "/" binary_expression
+| binary_expression "%" binary_expression
+| binary_expression "+" binary_expression
+| binary_expression "-" binary_expression
+| binary_expression "<<" binary_expression
+| binary_expression ">>" binary_expression
+| binary_expression "<" binary_expression
+| binary_expression ">" binary_expression
+| binary_expression "<=" binary_expression
+| binary_expression ">=" binary_expression
+| binary_expression "==" binary_expression
+| binary_expression "!=" binary_expression
+| binary_expression "&" binary_expression
+| binary_expression "^" binary_expression
+| binary_expression "|" binary_expression
+| binary_expression "&&" binary_expression
+| binary_expression "||" binary_expression
 
 constant_expression:
   conditional_expression
 
 conditional_expression:
-  logical_or_expression
-| logical_or_expression "?" expression ":" conditional_expression
-
-logical_or_expression:
-  logical_and_expression
-| logical_or_expression "||" logical_and_expression
-
-logical_and_expression:
-  inclusive_or_expression
-| logical_and_expression "&&" inclusive_or_expression
-
-inclusive_or_expression:
-  exclusive_or_expression
-| inclusive_or_expression "|" exclusive_or_expression
-
-exclusive_or_expression:
-  and_expression
-| exclusive_or_expression "^" and_expression
-
-and_expression:
-  equality_expression
-| and_expression "&" equality_expression
-
-equality_expression:
-  relational_expression
-| equality_expression equality_operator relational_expression
-
-equality_operator:
-  "=="
-| "!="
+  binary_expression
+| binary_expression "?" expression ":" conditional_expression
 
 option_assignment_expression_:
   %empty
@@ -892,8 +1392,9 @@ type_specifier_unique:
 | gcc_type_specifier_unique
 | gcc_struct_or_union_specifier
 
-struct_or_union_specifier:
-  struct_or_union option_general_identifier_ "{" struct_declaration_list "}"
+struct_or_union_specifier: struct_or_union option_general_identifier_[i] "{" struct_declaration_list "}" {
+  bisonParam.declare(DeclarationKind::tag, $i, @$, false);
+}
 | struct_or_union general_identifier
 
 struct_or_union:
@@ -928,8 +1429,9 @@ struct_declarator:
 // gcc extension
 | gcc_struct_declarator
 
-enum_specifier:
-  "enum" option_general_identifier_ "{" enumerator_list option_COMMA_ "}"
+enum_specifier: "enum" option_general_identifier_[i] "{" enumerator_list option_COMMA_ "}" {
+  bisonParam.declare(DeclarationKind::tag, $i, @$, false);
+}
 | "enum" general_identifier
 
 enumerator_list:
@@ -938,9 +1440,11 @@ enumerator_list:
 
 enumerator: enumeration_constant[i] {
   bisonParam.context.declare_varname($i);
+  bisonParam.declare(DeclarationKind::enumerator, $i, @$, false);
 }
 | enumeration_constant[i] "=" constant_expression {
   bisonParam.context.declare_varname($i);
+  bisonParam.declare(DeclarationKind::enumerator, $i, @$, false);
 }
 ;
 
@@ -972,9 +1476,13 @@ parameter_list:
   parameter_declaration
 | parameter_list "," parameter_declaration
 
-parameter_declaration:
-  declaration_specifiers declarator_varname
-| declaration_specifiers option_abstract_declarator_
+parameter_declaration: declaration_specifiers declarator_varname {
+  bisonParam.pop_declaration_specifiers();
+}
+| declaration_specifiers option_abstract_declarator_ {
+  bisonParam.pop_declaration_specifiers();
+}
+;
 
 option_identifier_list_:
   %empty
@@ -1273,7 +1781,9 @@ use var_name instead of general_identifier since identifier cannot be type_name
 gcc_struct_or_union_specifier:
   //struct_or_union gnu_attributes option_general_identifier_ "{" struct_declaration_list "}"
   struct_or_union gnu_attributes "{" struct_declaration_list "}"
-| struct_or_union gnu_attributes var_name "{" struct_declaration_list "}"
+| struct_or_union gnu_attributes var_name[i] "{" struct_declaration_list "}" {
+  bisonParam.declare(DeclarationKind::tag, $i, @$, false);
+}
 
 /*
 from gcc c-parser.cc
@@ -1418,6 +1928,9 @@ gcc_postfix_expression:
 // midrule actions
 
 save_context: %empty {
+  if(!bisonParam.check_context_bytes(yystack_.size(), @$)) {
+    YYABORT;
+  }
   $$ = bisonParam.context.save_context();
 }
 ;
@@ -1428,6 +1941,10 @@ postprocess: %empty {
   auto& stats = b.stats;
   stats.parseEndTime = steady_clock::now();
   stats.parseTimeTakenSec = stats.parseEndTime - stats.parseStartTime;
+// input was parsed to the end by recovering from errors but the parse still fails
+  if(!b.diagnostics.empty()) {
+    YYABORT;
+  }
 }
 
 %%
@@ -1436,18 +1953,35 @@ postprocess: %empty {
 
 #ifdef BUILD_BISON_MAIN
 
+#include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sys/stat.h>
 
+#include <limits>
 #include <string>
+#include <fstream>
 #include <iostream>
 #include <optional>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 #include <fmt/format.h>
 
 #include "lexer/c11parser_lexer.h"
+#include "parser/batch_parse.h"
+#include "parser/command_line.h"
+#include "parser/decl_index.h"
+#include "parser/frame_protocol.h"
+#include "parser/header_regions.h"
+#include "parser/parallel_parse.h"
+#include "parser/preprocessor.h"
+#include "parser/result_cache.h"
+#include "parser/symbol_db.h"
+#include "parser/watch.h"
 #include "c11parser.bison.h"
 
 using namespace std;
@@ -1456,17 +1990,193 @@ using namespace fmt;
 using namespace c11parser;
 
 void usage() {
-  puts("Usage: c11parse [-h | --help] [--atomic-permissive-syntax] [--enable-gcc-extensions] [--debug]");
-  puts("It prints nothing if input is valid, otherwise it prints an error message with line numbers");
+  puts("Usage: c11parse [-h | --help] [--atomic-permissive-syntax] [--enable-gcc-extensions] [--debug] [-j N] [--preprocess [-I DIR] [-D NAME[=VALUE]] [-U NAME]] [--watch DIR]... [--emit-decls[=FILE]] [--emit-uses[=FILE]] [--symbol-db FILE [--lookup NAME]...] [file | @listfile]...");
+  puts("It parses stdin when no files are given and prints nothing if input is valid, otherwise it prints every error found with line numbers");
+  puts("With files it parses each as a separate translation unit and prints a summary, @listfile names a file with one filename per line");
   puts("");
   puts("Options:");
   puts("--atomic-permissive-syntax: disables strict C18 syntax, off by default");
   puts("--enable-gcc-extensions: enable GCC extensions to C, disabled by default");
   puts("--debug: turns on Bison parser and Flex lexer debug traces, off by default");
   puts("--stats: print timing stats on successful parse, off by default");
+  puts("--skip-function-bodies: skip over function bodies without parsing them, off by default");
+  puts("--threads N: parse input in speculative parallel chunks with N threads, 0 for all cores, off by default");
+  puts("--timeout MS: stop the parse after MS milliseconds, no limit by default");
+  puts("--jobs N | -j N: parse files on N threads, 0 for all cores, all cores by default");
+  puts("--cache-dir DIR: keep results in DIR and answer from there when input, options and parser are unchanged, no cache by default");
+  puts("--skip-repeated-headers: with files, parse text a file includes from headers once and only apply its typedef names to later files including it the same way, off by default");
+  puts("--preprocess: run input through the C preprocessor and parse its output as it is written, $CPP or cc -E by default, errors point to source lines, off by default");
+  puts("--cpp CMD: preprocessor command split at spaces, implies --preprocess");
+  puts("--builtin-cpp: preprocess in this process with the parser's own preprocessor, given the predefined macros and include paths of the --cpp compiler, implies --preprocess");
+  puts("-I DIR | -D NAME[=VALUE] | -U NAME | --cpp-arg ARG: passed to the preprocessor in the order given, imply --preprocess");
+  puts("--prefetch: with files, read files ahead of the parser threads with io_uring or else reader threads, off by default");
+  puts("--prefetch-depth N: files read at once when prefetching, at most 256, 32 by default, implies --prefetch");
+  puts("--prefetch-mb N: megabytes of files read ahead and not yet parsed, 256 by default, implies --prefetch");
+  puts("--prefetch-threads: read ahead with blocking reads on reader threads instead of io_uring, implies --prefetch");
+  puts("--watch DIR: parse sources under DIR, then parse again each one a save changes, or that includes a changed header with --preprocess, until interrupted, can be repeated");
+  puts("--emit-decls[=FILE]: with stdin, write every declaration with its kind, name, storage class, scope depth and location to FILE or stdout as it is parsed, in a length-prefixed binary format described in parser/decl_index.h");
+  puts("--decls-format binary|jsonl: format of --emit-decls output, binary by default");
+  puts("--emit-uses[=FILE]: with stdin, resolve every identifier in an expression and typedef name in a type to its declaration and write the pairs of offsets to FILE or stdout after the parse, in the columnar format described in parser/name_resolution.h");
+  puts("--symbol-db FILE: with files, merge the file-scope declarations of every file into the symbol database FILE, replacing those of files in it already, a file unchanged since it was added is not parsed again unless preprocessed, see parser/symbol_db.h");
+  puts("--lookup NAME: with --symbol-db, print every declaration of NAME in the database after any update, a NAME ending in * prints those of every name starting with the rest, can be repeated");
+  puts("--frames: read length-prefixed name and source frames from stdin until end of input and write a status and diagnostics frame to stdout for each");
   puts("--help | -h: prints usage help");
 }
 
+// errors and failures are printed in the order files were given
+void print_batch(const BatchParseResult& result, const BatchParseOptions& options, bool printStats) {
+  for(auto& file: result.files) {
+    print_diagnostics(file.diagnostics);
+    if(file.status != 0) {
+      fprintf(stderr, "%s: parse failed\n", file.filename.c_str());
+    }
+    if(printStats) {
+      printf("%s parse_time %.9f sec bytes %zu\n", file.filename.c_str(), file.parseTime.count(), file.bytes);
+    }
+  }
+  printf("files %zu passed %zu failed %zu bytes %zu\n", result.files.size(), result.passed, result.failed, result.bytes);
+  if(options.cache) {
+    printf("cached %zu\n", result.cached);
+  }
+  if(options.prefetch) {
+    printf("prefetched %zu waited %zu\n", result.prefetched, result.prefetchWaits);
+  }
+  if(options.headers) {
+    printf("header_regions %zu skipped %zu skipped_bytes %zu\n", options.headers->size(), options.headers->hits.load(), options.headers->skippedBytes.load());
+  }
+  printf("wall_time %.9f sec parse_time %.9f sec stolen %zu\n", result.wallTime.count(), result.parseTime.count(), result.stolen);
+  fflush(stdout);
+}
+
+// files parsed in parallel
+int batch_parse(const vector<string>& files, const BatchParseOptions& options, bool printStats) {
+  auto result = BatchParser(options)(files);
+  print_batch(result, options, printStats);
+  return result.failed? 1: 0;
+}
+
+// files parsed into the symbol database at path, a file unchanged since the database has it is not parsed again unless preprocessed
+// preprocessed files are always parsed since a header they include may have changed
+// a file that failed to parse is stored with hash 0 so it is parsed and fails again on every run until it is fixed
+int update_symbols(const vector<string>& files, BatchParseOptions options, const string& path, bool printStats) {
+  optional<SymbolDatabase> earlier;
+  try {
+    if(filesystem::exists(path)) {
+      earlier.emplace(path);
+    }
+  } catch(const exception& e) {
+    fprintf(stderr, "cannot read symbol database: %s\n", e.what());
+    return 1;
+  }
+
+// content hash of every unit in the database by path, the paths are views into the mapped database
+  unordered_map<std::string_view, uint64_t> hashes;
+  if(earlier && !options.preprocessor) {
+    hashes.reserve(earlier->units().size());
+    for(auto& unit: earlier->units()) {
+      hashes.emplace(earlier->path(unit), unit.hash);
+    }
+  }
+
+  vector<string> parse;
+  vector<TranslationUnit> units;
+  unordered_set<string> seen;
+  size_t unchanged = 0;
+  for(auto& file: files) {
+    auto unit = translation_unit(file);
+    if(!seen.insert(unit.path).second) {
+      continue;
+    }
+    if(auto it = hashes.find(unit.path); it != hashes.end() && unit.hash && it->second == unit.hash) {
+      ++unchanged;
+      continue;
+    }
+    parse.push_back(file);
+    units.push_back(std::move(unit));
+  }
+
+  options.symbols = true;
+  auto result = BatchParser(options)(parse);
+  print_batch(result, options, printStats);
+  for(size_t i = 0; i < units.size(); ++i) {
+    if(result.files[i].status != 0) {
+      units[i].hash = 0;
+    }
+  }
+
+  SymbolDatabaseBuilder builder(options.threads);
+  if(earlier) {
+    builder.keep(*earlier);
+  }
+  builder.add(std::move(result.symbols), std::move(units));
+  try {
+    builder.write(path);
+  } catch(const exception& e) {
+    fprintf(stderr, "cannot write symbol database: %s\n", e.what());
+    return 1;
+  }
+  printf("symbols %zu units %zu unchanged %zu kept_symbols %zu\n", builder.symbols(), builder.units(), unchanged, builder.kept_symbols());
+  fflush(stdout);
+  return result.failed? 1: 0;
+}
+
+// every declaration of each name, or of every name with the prefix before a trailing *
+int lookup_symbols(const string& path, const vector<string>& names) {
+  try {
+    SymbolDatabase db(path);
+    for(auto& name: names) {
+      auto symbols = name.ends_with('*')? db.prefix(name.substr(0, name.size() - 1)): db.lookup(name);
+      for(auto& symbol: symbols) {
+        auto storage = storage_class_names(symbol.storage);
+        auto unit = db.unit(symbol);
+        auto unitPath = unit? db.path(*unit): std::string_view();
+        auto symbolName = db.name(symbol);
+        auto file = db.file(symbol);
+        printf("%.*s %s%s%s%s %.*s:%u:%u %.*s\n", (int)symbolName.size(), symbolName.data(), declaration_kind_name(symbol.declaration_kind()).data(),
+          storage.empty()? "": " ", storage.c_str(), symbol.definition()? " definition": "",
+          (int)file.size(), file.data(), symbol.line, symbol.column, (int)unitPath.size(), unitPath.data());
+      }
+    }
+  } catch(const exception& e) {
+    fprintf(stderr, "cannot read symbol database: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+// sources under dirs parsed and then parsed again as they change until SIGINT or SIGTERM
+int watch(const vector<string>& dirs, const SourceWatcherOptions& options, bool printStats) {
+// signals are taken by a thread of their own, blocked before the parser threads start so they inherit the mask
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  try {
+    SourceWatcher watcher(dirs, options);
+    jthread waiter([&] {
+      int signal;
+      sigwait(&signals, &signal);
+      watcher.stop();
+    });
+
+    print_batch(watcher.scan(), options.batch, printStats);
+    printf("watching %zu directories\n", watcher.directories());
+    fflush(stdout);
+    for(BatchParseResult result; !(result = watcher.changes()).files.empty();) {
+      print_batch(result, options.batch, printStats);
+    }
+
+    kill(getpid(), SIGTERM);
+    waiter.join();
+    return watcher.failed()? 1: 0;
+  } catch(const std::system_error& e) {
+    fprintf(stderr, "cannot watch: %s\n", e.what());
+    return 1;
+  }
+}
+
 int main(int argc, char* argv[])
 {
   ios_base::sync_with_stdio(false);
@@ -1476,6 +2186,26 @@ int main(int argc, char* argv[])
   int enableGccExtensions = 0;
   int debug = 0;
   int printStats = 0;
+  int skipFunctionBodies = 0;
+  int frames = 0;
+  int skipRepeatedHeaders = 0;
+  int preprocess = 0;
+  int builtinCpp = 0;
+  PreprocessorOptions preprocessorOptions;
+  vector<string> preprocessorArgs;
+  optional<unsigned> threads;
+  optional<milliseconds> timeout;
+  unsigned jobs = 0;
+  string cacheDir;
+  vector<string> watchDirs;
+  int prefetch = 0;
+  int prefetchThreads = 0;
+  PrefetchOptions prefetchOptions;
+  optional<string> declsFile;
+  optional<string> usesFile;
+  DeclarationWriterOptions declsOptions;
+  string symbolDb;
+  vector<string> lookups;
 
   auto inputFilename = "stdin"s;
   string changefile;
@@ -1485,15 +2215,117 @@ int main(int argc, char* argv[])
     {"enable-gcc-extensions", no_argument, &enableGccExtensions, 1},
     {"debug", no_argument, &debug, 1},
     {"stats", no_argument, &printStats, 1},
+    {"skip-function-bodies", no_argument, &skipFunctionBodies, 1},
+    {"frames", no_argument, &frames, 1},
+    {"skip-repeated-headers", no_argument, &skipRepeatedHeaders, 1},
+    {"preprocess", no_argument, &preprocess, 1},
+    {"cpp", required_argument, 0, 'P'},
+    {"builtin-cpp", no_argument, &builtinCpp, 1},
+    {"cpp-arg", required_argument, 0, 'A'},
+    {"threads", required_argument, 0, 't'},
+    {"timeout", required_argument, 0, 'T'},
+    {"jobs", required_argument, 0, 'j'},
+    {"cache-dir", required_argument, 0, 'C'},
+    {"watch", required_argument, 0, 'W'},
+    {"prefetch", no_argument, &prefetch, 1},
+    {"prefetch-depth", required_argument, 0, 'Q'},
+    {"prefetch-mb", required_argument, 0, 'M'},
+    {"prefetch-threads", no_argument, &prefetchThreads, 1},
+    {"emit-decls", optional_argument, 0, 'E'},
+    {"decls-format", required_argument, 0, 'F'},
+    {"emit-uses", optional_argument, 0, 'X'},
+    {"symbol-db", required_argument, 0, 'S'},
+    {"lookup", required_argument, 0, 'L'},
     {"help", no_argument, 0, 'h'},
     {0, 0, 0, 0}
   };
 
-  for(int i, optLetter; (optLetter = getopt_long(argc, argv, "h", opts, &i)) != -1;) {
+  for(int i, optLetter; (optLetter = getopt_long(argc, argv, "hj:I:D:U:", opts, &i)) != -1;) {
+    optional<unsigned long> n;
     switch(optLetter) {
 // 0 means long option variable in opts entry was set to its value
     case 0:
       break;
+    case 't':
+      if(!(n = option_number(optarg))) {
+        return bad_number(optarg, usage);
+      }
+      threads = *n;
+      break;
+    case 'T':
+      if(!(n = option_number(optarg))) {
+        return bad_number(optarg, usage);
+      }
+      timeout = milliseconds(*n);
+      break;
+    case 'j':
+      if(!(n = option_number(optarg))) {
+        return bad_number(optarg, usage);
+      }
+      jobs = *n;
+      break;
+    case 'C':
+      cacheDir = optarg;
+      break;
+    case 'W':
+      watchDirs.push_back(optarg);
+      break;
+// without io_uring the depth is also the number of reader threads
+    case 'Q':
+      if(!(n = option_number(optarg, 256))) {
+        return bad_number(optarg, usage);
+      }
+      prefetchOptions.queueDepth = *n;
+      prefetch = 1;
+      break;
+    case 'M':
+      if(!(n = option_number(optarg, numeric_limits<size_t>::max() >> 20))) {
+        return bad_number(optarg, usage);
+      }
+      prefetchOptions.memoryLimit = *n << 20;
+      prefetch = 1;
+      break;
+    case 'E':
+      declsFile = optarg? optarg: "-";
+      break;
+    case 'X':
+      usesFile = optarg? optarg: "-";
+      break;
+    case 'S':
+      symbolDb = optarg;
+      break;
+    case 'L':
+      lookups.push_back(optarg);
+      break;
+    case 'F':
+      if(optarg == "binary"s) {
+        declsOptions.format = DeclarationFormat::binary;
+      } else if(optarg == "jsonl"s) {
+        declsOptions.format = DeclarationFormat::jsonl;
+      } else {
+        fprintf(stderr, "unknown declaration format %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'P': {
+      preprocessorOptions.command.clear();
+      istringstream words(optarg);
+      for(string word; words >> word;) {
+        preprocessorOptions.command.push_back(word);
+      }
+      preprocess = 1;
+      break;
+    }
+    case 'I':
+    case 'D':
+    case 'U':
+      preprocessorArgs.push_back("-"s + (char)optLetter + optarg);
+      preprocess = 1;
+      break;
+    case 'A':
+      preprocessorArgs.push_back(optarg);
+      preprocess = 1;
+      break;
     case 'h':
       usage();
       return 0;
@@ -1511,19 +2343,246 @@ int main(int argc, char* argv[])
     .enableGccExtensions = (bool)enableGccExtensions,
   };
 
-  BisonParam bisonParam;
-  LexParam lexParam{.loc = location(&inputFilename)};
+  vector<string> files;
+  if(!expand_file_list(argc, argv, optind, files)) {
+    return 1;
+  }
+
+  optional<ResultCache> cache;
+  if(!cacheDir.empty()) {
+    try {
+      cache.emplace(cacheDir);
+    } catch(const filesystem::filesystem_error& e) {
+      fprintf(stderr, "cannot use cache directory: %s\n", e.what());
+      return 1;
+    }
+  }
+
+// declarations come from one parse of stdin by this thread, the batch and chunked parsers run many parsers at once
+  if((declsFile || usesFile) && (frames || !files.empty() || !watchDirs.empty() || threads)) {
+    fputs("--emit-decls and --emit-uses parse stdin alone, not with files, --watch, --threads or --frames\n", stderr);
+    return 1;
+  }
+
+// the database takes the files of one batch, lookups read it without parsing anything
+  if(!symbolDb.empty() && (frames || !watchDirs.empty() || threads || (files.empty() && lookups.empty()))) {
+    fputs("--symbol-db takes files or --lookup, not --watch, --threads or --frames\n", stderr);
+    return 1;
+  }
+  if(!lookups.empty() && symbolDb.empty()) {
+    fputs("--lookup needs --symbol-db\n", stderr);
+    return 1;
+  }
+  if(!symbolDb.empty() && files.empty()) {
+    return lookup_symbols(symbolDb, lookups);
+  }
+
+  if(frames) {
+    try {
+      FrameServer({.lexerOptions = lexer.options, .skipFunctionBodies = (bool)skipFunctionBodies, .timeout = timeout}).serve(cin, cout);
+    } catch(const runtime_error& e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+    return 0;
+  }
+
+// the built-in preprocessor asks the compiler, which gets the extra arguments such as -std, for its macros and paths and handles -I, -D and -U itself
+  BuiltinPreprocessorOptions builtinOptions;
+  SourceFileCache sourceFiles;
+  if(builtinCpp) {
+    preprocess = 1;
+    auto compiler = preprocessorOptions.command;
+    erase(compiler, "-E"s);
+    for(auto& arg: preprocessorArgs) {
+      if(!arg.starts_with("-I") && !arg.starts_with("-D") && !arg.starts_with("-U")) {
+        compiler.push_back(arg);
+      }
+    }
+    builtinOptions = builtin_options_from(compiler);
+    for(auto& arg: preprocessorArgs) {
+      auto value = arg.substr(min<size_t>(arg.size(), 2));
+      if(arg.starts_with("-I")) {
+        builtinOptions.includeDirs.push_back(value);
+      } else if(arg.starts_with("-D")) {
+        auto eq = value.find('=');
+        builtinOptions.predefined += "#define " + (eq == string::npos? value + " 1": value.substr(0, eq) + " " + value.substr(eq + 1)) + "\n";
+      } else if(arg.starts_with("-U")) {
+        builtinOptions.predefined += "#undef " + value + "\n";
+      }
+    }
+    builtinOptions.files = &sourceFiles;
+    preprocessorOptions.builtin = &builtinOptions;
+  }
+  ranges::copy(preprocessorArgs, back_inserter(preprocessorOptions.command));
+
+  HeaderRegionCache headers;
+  prefetchOptions.uring = !prefetchThreads;
+  BatchParseOptions batchOptions{.threads = jobs, .lexerOptions = lexer.options, .skipFunctionBodies = (bool)skipFunctionBodies, .timeout = timeout, .cache = cache? &*cache: nullptr, .headers = skipRepeatedHeaders? &headers: nullptr, .preprocessor = preprocess? &preprocessorOptions: nullptr, .prefetch = prefetch || prefetchThreads? &prefetchOptions: nullptr};
+  if(!watchDirs.empty()) {
+    return watch(watchDirs, {.batch = batchOptions}, printStats);
+  }
+  if(!symbolDb.empty()) {
+    auto status = update_symbols(files, batchOptions, symbolDb, printStats);
+    if(!lookups.empty() && filesystem::exists(symbolDb)) {
+      status = max(status, lookup_symbols(symbolDb, lookups));
+    }
+    return status;
+  }
+  if(!files.empty()) {
+    return batch_parse(files, batchOptions, printStats);
+  }
+
+// stdin through the preprocessor, the lexer reads its output as it comes unless the input is needed whole
+  optional<Preprocessor> preprocessor;
+  istream* source = &cin;
+  if(preprocess) {
+    try {
+      preprocessor.emplace("-", preprocessorOptions);
+    } catch(const std::system_error& e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+    source = &preprocessor->output();
+  }
+// a failed preprocess leaves partial output and any parse errors in it are not worth reporting alone
+  auto preprocessed = [&] {
+    if(preprocessor) {
+      if(auto status = preprocessor->wait(); status != 0) {
+        fprintf(stderr, "preprocessor exited with status %d\n", status);
+        return false;
+      }
+    }
+    return true;
+  };
+  vector<Linemarker> linemarkers;
+
+// a cache hit answers without lexing, the input is read whole to hash it
+// declarations and uses need a parse so the cache is not used with them
+  if(declsFile || usesFile) {
+    cache.reset();
+  }
+  string input;
+  string key;
+  if(cache || threads) {
+    input.assign(istreambuf_iterator<char>(*source), {});
+    if(!preprocessed()) {
+      return 1;
+    }
+    if(preprocessor) {
+      linemarkers = read_linemarkers(input);
+    }
+  }
+  if(cache) {
+    key = ResultCache::key(input, lexer.options, skipFunctionBodies);
+    int status;
+    vector<Diagnostic> diagnostics;
+    if(cache->load(key, status, diagnostics, &inputFilename)) {
+      map_to_source(diagnostics, linemarkers);
+      print_diagnostics(diagnostics);
+      if(status != 0) {
+        fputs("parse failed\n", stderr);
+        return status;
+      }
+      if(printStats) {
+        puts("cache_hit");
+      }
+      return 0;
+    }
+  }
+
+  if(threads) {
+    auto start = steady_clock::now();
+    auto result = ParallelParser({.threads = *threads, .lexerOptions = lexer.options})(input, &inputFilename);
+    duration<double> timeTaken = steady_clock::now() - start;
+    if(cache) {
+      cache->store(key, result.status, result.diagnostics);
+    }
+    map_to_source(result.diagnostics, linemarkers);
+    print_diagnostics(result.diagnostics);
+    if(result.status != 0) {
+      fputs("parse failed\n", stderr);
+      return result.status;
+    }
+    if(printStats) {
+      printf("parse_time %.9f sec\n", timeTaken.count());
+      printf("chunks %zu reparsed %zu\n", result.chunks, result.reparsed);
+    }
+    return 0;
+  }
+
+  BisonParam bisonParam{.skipFunctionBodies = (bool)skipFunctionBodies};
+  ispanstream inputStream(span<const char>(input.data(), input.size()));
+  if(cache) {
+    lexer.reset(inputStream);
+  } else if(preprocessor) {
+    lexer.reset(*source);
+  }
+  if(timeout) {
+    bisonParam.control.deadline = steady_clock::now() + *timeout;
+  }
+  LexParam lexParam{.loc = location(&inputFilename), .linemarkers = preprocessor && !cache? &linemarkers: nullptr};
+
+  optional<ofstream> declsOut;
+  optional<DeclarationWriter> decls;
+  if(declsFile) {
+    if(*declsFile != "-") {
+      declsOut.emplace(*declsFile, ios::binary);
+      if(!*declsOut) {
+        fprintf(stderr, "cannot write %s\n", declsFile->c_str());
+        return 1;
+      }
+    }
+    declsOptions.linemarkers = preprocessor? &linemarkers: nullptr;
+    decls.emplace(declsOut? *declsOut: cout, declsOptions);
+    bisonParam.events = &*decls;
+  }
+  NameResolver resolver;
+  if(usesFile) {
+    bisonParam.resolver = &resolver;
+  }
 
-  C11Parser parser([&lexer](LexParam& lexParam) -> C11Parser::symbol_type {
-    return lexer.yylex(lexParam);
-  },
-  bisonParam,
-  lexParam);
+  C11Parser parser(lexer, bisonParam, lexParam);
 
   lexer.set_debug(debug);
   parser.set_debug_level(debug);
 
-  if(auto ev = parser(); ev != 0) {
+  auto ev = bisonParam.status(parser());
+  if(decls) {
+    decls->close();
+    if(!decls->good()) {
+      fputs("cannot write declarations\n", stderr);
+      return 1;
+    }
+  }
+  if(usesFile) {
+    auto& uses = resolver.index();
+    bool written;
+    if(*usesFile == "-") {
+      write_use_index(cout, uses);
+      written = (bool)cout.flush();
+    } else {
+      ofstream out(*usesFile, ios::binary);
+      write_use_index(out, uses);
+      written = (bool)out.flush();
+    }
+    if(!written) {
+      fprintf(stderr, "cannot write %s\n", usesFile->c_str());
+      return 1;
+    }
+    if(printStats) {
+      printf("uses %zu unresolved %zu\n", uses.size(), (size_t)ranges::count(uses.declarations, UseIndex::unresolved));
+    }
+  }
+  if(!preprocessed()) {
+    return 1;
+  }
+  if(cache) {
+    cache->store(key, ev, bisonParam.diagnostics);
+  }
+  map_to_source(bisonParam.diagnostics, linemarkers);
+  print_diagnostics(bisonParam.diagnostics);
+  if(ev != 0) {
     fputs("parse failed\n", stderr);
     return ev;
   }
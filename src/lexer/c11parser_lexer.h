@@ -53,6 +53,10 @@ public:
 
   explicit Lexer(istream& yyin_arg): yyFlexLexer(&yyin_arg) {}
 
+// start lexing new input from the beginning, keeps the allocated flex buffer and start condition stack for reuse
+// implemented in the flex file since it needs flex start condition macros
+  void reset(istream& yyin_arg);
+
 private:
 
   using yyFlexLexer::yylex;
@@ -74,9 +78,31 @@ private:
 // identifier to lookup and disambiguate between VARIABLE and TYPE tokens in next yylex call
   string identifierToLookup;
 
+// nesting depth of braces inside a function body being skipped
+  int skipBraceDepth = 0;
+
 private:
 
-  C11Parser::symbol_type checkToken(const C11Parser::symbol_type& token) {
+// advance location over matched text that can contain newlines
+  static void advance(location& loc, const char* text, size_t len) {
+    auto col = text;
+    for(auto p = text, end = text + len; p != end; ++p) {
+      if(*p == '\n') {
+        loc.columns(p - col);
+        loc.lines();
+        col = p + 1;
+      }
+    }
+    loc.columns(text + len - col);
+  }
+
+// record a lexical error and return the error token, the parser recovers from it the same as from a syntax error
+  static C11Parser::symbol_type lex_error(LexParam& param, const string& msg) {
+    param.report(param.loc, msg);
+    return C11Parser::make_YYerror(param.loc);
+  }
+
+  C11Parser::symbol_type checkToken(C11Parser::symbol_type&& token) {
 
     using symbol_kind = C11Parser::symbol_kind;
     constexpr auto S_NAME = symbol_kind::S_NAME;
@@ -92,10 +118,11 @@ private:
     case SRegular:
 
 // return first half of split token and prepare to send second half in next yylex call
+// tokens are moved through so identifier text stays in parser memory instead of being copied to the default heap
       if(token.kind() == S_NAME) {
-        identifierToLookup = token.value.as<string>();
+        identifierToLookup.assign(token.value.as<Context::name>());
         lexer_state = SIdent;
-        return token;
+        return std::move(token);
       }
 
 // check state for returning special ATOMIC_LPAREN token instead of plain parentheses following _Atomic
@@ -107,12 +134,12 @@ private:
 // check strict C18 syntax option for how to handle possible parentheses after _Atomic
       if(token.kind() == S_ATOMIC) {
         lexer_state = options.atomic_strict_syntax? SAtomic: SRegular;
-        return token;
+        return std::move(token);
       }
 
 // default is to return the matched token as-is
       lexer_state = SRegular;
-      return token;
+      return std::move(token);
 
 // SIdent is the only other possible lexer state - it should never occur here since it is checked at yylex entry
     default:
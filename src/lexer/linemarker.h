@@ -0,0 +1,152 @@
+#ifndef C11PARSER_LINEMARKER_H
+#define C11PARSER_LINEMARKER_H
+// lexer/linemarker.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// GCC preprocessor linemarkers, the lines that say which file and line the text after them came from
+//
+// # 1 "/usr/include/stdio.h" 1 3 4
+//
+// flag 1 starts a new included file, 2 returns to the including file, 3 is a system header and 4 wants extern "C"
+// the #line directive form is taken as well
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace c11parser {
+using namespace std;
+
+struct Linemarker {
+// byte offset of the # starting the line
+  size_t offset = 0;
+// line of the marker itself in the input
+  int inputLine = 0;
+// presumed line number of the line after the marker
+  int line = 0;
+  string filename;
+  bool enter = false;
+  bool leave = false;
+  bool system = false;
+};
+
+// parses a linemarker line with or without its leading #, nullopt for any other preprocessor line
+inline optional<Linemarker> parse_linemarker(string_view text) {
+  size_t i = 0;
+  auto skip_space = [&] {
+    while(i < text.size() && (text[i] == ' ' || text[i] == '\t')) {
+      ++i;
+    }
+  };
+
+  skip_space();
+  if(i < text.size() && text[i] == '#') {
+    ++i;
+    skip_space();
+  }
+  if(text.substr(i).starts_with("line") && i + 4 < text.size() && (text[i + 4] == ' ' || text[i + 4] == '\t')) {
+    i += 4;
+    skip_space();
+  }
+
+  Linemarker marker;
+  if(i == text.size() || !isdigit((unsigned char)text[i])) {
+    return nullopt;
+  }
+  for(; i < text.size() && isdigit((unsigned char)text[i]); ++i) {
+    marker.line = marker.line * 10 + (text[i] - '0');
+  }
+
+  skip_space();
+  if(i == text.size() || text[i] != '"') {
+    return nullopt;
+  }
+// the filename keeps its escapes as written, only an escaped quote needs care to find the end
+  for(++i; i < text.size() && text[i] != '"' && text[i] != '\n'; ++i) {
+    if(text[i] == '\\' && i + 1 < text.size()) {
+      marker.filename += text[i++];
+    }
+    marker.filename += text[i];
+  }
+  if(i == text.size() || text[i] != '"') {
+    return nullopt;
+  }
+  ++i;
+
+  for(;;) {
+    skip_space();
+    if(i == text.size() || !isdigit((unsigned char)text[i])) {
+      break;
+    }
+    switch(text[i++]) {
+    case '1':
+      marker.enter = true;
+      break;
+    case '2':
+      marker.leave = true;
+      break;
+    case '3':
+      marker.system = true;
+      break;
+    }
+  }
+  return marker;
+}
+
+// last linemarker before the byte offset in markers read in input order, null if none
+inline const Linemarker* linemarker_before(const vector<Linemarker>& markers, size_t offset) {
+  auto it = upper_bound(markers.begin(), markers.end(), offset, [](size_t offset, const Linemarker& marker) { return offset < marker.offset; });
+  return it == markers.begin()? nullptr: &*--it;
+}
+
+// every linemarker in the text with its offset and input line
+inline vector<Linemarker> read_linemarkers(string_view text) {
+  vector<Linemarker> markers;
+  int line = 1;
+  for(size_t pos = 0; pos < text.size(); ++line) {
+    auto eol = text.find('\n', pos);
+    auto next = eol == string_view::npos? text.size(): eol + 1;
+    auto p = text.find_first_not_of(" \t", pos);
+    if(p < next && text[p] == '#') {
+      if(auto marker = parse_linemarker(text.substr(p, next - p))) {
+        marker->offset = p;
+        marker->inputLine = line;
+        markers.push_back(std::move(*marker));
+      }
+    }
+    pos = next;
+  }
+  return markers;
+}
+
+}
+
+#endif
+
@@ -0,0 +1,395 @@
+#ifndef C11PARSER_BATCH_PARSE_H
+#define C11PARSER_BATCH_PARSE_H
+// parser/batch_parse.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// parse of many translation units in one process on a pool of threads
+//
+// files are dealt out largest first, round robin to one queue per thread, so every thread starts on big files and a big file is never left for last
+// a thread takes from the front of its own queue and when that is empty steals from the back of another, where the smallest files are
+// each thread keeps one lexer and parser and their memory for every file it parses, and for every later batch of the same batch parser
+// with a result cache a file whose content, options and parser are unchanged since it was cached is not parsed again
+// with a preprocessor each thread runs it on a file and parses its output, so one file is preprocessed while others are parsed
+// with a header region cache the text each file includes from headers is parsed once per batch, see parser/header_regions.h
+// with prefetch files are read ahead of the threads in the order they are scheduled, see parser/file_prefetch.h
+// with symbols each thread collects the file-scope declarations of the files it parses into a partial index, see parser/symbol_db.h
+// results are in the order the files were given no matter which thread parsed them or when
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <spanstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "lexer/c11parser_lexer.h"
+#include "parser/file_prefetch.h"
+#include "parser/header_regions.h"
+#include "parser/preprocessor.h"
+#include "parser/result_cache.h"
+#include "parser/symbol_db.h"
+#include "c11parser.bison.h"
+
+namespace c11parser {
+using namespace std;
+
+struct BatchParseOptions {
+// worker threads, 0 means hardware concurrency
+  unsigned threads = 0;
+  LexerOptions lexerOptions{};
+  bool skipFunctionBodies = false;
+// limit on the parse of each file
+  optional<chrono::milliseconds> timeout{};
+// results looked up before parsing and stored after, shared by all threads
+  const ResultCache* cache = nullptr;
+// header regions already parsed by any thread, not parsed again when repeated in a file with the same typedef context before them
+  HeaderRegionCache* headers = nullptr;
+// files are sources run through this preprocessor and their diagnostics are mapped back to the source lines
+  const PreprocessorOptions* preprocessor = nullptr;
+// files are read ahead with these limits, not with a preprocessor which reads them itself
+  const PrefetchOptions* prefetch = nullptr;
+// file-scope declarations are collected, every file is then parsed through and not taken from the cache or header regions
+  bool symbols = false;
+};
+
+struct BatchFileResult {
+  string filename;
+// same as parser return value, 0 on success, -1 if the file could not be read or preprocessed
+  int status = 0;
+  size_t bytes = 0;
+  chrono::duration<double> parseTime{};
+  vector<Diagnostic> diagnostics{};
+// result came from the cache without parsing
+  bool cached = false;
+// linemarkers of preprocessed output, mapped diagnostics point to filenames in them
+  vector<Linemarker> linemarkers{};
+};
+
+struct BatchParseResult {
+// one per file in the order given
+  vector<BatchFileResult> files{};
+  size_t passed = 0;
+  size_t failed = 0;
+  size_t bytes = 0;
+  chrono::duration<double> wallTime{};
+// sum of parse times of all files, more than wall time when threads overlap
+  chrono::duration<double> parseTime{};
+// files a thread took from another thread's queue
+  size_t stolen = 0;
+  size_t cached = 0;
+// files read ahead before their thread took them and takes that waited on a read in flight
+  size_t prefetched = 0;
+  size_t prefetchWaits = 0;
+// with symbols one partial index per thread, unit ids are places of files in the batch
+  vector<PartialSymbolIndex> symbols{};
+};
+
+class BatchParser {
+public:
+
+  explicit BatchParser(BatchParseOptions options = {}): options(options) {}
+
+  BatchParseResult operator()(const vector<string>& filenames) {
+    auto start = chrono::steady_clock::now();
+
+    BatchParseResult result;
+    result.files.resize(filenames.size());
+// only regular files have a size
+    vector<bool> regular(filenames.size());
+    for(size_t i = 0; i < filenames.size(); ++i) {
+      auto& file = result.files[i];
+      file.filename = filenames[i];
+      error_code ec;
+      auto size = filesystem::file_size(file.filename, ec);
+      file.bytes = ec? 0: size;
+      regular[i] = !ec;
+    }
+
+    auto threads = min<size_t>(options.threads? options.threads: max(thread::hardware_concurrency(), 1u), max<size_t>(filenames.size(), 1));
+    vector<Queue> queues(threads);
+    auto order = largest_first(result.files);
+    for(size_t k = 0; auto i: order) {
+      queues[k++ % threads].files.push_back(i);
+    }
+
+    optional<FilePrefetcher> prefetcher;
+    if(options.prefetch && !options.preprocessor) {
+      vector<size_t> sizes, ahead;
+      for(auto& file: result.files) {
+        sizes.push_back(file.bytes);
+      }
+// pipes and devices are left to their takers, reading ahead could block a reader thread or consume their input
+      ranges::copy_if(order, back_inserter(ahead), [&](size_t i) { return regular[i]; });
+      prefetcher.emplace(filenames, ahead, sizes, *options.prefetch);
+    }
+
+    while(workers.size() < threads) {
+      workers.push_back(make_unique<Worker>(options));
+    }
+    atomic<size_t> stolen = 0;
+    {
+      vector<jthread> pool;
+      for(size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+          auto& worker = *workers[t];
+          worker.prefetch = prefetcher? &*prefetcher: nullptr;
+          for(optional<size_t> i; (i = take(queues, t, stolen));) {
+            worker.parse(result.files[*i], *i);
+          }
+        });
+      }
+    }
+
+    for(auto& file: result.files) {
+      ++(file.status == 0? result.passed: result.failed);
+      result.bytes += file.bytes;
+      result.parseTime += file.parseTime;
+      result.cached += file.cached;
+    }
+    if(options.symbols) {
+      for(size_t t = 0; t < threads; ++t) {
+        result.symbols.push_back(workers[t]->symbols.take());
+      }
+    }
+    result.stolen = stolen;
+    if(prefetcher) {
+      result.prefetched = prefetcher->prefetched;
+      result.prefetchWaits = prefetcher->waits;
+    }
+    result.wallTime = chrono::steady_clock::now() - start;
+    return result;
+  }
+
+// indexes of files in the order they are scheduled, stable so equal sizes keep their given order
+  static vector<size_t> largest_first(const vector<BatchFileResult>& files) {
+    vector<size_t> order(files.size());
+    for(size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    ranges::stable_sort(order, greater{}, [&](size_t i) { return files[i].bytes; });
+    return order;
+  }
+
+private:
+
+  struct Queue {
+    mutex lock;
+    deque<size_t> files;
+  };
+
+// next file for thread t, from the front of its own queue or else the back of the next queue with any left
+// no files are added once threads start so all queues empty means the batch is done
+  static optional<size_t> take(vector<Queue>& queues, size_t t, atomic<size_t>& stolen) {
+    for(size_t k = 0; k < queues.size(); ++k) {
+      auto& queue = queues[(t + k) % queues.size()];
+      lock_guard guard(queue.lock);
+      if(queue.files.empty()) {
+        continue;
+      }
+      size_t i;
+      if(k == 0) {
+        i = queue.files.front();
+        queue.files.pop_front();
+      } else {
+        i = queue.files.back();
+        queue.files.pop_back();
+        ++stolen;
+      }
+      return i;
+    }
+    return nullopt;
+  }
+
+// parser objects and input buffer reused for every file a thread parses
+  struct Worker {
+    Lexer lexer;
+    BisonParam bisonParam;
+    LexParam lexParam;
+    C11Parser parser;
+    const BatchParseOptions& options;
+    string text;
+    optional<HeaderSkippingParser> headerSkipping;
+// read ahead for the current batch if any
+    FilePrefetcher* prefetch = nullptr;
+    SymbolCollector symbols;
+
+    explicit Worker(const BatchParseOptions& options):
+      parser(lexer, bisonParam, lexParam),
+      options(options) {
+      lexer.options = options.lexerOptions;
+      if(options.headers && !options.symbols) {
+        headerSkipping.emplace(lexer, bisonParam, lexParam, parser, *options.headers);
+      }
+      if(options.symbols) {
+        bisonParam.events = &symbols;
+      }
+    }
+
+// index is the file's place in the batch for the prefetcher and the symbol index
+    void parse(BatchFileResult& file, size_t index = 0) {
+      auto start = chrono::steady_clock::now();
+      auto cache = options.symbols? nullptr: options.cache;
+      symbols.begin(index, options.preprocessor? &file.linemarkers: nullptr);
+      if(options.preprocessor && !cache && !headerSkipping) {
+        parse_preprocessed(file);
+        file.parseTime = chrono::steady_clock::now() - start;
+        return;
+      }
+      if(options.preprocessor) {
+        if(auto error = preprocess(file.filename); !error.empty()) {
+          file.status = -1;
+          file.diagnostics.push_back({location(&file.filename), error});
+          return;
+        }
+      } else if(!(prefetch && prefetch->take(index, text)) && !read(file.filename)) {
+        file.status = -1;
+        file.diagnostics.push_back({location(&file.filename), "cannot read file"});
+        return;
+      }
+      file.bytes = text.size();
+
+      string key;
+      if(cache) {
+        key = ResultCache::key(text, options.lexerOptions, options.skipFunctionBodies);
+        if(cache->load(key, file.status, file.diagnostics, &file.filename)) {
+          file.cached = true;
+          map_diagnostics(file);
+          file.parseTime = chrono::steady_clock::now() - start;
+          return;
+        }
+      }
+
+      bisonParam.skipFunctionBodies = options.skipFunctionBodies;
+      if(options.timeout) {
+        bisonParam.control.deadline = chrono::steady_clock::now() + *options.timeout;
+      }
+      if(headerSkipping) {
+        file.status = (*headerSkipping)(text, &file.filename);
+      } else {
+        ispanstream s(span<const char>(text.data(), text.size()));
+        lexer.reset(s);
+        bisonParam.reset();
+        lexParam.loc.initialize(&file.filename);
+        file.status = bisonParam.status(parser());
+      }
+      if(cache) {
+        cache->store(key, file.status, bisonParam.diagnostics);
+      }
+      file.diagnostics = std::move(bisonParam.diagnostics);
+      map_diagnostics(file);
+      file.parseTime = chrono::steady_clock::now() - start;
+    }
+
+// lexer reads the preprocessor output as it is written
+    void parse_preprocessed(BatchFileResult& file) {
+      try {
+        Preprocessor preprocessor(file.filename, *options.preprocessor);
+        lexer.reset(preprocessor.output());
+        bisonParam.reset();
+        bisonParam.skipFunctionBodies = options.skipFunctionBodies;
+        if(options.timeout) {
+          bisonParam.control.deadline = chrono::steady_clock::now() + *options.timeout;
+        }
+        lexParam.loc.initialize(&file.filename);
+        lexParam.linemarkers = &file.linemarkers;
+        file.status = bisonParam.status(parser());
+        lexParam.linemarkers = nullptr;
+        file.bytes = lexParam.loc.end.offset;
+        file.diagnostics = std::move(bisonParam.diagnostics);
+        map_to_source(file.diagnostics, file.linemarkers);
+// parse errors in partial output are not worth reporting
+        if(auto status = preprocessor.wait(); status != 0) {
+          file.status = -1;
+          file.diagnostics = {{location(&file.filename), "preprocessor exited with status " + to_string(status)}};
+        }
+      } catch(const system_error& e) {
+        lexParam.linemarkers = nullptr;
+        file.status = -1;
+        file.diagnostics.push_back({location(&file.filename), e.what()});
+      }
+    }
+
+// linemarkers are kept as a streamed parse keeps them, they also say which headers the file includes
+    void map_diagnostics(BatchFileResult& file) {
+      if(options.preprocessor) {
+        file.linemarkers = read_linemarkers(text);
+        map_to_source(file.diagnostics, file.linemarkers);
+      }
+    }
+
+// preprocessed output of the file into the reused buffer, returns an error message on failure
+// for the result cache and header regions which need the whole text, the other threads parse meanwhile
+    string preprocess(const string& filename) {
+      try {
+        Preprocessor preprocessor(filename, *options.preprocessor);
+        text.clear();
+        auto& out = preprocessor.output();
+        for(char chunk[1 << 16]; out.read(chunk, sizeof(chunk)) || out.gcount();) {
+          text.append(chunk, out.gcount());
+        }
+        if(auto status = preprocessor.wait(); status != 0) {
+          return "preprocessor exited with status " + to_string(status);
+        }
+      } catch(const system_error& e) {
+        return e.what();
+      }
+      return {};
+    }
+
+// whole file into the reused buffer, keeps its capacity from earlier files
+    bool read(const string& filename) {
+      ifstream in(filename, ios::binary);
+      if(!in) {
+        return false;
+      }
+      in.seekg(0, ios::end);
+      auto size = in.tellg();
+      if(size < 0) {
+        return false;
+      }
+      in.seekg(0);
+      text.resize(size);
+      return (bool)in.read(text.data(), size);
+    }
+  };
+
+  BatchParseOptions options;
+// one per thread of the largest batch so far, refer to options
+  vector<unique_ptr<Worker>> workers;
+};
+
+}
+
+#endif
+
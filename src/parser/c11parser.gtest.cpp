@@ -24,8 +24,20 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <new>
 #include <sstream>
 #include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <fmt/format.h>
 
@@ -33,6 +45,17 @@ SOFTWARE.
 #include <gmock/gmock.h>
 
 #include "lexer/c11parser_lexer.h"
+#include "parser/batch_parse.h"
+#include "parser/decl_index.h"
+#include "parser/document.h"
+#include "parser/frame_protocol.h"
+#include "parser/header_regions.h"
+#include "parser/name_resolution.h"
+#include "parser/parallel_parse.h"
+#include "parser/preprocessor.h"
+#include "parser/result_cache.h"
+#include "parser/symbol_db.h"
+#include "parser/watch.h"
 #include "c11parser.bison.h"
 
 using namespace std;
@@ -40,6 +63,33 @@ using namespace fmt;
 
 using namespace ::testing;
 
+// global heap allocations made by the whole test program, counted to check the parser allocates nothing per token
+namespace {
+std::atomic<size_t> heapAllocations = 0;
+}
+
+void* operator new(size_t n) {
+  ++heapAllocations;
+  if(auto p = malloc(n? n: 1)) {
+    return p;
+  }
+  throw bad_alloc();
+}
+
+void* operator new(size_t n, align_val_t al) {
+  ++heapAllocations;
+  auto a = static_cast<size_t>(al);
+  if(auto p = aligned_alloc(a, (max<size_t>(n, 1) + a - 1) / a * a)) {
+    return p;
+  }
+  throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { free(p); }
+
 namespace c11parser::testing {
 
 TEST(C11Parser, test_0) {
@@ -1942,5 +1992,1394 @@ TEST(C11Parser, 2000_null_statement_semicolon_outside_function) {
   EXPECT_NE(parser(), 0) << "parse should fail similar to gcc error, ISO C does not allow extra ; outside of a function";
 }
 
+TEST(C11Parser, 3000_parse_events) {
+  auto input = R"%(
+int x;
+int f(int a) {
+  return a + x;
 }
+)%"s;
+  stringstream s(input);
+
+// records each event with the source text it covers
+  struct Recorder: ParseEvents {
+    const string& input;
+    vector<string> events;
+
+    explicit Recorder(const string& input): input(input) {}
+
+    void enter(ParseEventKind kind, const location& loc) override {
+      events.push_back(format("enter {} {}", (int)kind, input.substr(loc.begin.offset, loc.size())));
+    }
+
+    void exit(ParseEventKind kind, const location& loc) override {
+      events.push_back(format("exit {} {}", (int)kind, input.substr(loc.begin.offset, loc.size())));
+    }
+  } recorder(input);
+
+  Lexer lexer(s);
+  BisonParam bisonParam;
+  bisonParam.events = &recorder;
+  LexParam lexParam;
+
+  C11Parser parser([&lexer](LexParam& lexParam) -> C11Parser::symbol_type {
+    return lexer.yylex(lexParam);
+  },
+  bisonParam,
+  lexParam);
+
+  EXPECT_EQ(parser(), 0);
+
+  auto kind = [](ParseEventKind k) { return (int)k; };
+  EXPECT_THAT(recorder.events, ElementsAre(
+    format("exit {} int x;", kind(ParseEventKind::declaration)),
+    format("enter {} int f(int a)", kind(ParseEventKind::function_definition)),
+    format("enter {} {{", kind(ParseEventKind::block)),
+    format("exit {} a + x", kind(ParseEventKind::expression)),
+    format("exit {} return a + x;", kind(ParseEventKind::statement)),
+    format("exit {} {{\n  return a + x;\n}}", kind(ParseEventKind::block)),
+    format("exit {} int f(int a) {{\n  return a + x;\n}}", kind(ParseEventKind::function_definition))
+  ));
+}
+
+TEST(C11Parser, 3010_reuse_parser_after_reset) {
+  stringstream s1(R"%(
+typedef int T;
+T x;
+)%");
+
+// T must be a variable name again after reset
+  stringstream s2(R"%(
+int T;
+int y = T;
+)%");
+
+  Lexer lexer(s1);
+  BisonParam bisonParam;
+  LexParam lexParam;
+
+  C11Parser parser([&lexer](LexParam& lexParam) -> C11Parser::symbol_type {
+    return lexer.yylex(lexParam);
+  },
+  bisonParam,
+  lexParam);
+
+  EXPECT_EQ(parser(), 0);
+  EXPECT_TRUE(bisonParam.context.is_typedefname("T"));
+
+  lexer.reset(s2);
+  bisonParam.reset();
+  lexParam.reset();
+
+  EXPECT_EQ(parser(), 0);
+  EXPECT_FALSE(bisonParam.context.is_typedefname("T"));
+  EXPECT_EQ(lexParam.loc.end.line, 4);
+}
+
+TEST(C11Parser, 3020_lexer_bound_directly) {
+  stringstream s(R"%(
+typedef int T;
+T x;
+int f(T T) {
+  return T;
+}
+)%");
+
+  Lexer lexer(s);
+  BisonParam bisonParam;
+  LexParam lexParam;
+
+  C11Parser parser(lexer, bisonParam, lexParam);
+
+  EXPECT_EQ(parser(), 0);
+  EXPECT_EQ(lexParam.context, &bisonParam.context) << "typedef names should be looked up directly in parser context";
+}
+
+TEST(C11Parser, 3030_skip_function_bodies) {
+  auto input = R"%(
+typedef int T;
+int f(int T) {
+  if(T) { return '}'; }
+  /* } */ // }
+  return sizeof "{\"}" + T;
+}
+T g(void) { { } }
+T x;
+)%"s;
+  stringstream s(input);
+
+  Lexer lexer(s);
+  BisonParam bisonParam{.skipFunctionBodies = true};
+  LexParam lexParam;
+
+  C11Parser parser(lexer, bisonParam, lexParam);
+
+  EXPECT_EQ(parser(), 0);
+
+  vector<string> bodies;
+  for(auto& loc: bisonParam.skippedFunctionBodies) {
+    bodies.push_back(input.substr(loc.begin.offset, loc.size()));
+  }
+  EXPECT_THAT(bodies, ElementsAre(
+    "{\n  if(T) { return '}'; }\n  /* } */ // }\n  return sizeof \"{\\\"}\" + T;\n}",
+    "{ { } }"
+  ));
+  EXPECT_EQ(lexParam.loc.end.line, 10);
+}
+
+TEST(C11Parser, 3040_parallel_parse_same_as_sequential) {
+  auto input = R"%(
+typedef int T;
+typedef struct S { int a; } S_t, *S_p;
+typedef void (*fp)(int *p);
+S_t s = { 1 };
+int T2;
+int T;
+int f(void) {
+  return T;
+}
+int g(a)
+  int a;
+{
+  return a;
+}
+typedef unsigned long U;
+U u;
+)%"s;
+
+  stringstream s(input);
+  Lexer lexer(s);
+  BisonParam bisonParam;
+  LexParam lexParam;
+  C11Parser parser(lexer, bisonParam, lexParam);
+  ASSERT_EQ(parser(), 0);
+
+  ParallelParser parallelParser({.threads = 4, .minChunkSize = 1});
+  auto result = parallelParser(input);
+
+  EXPECT_EQ(result.status, 0);
+  EXPECT_GT(result.chunks, 1u);
+  EXPECT_GE(result.reparsed, 1u) << "T shadowed by a variable should be mispredicted";
+  EXPECT_FALSE(result.sequentialFallback);
+  EXPECT_EQ(result.context, bisonParam.context.current);
+}
+
+TEST(C11Parser, 3041_parallel_parse_error) {
+  auto input = R"%(
+typedef int T;
+T x;
+int y;
+T z z;
+int w;
+)%"s;
+
+  ParallelParser parallelParser({.threads = 2, .minChunkSize = 1});
+  auto result = parallelParser(input);
+
+  EXPECT_NE(result.status, 0);
+  EXPECT_TRUE(result.sequentialFallback);
+}
+
+TEST(C11Parser, 3050_expression_reductions) {
+  stringstream s(R"%(
+int f(int a, int b, int c) {
+  return a * b + c << 1 < a == b & c ^ a | b && c || a ? b : c;
+}
+int g(int x) {
+  x = f(x, x, x);
+  x += x * 2 - (x + 1) / 3 % 4;
+  return x == 0 || x != 1 && x < 10;
+}
+)%");
+
+  Lexer lexer(s);
+  BisonParam bisonParam;
+  LexParam lexParam;
+
+  C11Parser parser(lexer, bisonParam, lexParam);
+
+// count reductions in the parser debug trace
+  ostringstream trace;
+  parser.set_debug_stream(trace);
+  parser.set_debug_level(1);
+
+  EXPECT_EQ(parser(), 0);
+
+// unit reductions from one expression nonterminal to another, and operands, from the reductions in the trace
+  auto expression = [](std::string_view line, std::string_view prefix) {
+    if(!line.starts_with(prefix)) {
+      return false;
+    }
+    auto name = line.substr(prefix.size(), line.find(' ', prefix.size()) - prefix.size());
+    return name == "expression" || name.ends_with("_expression");
+  };
+  auto unitReductions = 0;
+  auto operands = 0;
+  istringstream lines(trace.str());
+  for(string line; getline(lines, line);) {
+    if(!line.starts_with("Reducing stack by rule")) {
+      continue;
+    }
+    vector<string> symbols;
+    while(getline(lines, line) && line.starts_with("   $")) {
+      symbols.push_back(line);
+    }
+    if(expression(line, "-> $$ = nterm ")) {
+      operands += line.starts_with("-> $$ = nterm primary_expression ");
+      unitReductions += symbols.size() == 1 && expression(symbols[0], "   $1 = nterm ");
+    }
+  }
+
+// an operand used to go through ten unit reductions from multiplicative_expression to logical_or_expression, some fifteen in all on the way up to a full expression
+// with all binary operators in one rule it takes the few from primary_expression to expression, no matter how many precedence levels lie between
+  EXPECT_GT(operands, 0);
+  EXPECT_LE(unitReductions, 6 * operands);
+}
+
+TEST(C11Parser, 3060_collect_errors_and_recover) {
+  stringstream s(R"%(
+typedef int T;
+int f(int T) {
+  T = 1 +;
+  return T;
+}
+T x = 1 2;
+__extension__ int y;
+int g(void) {
+  return "abc
+  ;
+}
+T z;
+)%");
+
+  Lexer lexer(s);
+  BisonParam bisonParam;
+  LexParam lexParam;
 
+  C11Parser parser(lexer, bisonParam, lexParam);
+
+  EXPECT_NE(parser(), 0);
+
+  vector<string> errors;
+  for(auto& diagnostic: bisonParam.diagnostics) {
+    errors.push_back(format("{} {}", diagnostic.loc.begin.line, diagnostic.message));
+  }
+  EXPECT_THAT(errors, ElementsAre(
+    "4 syntax error, unexpected ;",
+    "7 syntax error, unexpected CONSTANT, expecting ;",
+    "8 __extension__ requires GCC extensions be enabled",
+    "10 missing terminating doublequote \" character"
+  ));
+  EXPECT_TRUE(bisonParam.context.is_typedefname("T")) << "parameter T should not shadow typedef T after recovery";
+  EXPECT_EQ(lexParam.loc.end.line, 14) << "whole input should be parsed";
+}
+
+TEST(C11Parser, 3061_recover_after_bad_input) {
+  stringstream s(R"%(#define X 1
+int x;
+int y = ;
+int z;
+)%");
+
+  Lexer lexer(s);
+  BisonParam bisonParam;
+  LexParam lexParam;
+
+  C11Parser parser(lexer, bisonParam, lexParam);
+
+  EXPECT_NE(parser(), 0);
+
+// the directive the lexer does not know is one error, the lines after it are lexed as code again
+  vector<int> lines;
+  for(auto& diagnostic: bisonParam.diagnostics) {
+    lines.push_back(diagnostic.loc.begin.line);
+  }
+  EXPECT_THAT(lines, ElementsAre(1, 3));
+  ASSERT_EQ(bisonParam.diagnostics.size(), 2u);
+  EXPECT_EQ(bisonParam.diagnostics[1].message, "syntax error, unexpected ;");
+}
+
+TEST(C11Parser, 3070_nesting_limits) {
+  auto nested = [](const string& open, const string& inner, const string& close, int depth) {
+    string s;
+    for(auto i = 0; i < depth; ++i) {
+      s += open;
+    }
+    s += inner;
+    for(auto i = 0; i < depth; ++i) {
+      s += close;
+    }
+    return s;
+  };
+
+  auto parse = [](const string& input, BisonParam::Limits limits) {
+    istringstream s(input);
+    Lexer lexer(s);
+    BisonParam bisonParam{.limits = limits};
+    LexParam lexParam;
+    C11Parser parser(lexer, bisonParam, lexParam);
+    auto status = bisonParam.status(parser());
+    return pair(status, bisonParam.diagnostics);
+  };
+
+  auto parens = "int x = " + nested("(", "1", ")", 5000) + ";\n";
+  auto braces = "int a[1] = " + nested("{", "1", "}", 5000) + ";\n";
+  auto ifs = "void f(void) {\n" + nested("if(1) ", ";", "", 5000) + "\n}\n";
+  auto declarators = "int " + nested("(", "*p", ")", 5000) + ";\n";
+
+  for(auto& input: {parens, braces, ifs, declarators}) {
+    auto [status, diagnostics] = parse(input, {});
+    EXPECT_EQ(status, 0) << "no limit by default";
+
+    tie(status, diagnostics) = parse(input, {.maxStackDepth = 1000});
+    EXPECT_NE(status, 0);
+    ASSERT_EQ(diagnostics.size(), 1u);
+    EXPECT_THAT(diagnostics[0].message, HasSubstr("parser stack depth exceeds limit of 1000"));
+  }
+
+  string typedefs;
+  for(auto i = 0; i < 100; ++i) {
+    typedefs += format("typedef int T{};\n", i);
+  }
+  auto [status, diagnostics] = parse(typedefs + ifs, {.maxContextBytes = 1024 * 1024});
+  EXPECT_NE(status, 0);
+  ASSERT_EQ(diagnostics.size(), 1u);
+  EXPECT_THAT(diagnostics[0].message, HasSubstr("typedef context snapshots exceed limit"));
+
+// a long file of declarations stays shallow and within both limits
+  string declarations;
+  for(auto i = 0; i < 20000; ++i) {
+    declarations += format("int v{};\n", i);
+  }
+  tie(status, diagnostics) = parse(typedefs + declarations, {.maxStackDepth = 100, .maxContextBytes = 1024 * 1024});
+  EXPECT_EQ(status, 0);
+  EXPECT_TRUE(diagnostics.empty());
+}
+
+TEST(C11Parser, 3080_snippet_entry_points) {
+  Context::context shared{"T", "U"};
+
+  auto parse = [&](ParseEntry entry, const string& input, BisonParam& bisonParam) {
+    stringstream s(input);
+    Lexer lexer(s);
+    LexParam lexParam;
+    bisonParam.entry = entry;
+    bisonParam.context.enclosing = &shared;
+    C11Parser parser(lexer, bisonParam, lexParam);
+    return parser();
+  };
+
+  auto parse_ok = [&](ParseEntry entry, const string& input) {
+    BisonParam bisonParam;
+    return parse(entry, input, bisonParam) == 0;
+  };
+
+  EXPECT_TRUE(parse_ok(ParseEntry::expression, "(T)*x + sizeof(U)"));
+  EXPECT_TRUE(parse_ok(ParseEntry::expression, "f(a, b)[0]->c"));
+  EXPECT_FALSE(parse_ok(ParseEntry::expression, "T x"));
+  EXPECT_FALSE(parse_ok(ParseEntry::expression, "x;"));
+
+  EXPECT_TRUE(parse_ok(ParseEntry::statement, "for(T i = 0; i < 10; ++i) { U u; (void)u; }"));
+  EXPECT_TRUE(parse_ok(ParseEntry::statement, "if(x) return; else y = 1;"));
+  EXPECT_FALSE(parse_ok(ParseEntry::statement, "int x;"));
+
+  EXPECT_TRUE(parse_ok(ParseEntry::declaration, "static T *p = 0, q[3];"));
+  EXPECT_FALSE(parse_ok(ParseEntry::declaration, "T f(void) { return 0; }"));
+
+  EXPECT_TRUE(parse_ok(ParseEntry::type_name, "const T *(*)[3]"));
+  EXPECT_TRUE(parse_ok(ParseEntry::type_name, "struct S { U a; }"));
+  EXPECT_FALSE(parse_ok(ParseEntry::type_name, "T x"));
+
+// declarations in a snippet go into its own context and never into the shared one
+  BisonParam bisonParam;
+  EXPECT_EQ(parse(ParseEntry::declaration, "typedef U V;", bisonParam), 0);
+  EXPECT_TRUE(bisonParam.context.is_typedefname("V"));
+  EXPECT_EQ(parse(ParseEntry::declaration, "int T;", bisonParam), 0);
+  EXPECT_FALSE(bisonParam.context.is_typedefname("T")) << "variable T should hide shared typedef T";
+  EXPECT_TRUE(bisonParam.context.is_typedefname("U"));
+  EXPECT_EQ(parse(ParseEntry::expression, "T * 2", bisonParam), 0);
+  EXPECT_EQ(parse(ParseEntry::declaration, "typedef int T;", bisonParam), 0);
+  EXPECT_TRUE(bisonParam.context.is_typedefname("T"));
+  EXPECT_EQ(shared, (Context::context{"T", "U"}));
+
+// a hiding declaration inside a block ends with the block
+  BisonParam scoped;
+  EXPECT_EQ(parse(ParseEntry::statement, "{ int T = 1; T * 2; }", scoped), 0);
+  EXPECT_TRUE(scoped.context.is_typedefname("T"));
+  EXPECT_TRUE(scoped.context.current.empty());
+}
+
+TEST(C11Parser, 3090_document_incremental_reparse) {
+  string input = "typedef int T;\n";
+  for(auto i = 0; i < 300; ++i) {
+    input += format("int f{0}(T x) {{ T y = x * 2; return y; }}\nT v{0} = {0};\n", i);
+  }
+
+// every edit must leave the document the same as parsing its text from scratch
+  auto expect_same_as_full = [](const Document& doc) {
+    Document full;
+    full.parse(doc.source());
+    EXPECT_EQ(doc.status(), full.status());
+    EXPECT_EQ(doc.context(), full.context());
+    ASSERT_EQ(doc.declarations(), full.declarations());
+    for(size_t i = 0; i < doc.declarations(); ++i) {
+      auto a = doc.declaration(i);
+      auto b = full.declaration(i);
+      EXPECT_EQ(make_tuple(a.begin.offset, a.begin.line, a.begin.column, a.size), make_tuple(b.begin.offset, b.begin.line, b.begin.column, b.size)) << "declaration " << i;
+    }
+    vector<string> errors, fullErrors;
+    for(auto& diagnostic: doc.diagnostics()) {
+      errors.push_back((ostringstream() << diagnostic).str());
+    }
+    for(auto& diagnostic: full.diagnostics()) {
+      fullErrors.push_back((ostringstream() << diagnostic).str());
+    }
+    EXPECT_EQ(errors, fullErrors);
+  };
+
+  Document doc;
+  ASSERT_EQ(doc.parse(input), 0);
+  EXPECT_EQ(doc.declarations(), 601u);
+  EXPECT_EQ(doc.context(), (Context::context{"T"}));
+
+// edit inside one function body reparses only that function
+  auto at = doc.source().find("x * 2; return y; }\nT v150");
+  EXPECT_EQ(doc.edit(at, 1, "(x + 1)"), 0);
+  EXPECT_EQ(doc.stats().reparsedDeclarations, 1u);
+  EXPECT_LT(doc.stats().reparsedBytes, 100u);
+  expect_same_as_full(doc);
+
+// new lines shift later declarations
+  at = doc.source().find("T v10 ");
+  EXPECT_EQ(doc.edit(at, 0, "\n\n  "), 0);
+  EXPECT_LT(doc.stats().reparsedBytes, 100u);
+  expect_same_as_full(doc);
+
+// a typedef name hidden by a variable changes how later declarations parse until it is declared again
+  at = doc.source().find("int f200");
+  EXPECT_NE(doc.edit(at, 0, "int T; "), 0);
+  expect_same_as_full(doc);
+  EXPECT_FALSE(doc.diagnostics().empty());
+
+  at = doc.source().find("int T; ");
+  EXPECT_EQ(doc.edit(at, 7, ""), 0);
+  expect_same_as_full(doc);
+  EXPECT_TRUE(doc.diagnostics().empty());
+
+  at = doc.source().find("int f250");
+  EXPECT_EQ(doc.edit(at, 0, "typedef long U; "), 0);
+  EXPECT_LT(doc.stats().reparsedBytes, 200u);
+  EXPECT_EQ(doc.context(), (Context::context{"T", "U"}));
+  expect_same_as_full(doc);
+
+// an unclosed brace takes in the rest of the text, closing it again goes back to one declaration per region
+  at = doc.source().find("T v20 ");
+  EXPECT_NE(doc.edit(at, 0, "int g(void) { "), 0);
+  expect_same_as_full(doc);
+  at = doc.source().find("int f21(");
+  EXPECT_EQ(doc.edit(at, 0, "} "), 0);
+  expect_same_as_full(doc);
+
+// deleting the semicolon between two declarations
+  at = doc.source().find(";\nint f30(");
+  EXPECT_NE(doc.edit(at, 1, ""), 0);
+  expect_same_as_full(doc);
+  EXPECT_EQ(doc.edit(at, 0, ";"), 0);
+  expect_same_as_full(doc);
+
+  EXPECT_THROW(doc.edit(doc.source().size(), 1, ""), out_of_range);
+}
+
+TEST(C11Parser, 3100_parse_control) {
+  string input = "typedef int T;\n";
+  for(auto i = 0; i < 2000; ++i) {
+    input += format("T f{0}(T x) {{ return x * {0}; }}\n", i);
+  }
+
+  auto parse = [&](const string& text, BisonParam& bisonParam) {
+    stringstream s(text);
+    Lexer lexer(s);
+    LexParam lexParam;
+    C11Parser parser(lexer, bisonParam, lexParam);
+    return bisonParam.status(parser());
+  };
+
+  atomic<bool> cancel = false;
+  BisonParam bisonParam;
+  bisonParam.control.cancel = &cancel;
+  bisonParam.control.checkInterval = 100;
+  vector<size_t> offsets;
+  bisonParam.control.progress = [&](size_t offset) {
+    offsets.push_back(offset);
+    if(offset > input.size() / 2) {
+      cancel = true;
+    }
+  };
+  EXPECT_EQ(parse(input, bisonParam), parse_cancelled);
+  ASSERT_EQ(bisonParam.diagnostics.size(), 1u);
+  EXPECT_EQ(bisonParam.diagnostics[0].message, "parse cancelled");
+  EXPECT_GT(offsets.size(), 10u);
+  EXPECT_TRUE(ranges::is_sorted(offsets));
+  EXPECT_LT(offsets.back(), input.size() * 3 / 4);
+
+// same parameters parse to the end once the cancel flag is clear
+  cancel = false;
+  bisonParam.control.progress = {};
+  EXPECT_EQ(parse(input, bisonParam), 0);
+  EXPECT_TRUE(bisonParam.diagnostics.empty());
+
+  BisonParam late;
+  late.control.deadline = steady_clock::now() - 1s;
+  EXPECT_EQ(parse(input, late), parse_deadline_exceeded);
+  EXPECT_EQ(late.diagnostics.at(0).message, "parse deadline exceeded");
+
+  string nested = "int x = " + string(5000, '(') + "1" + string(5000, ')') + ";\n";
+  BisonParam budget;
+  budget.control.maxMemoryBytes = 64 * 1024;
+  EXPECT_EQ(parse(nested, budget), parse_memory_budget_exceeded);
+  budget.control.maxMemoryBytes = 64 * 1024 * 1024;
+  EXPECT_EQ(parse(nested, budget), 0);
+
+// a snippet stops with the same status
+  BisonParam snippet;
+  snippet.entry = ParseEntry::expression;
+  snippet.control.checkInterval = 1;
+  snippet.control.deadline = steady_clock::now() - 1s;
+  EXPECT_EQ(parse("a + b * c", snippet), parse_deadline_exceeded);
+}
+
+
+TEST(C11Parser, 3110_no_heap_allocations_per_token) {
+// identifiers longer than the small string buffer so every name token needs memory
+  string input = "typedef int a_typedef_name_longer_than_sso;\n";
+  for(auto i = 0; i < 2000; ++i) {
+    input += format("a_typedef_name_longer_than_sso function_with_a_long_name_{0}(a_typedef_name_longer_than_sso parameter_with_a_long_name) {{ a_typedef_name_longer_than_sso local_variable_{0} = parameter_with_a_long_name; return local_variable_{0}; }}\n", i);
+  }
+
+  Lexer lexer;
+  BisonParam bisonParam;
+  LexParam lexParam;
+  C11Parser parser(lexer, bisonParam, lexParam);
+
+  auto parse = [&] {
+    istringstream s(input);
+    lexer.reset(s);
+    bisonParam.reset();
+    lexParam.reset();
+    auto before = heapAllocations.load();
+    EXPECT_EQ(parser(), 0);
+    return heapAllocations.load() - before;
+  };
+
+// first parse sizes the pool, stack and lexer buffers, later parses of the same input reuse them
+// what remains is a few input buffer allocations and nothing for the 60000 tokens
+  parse();
+  EXPECT_LT(parse(), 32u);
+
+// caller memory with no upstream fallback holds everything the parse needs
+  vector<byte> buffer(16 << 20);
+  pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), pmr::null_memory_resource());
+  BisonParam inArena{.resource = &arena};
+  istringstream s(input);
+  Lexer arenaLexer(s);
+  LexParam arenaLexParam;
+  C11Parser arenaParser(arenaLexer, inArena, arenaLexParam);
+  EXPECT_EQ(arenaParser(), 0);
+}
+
+
+TEST(C11Parser, 3120_batch_parse) {
+  auto dir = filesystem::temp_directory_path() / format("c11parser_batch_{}", getpid());
+  filesystem::create_directories(dir);
+
+  vector<string> files;
+  auto write = [&](const string& name, const string& text) {
+    auto path = (dir / name).string();
+    ofstream(path) << text;
+    files.push_back(path);
+  };
+
+  string big = "typedef int T;\n";
+  for(auto i = 0; i < 500; ++i) {
+    big += format("T f{0}(T x) {{ return x + {0}; }}\n", i);
+  }
+  write("small.c", "int main(void) { return 0; }\n");
+  write("big.c", big);
+  write("bad.c", "int x = ;\nint y;\n");
+  for(auto i = 0; i < 20; ++i) {
+    write(format("t{}.c", i), format("typedef int T{0};\nT{0} v{0};\n", i));
+  }
+  files.push_back((dir / "missing.c").string());
+
+  auto result = BatchParser({.threads = 3})(files);
+  filesystem::remove_all(dir);
+
+  ASSERT_EQ(result.files.size(), files.size());
+  for(size_t i = 0; i < files.size(); ++i) {
+    EXPECT_EQ(result.files[i].filename, files[i]);
+  }
+  EXPECT_EQ(result.passed, files.size() - 2);
+  EXPECT_EQ(result.failed, 2u);
+  EXPECT_EQ(result.files[1].status, 0);
+  EXPECT_EQ(result.files[1].bytes, big.size());
+
+  auto& bad = result.files[2];
+  EXPECT_NE(bad.status, 0);
+  ASSERT_EQ(bad.diagnostics.size(), 1u);
+  EXPECT_EQ(*bad.diagnostics[0].loc.begin.filename, files[2]);
+  EXPECT_EQ(bad.diagnostics[0].loc.begin.line, 1);
+
+  auto& missing = result.files.back();
+  EXPECT_EQ(missing.status, -1);
+  ASSERT_EQ(missing.diagnostics.size(), 1u);
+  EXPECT_EQ(missing.diagnostics[0].message, "cannot read file");
+
+// scheduled biggest first with ties in given order
+  auto order = BatchParser::largest_first(result.files);
+  EXPECT_EQ(order[0], 1u);
+  EXPECT_EQ(order.back(), files.size() - 1);
+  EXPECT_TRUE(ranges::is_sorted(order, greater{}, [&](size_t i) { return result.files[i].bytes; }));
+}
+
+
+TEST(C11Parser, 3130_frame_protocol) {
+  stringstream in;
+  write_frame(in, {"a.c", "typedef int T;\nT x;\n"});
+  write_frame(in, {"name with\nnewline.c", "int x = ;\nint y = 1 +;\n"});
+  write_frame(in, {"main.c", "int main(void) { return 0; }\n"});
+// names are per request, T from the first request is not a typedef here
+  write_frame(in, {"b.c", "T y;\n"});
+
+  stringstream out;
+  FrameServer server;
+  EXPECT_EQ(server.serve(in, out), 2u);
+
+  vector<FrameResponse> responses;
+  for(FrameResponse response; read_response(out, response);) {
+    responses.push_back(response);
+  }
+  ASSERT_EQ(responses.size(), 4u);
+
+  EXPECT_EQ(responses[0].name, "a.c");
+  EXPECT_EQ(responses[0].status, 0);
+  EXPECT_TRUE(responses[0].diagnostics.empty());
+
+  auto& bad = responses[1];
+  EXPECT_EQ(bad.name, "name with\nnewline.c");
+  EXPECT_NE(bad.status, 0);
+  ASSERT_EQ(bad.diagnostics.size(), 2u);
+  EXPECT_EQ(bad.diagnostics[0].loc.begin.line, 1);
+  EXPECT_EQ(bad.diagnostics[0].loc.begin.column, 9);
+  EXPECT_EQ(bad.diagnostics[1].loc.begin.line, 2);
+  EXPECT_THAT(bad.diagnostics[0].message, HasSubstr("syntax error"));
+
+  EXPECT_EQ(responses[2].status, 0);
+  EXPECT_EQ(responses[3].name, "b.c");
+  EXPECT_NE(responses[3].status, 0);
+
+// a frame cut short cannot be skipped over
+  stringstream truncated("3 100\nc.cint x;");
+  stringstream ignored;
+  EXPECT_THROW(server.serve(truncated, ignored), runtime_error);
+  stringstream garbage("hello\n");
+  EXPECT_THROW(server.serve(garbage, ignored), runtime_error);
+
+// sizes past the bounds are bad headers, a negative size reads as a huge one
+  FrameRequest request;
+  for(auto header: {"0 -1\n", "-1 0\n", "0 99999999999999\n"}) {
+    stringstream oversized(header);
+    EXPECT_THROW(read_frame(oversized, request), runtime_error) << header;
+  }
+  stringstream limited("3 8\nc.cint x;\n");
+  EXPECT_THROW(read_frame(limited, request, 4), runtime_error);
+  stringstream response("1 0 1000000000000\nx");
+  FrameResponse ignoredResponse;
+  EXPECT_THROW(read_response(response, ignoredResponse), runtime_error);
+}
+
+
+TEST(C11Parser, 3140_result_cache) {
+// reference XXH64 values
+  EXPECT_EQ(xxh64(""), 0xef46db3751d8e999ull);
+  EXPECT_EQ(xxh64("abc"), 0x44bc2cf5ad770999ull);
+  EXPECT_EQ(xxh64("Nobody inspects the spammish repetition"), 0xfbcea83c8a378bf1ull);
+
+  auto dir = filesystem::temp_directory_path() / format("c11parser_cache_{}", getpid());
+  filesystem::remove_all(dir);
+  ResultCache cache(dir);
+
+  string bad = "int x = ;\nint y = 1 +;\n";
+  auto key = ResultCache::key(bad, {}, false);
+  EXPECT_NE(key, ResultCache::key(bad, {.enableGccExtensions = true}, false));
+  EXPECT_NE(key, ResultCache::key(bad, {}, true));
+  EXPECT_NE(key, ResultCache::key(bad + " ", {}, false));
+
+  int status = -1;
+  vector<Diagnostic> diagnostics;
+  EXPECT_FALSE(cache.load(key, status, diagnostics));
+
+  BisonParam bisonParam;
+  stringstream s(bad);
+  Lexer lexer(s);
+  LexParam lexParam;
+  C11Parser parser(lexer, bisonParam, lexParam);
+  auto parsed = parser();
+  ASSERT_EQ(bisonParam.diagnostics.size(), 2u);
+  EXPECT_TRUE(cache.store(key, parsed, bisonParam.diagnostics));
+
+  string name = "bad.c";
+  ASSERT_TRUE(cache.load(key, status, diagnostics, &name));
+  EXPECT_EQ(status, parsed);
+  ASSERT_EQ(diagnostics.size(), 2u);
+  for(size_t i = 0; i < diagnostics.size(); ++i) {
+    EXPECT_EQ(diagnostics[i].message, bisonParam.diagnostics[i].message);
+    EXPECT_EQ(diagnostics[i].loc.begin.line, bisonParam.diagnostics[i].loc.begin.line);
+    EXPECT_EQ(diagnostics[i].loc.end.column, bisonParam.diagnostics[i].loc.end.column);
+    EXPECT_EQ(diagnostics[i].loc.begin.filename, &name);
+  }
+
+// a stopped parse says nothing about the input
+  EXPECT_FALSE(cache.store(ResultCache::key("int x;", {}, false), parse_deadline_exceeded, {}));
+
+// damaged entries are misses
+  auto entry = dir / key.substr(0, 2) / key;
+  filesystem::resize_file(entry, filesystem::file_size(entry) - 3);
+  EXPECT_FALSE(cache.load(key, status, diagnostics));
+  ofstream(entry) << "garbage";
+  EXPECT_FALSE(cache.load(key, status, diagnostics));
+
+// threads writing the same entry at once leave a whole one behind and no temporary files
+  {
+    vector<jthread> writers;
+    for(auto t = 0; t < 4; ++t) {
+      writers.emplace_back([&] {
+        for(auto i = 0; i < 50; ++i) {
+          cache.store(key, parsed, bisonParam.diagnostics);
+        }
+      });
+    }
+  }
+  EXPECT_TRUE(cache.load(key, status, diagnostics));
+  EXPECT_EQ(diagnostics.size(), 2u);
+  EXPECT_EQ(ranges::distance(filesystem::directory_iterator(entry.parent_path())), 1);
+
+// second batch over unchanged files parses nothing and reports the same
+  vector<string> files;
+  for(auto i = 0; i < 6; ++i) {
+    auto path = (dir / format("f{}.c", i)).string();
+    ofstream(path) << (i % 2? format("typedef int T{0};\nT{0} x;\n", i): format("int x{} = ;\n", i));
+    files.push_back(path);
+  }
+  auto first = BatchParser({.threads = 2, .cache = &cache})(files);
+  auto second = BatchParser({.threads = 2, .cache = &cache})(files);
+  filesystem::remove_all(dir);
+
+  EXPECT_EQ(first.cached, 0u);
+  EXPECT_EQ(second.cached, files.size());
+  EXPECT_EQ(second.passed, first.passed);
+  for(size_t i = 0; i < files.size(); ++i) {
+    EXPECT_EQ(second.files[i].status, first.files[i].status);
+    ASSERT_EQ(second.files[i].diagnostics.size(), first.files[i].diagnostics.size());
+    for(auto& diagnostic: second.files[i].diagnostics) {
+      EXPECT_EQ(*diagnostic.loc.begin.filename, files[i]);
+    }
+  }
+}
+
+TEST(C11Parser, 3150_header_region_skipping) {
+  auto marker = parse_linemarker("# 12 \"/usr/include/stdio.h\" 1 3 4\n");
+  ASSERT_TRUE(marker);
+  EXPECT_EQ(marker->line, 12);
+  EXPECT_EQ(marker->filename, "/usr/include/stdio.h");
+  EXPECT_TRUE(marker->enter);
+  EXPECT_FALSE(marker->leave);
+  EXPECT_TRUE(marker->system);
+  marker = parse_linemarker("#line 7 \"a.c\"");
+  ASSERT_TRUE(marker);
+  EXPECT_EQ(marker->line, 7);
+  EXPECT_FALSE(marker->enter || marker->leave);
+  EXPECT_FALSE(parse_linemarker("#pragma once"));
+  EXPECT_FALSE(parse_linemarker("# 3 a.c"));
+
+  auto header = R"(# 1 "t.h" 1
+# 1 "u.h" 1
+typedef int U;
+# 2 "t.h" 2
+typedef U T;
+int shadowed;
+)"s;
+  auto tu = [&](string before, string after) {
+    return "# 1 \"main.c\"\n" + before + header + "# 3 \"main.c\" 2\n" + after;
+  };
+
+// the lexer records the markers it skips with the offset of each
+  {
+    auto text = tu("", "T t;\n");
+    vector<Linemarker> markers;
+    istringstream s(text);
+    Lexer lexer(s);
+    BisonParam bisonParam;
+    LexParam lexParam{.linemarkers = &markers};
+    C11Parser parser(lexer, bisonParam, lexParam);
+    ASSERT_EQ(parser(), 0);
+    ASSERT_EQ(markers.size(), 5u);
+    for(auto& m: markers) {
+      EXPECT_EQ(text[m.offset], '#');
+    }
+    EXPECT_TRUE(markers[1].enter);
+    EXPECT_TRUE(markers[4].leave);
+    EXPECT_EQ(markers[4].filename, "main.c");
+  }
+
+// the header is one region from its first marker up to the marker returning to main.c
+  auto text = tu("int a;\n", "T t;\n");
+  auto regions = split_header_regions(text);
+  ASSERT_EQ(regions.size(), 3u);
+  EXPECT_FALSE(regions[0].header);
+  EXPECT_TRUE(regions[1].header);
+  EXPECT_EQ(text.substr(regions[1].offset, regions[1].size), header);
+  EXPECT_EQ(regions[1].line, 3);
+  EXPECT_TRUE(text.substr(regions[2].offset).starts_with("# 3 \"main.c\" 2"));
+  EXPECT_TRUE(blank_region("# 1 \"x.h\" 1\n\n#pragma pack(1)\n  \n"));
+  EXPECT_FALSE(blank_region("# 1 \"x.h\" 1\nint x;\n"));
+
+  auto dir = filesystem::temp_directory_path() / format("c11parser_headers_{}", getpid());
+  filesystem::remove_all(dir);
+  filesystem::create_directories(dir);
+  vector<string> sources = {
+    tu("", "T t;\nU u;\n"),
+    tu("int a;\n", "T f(void) { return 0; }\n"),
+// a typedef before the header is a different entry context so the header is parsed again
+    tu("typedef char C;\n", "C c;\nT t;\n"),
+// errors after the header are those of a plain parse
+    tu("", "T t = ;\nshadowed x;\n"),
+// an include inside a declaration does not parse region by region
+    "# 1 \"main.c\"\nstruct s {\n" + header + "# 3 \"main.c\" 2\n};\nT t;\n",
+    tu("int b;\n", "T t;\n"),
+  };
+  vector<string> files;
+  for(size_t i = 0; i < sources.size(); ++i) {
+    auto path = (dir / format("tu{}.i", i)).string();
+    ofstream(path) << sources[i];
+    files.push_back(path);
+  }
+
+  HeaderRegionCache headers;
+  auto plain = BatchParser({.threads = 1})(files);
+  auto skipping = BatchParser({.threads = 1, .headers = &headers})(files);
+  auto again = BatchParser({.threads = 2, .headers = &headers})(files);
+  filesystem::remove_all(dir);
+
+  EXPECT_EQ(plain.passed, 4u);
+  EXPECT_EQ(headers.size(), 2u);
+  EXPECT_EQ(headers.hits, 3u + 5u);
+  EXPECT_EQ(headers.skippedBytes, headers.hits * header.size());
+  for(auto result: {&skipping, &again}) {
+    EXPECT_EQ(result->passed, plain.passed);
+    for(size_t i = 0; i < files.size(); ++i) {
+      EXPECT_EQ(result->files[i].status, plain.files[i].status) << files[i];
+      ASSERT_EQ(result->files[i].diagnostics.size(), plain.files[i].diagnostics.size()) << files[i];
+      for(size_t k = 0; k < plain.files[i].diagnostics.size(); ++k) {
+        auto& a = result->files[i].diagnostics[k];
+        auto& b = plain.files[i].diagnostics[k];
+        EXPECT_EQ(a.message, b.message);
+        EXPECT_EQ(a.loc.begin.line, b.loc.begin.line);
+        EXPECT_EQ(a.loc.begin.column, b.loc.begin.column);
+        EXPECT_EQ(a.loc.begin.offset, b.loc.begin.offset);
+      }
+    }
+  }
+}
+
+TEST(C11Parser, 3160_preprocess_pipe) {
+  auto dir = filesystem::temp_directory_path() / format("c11parser_cpp_{}", getpid());
+  filesystem::remove_all(dir);
+  filesystem::create_directories(dir);
+  ofstream(dir / "t.h") << "typedef int T;\n#ifdef BAD\nint y = ;\n#endif\n";
+  ofstream(dir / "a.c") << "#include \"t.h\"\n\nint main(void) {\n  T x = ;\n  return N;\n}\n";
+  ofstream(dir / "b.c") << "#include \"missing.h\"\n";
+  auto a = (dir / "a.c").string();
+
+  {
+    Preprocessor preprocessor(a, {.command = {"cc", "-E", "-DN=1"}});
+    string text(istreambuf_iterator<char>(preprocessor.output()), {});
+    EXPECT_EQ(preprocessor.wait(), 0);
+    EXPECT_THAT(text, HasSubstr("return 1;"));
+    auto markers = read_linemarkers(text);
+    EXPECT_TRUE(ranges::any_of(markers, [](auto& m) { return m.enter && m.filename.ends_with("t.h"); }));
+  }
+  EXPECT_THROW(Preprocessor(a, {.command = {"c11parser-no-such-preprocessor"}}), std::system_error);
+
+// errors point to the source lines whether the output is streamed or read whole for the result cache
+  PreprocessorOptions options{.command = {"cc", "-E", "-DBAD", "-DN=1"}};
+  ResultCache cache(dir / "cache");
+  vector<string> files = {a, (dir / "b.c").string()};
+  auto streamed = BatchParser({.threads = 1, .preprocessor = &options})(files);
+  auto whole = BatchParser({.threads = 1, .cache = &cache, .preprocessor = &options})(files);
+  auto cached = BatchParser({.threads = 1, .cache = &cache, .preprocessor = &options})(files);
+  filesystem::remove_all(dir);
+
+  EXPECT_EQ(cached.cached, 1u);
+  for(auto result: {&streamed, &whole, &cached}) {
+    auto& diagnostics = result->files[0].diagnostics;
+    EXPECT_EQ(result->files[0].status, 1);
+    ASSERT_EQ(diagnostics.size(), 2u);
+    EXPECT_THAT(*diagnostics[0].loc.begin.filename, EndsWith("t.h"));
+    EXPECT_EQ(diagnostics[0].loc.begin.line, 3);
+    EXPECT_THAT(*diagnostics[1].loc.begin.filename, EndsWith("a.c"));
+    EXPECT_EQ(diagnostics[1].loc.begin.line, 4);
+    EXPECT_EQ(diagnostics[1].loc.begin.column, 9);
+
+// a failed preprocess is reported by itself
+    EXPECT_EQ(result->files[1].status, -1);
+    ASSERT_EQ(result->files[1].diagnostics.size(), 1u);
+    EXPECT_THAT(result->files[1].diagnostics[0].message, HasSubstr("preprocessor exited"));
+  }
+}
+
+// output of the built-in preprocessor is token for token that of the system one on the same sources
+TEST(C11Parser, 3170_builtin_preprocessor) {
+  auto dir = filesystem::temp_directory_path() / format("c11parser_builtin_cpp_{}", getpid());
+  filesystem::remove_all(dir);
+  filesystem::create_directories(dir / "inc");
+  ofstream(dir / "inc" / "g.h") << "// guard\n#ifndef G_H\n#define G_H\ntypedef int G;\n#endif\n";
+  ofstream(dir / "inc" / "o.h") << "#pragma once\ntypedef long O;\n";
+  ofstream(dir / "m.h") <<
+    "#define str(s) # s\n#define xstr(s) str(s)\n#define glue(a, b) a ## b\n#define xglue(a, b) glue(a, b)\n"
+    "#define pr(fmt, ...) printf(fmt, ## __VA_ARGS__)\n#define show(...) puts(#__VA_ARGS__)\n"
+    "#define f(a) f(x * (a))\n#define x 2\n#define g f\n#define t(a) a\n#define HDR <o.h>\n";
+  ofstream(dir / "a.c") <<
+    "#include <stdio.h>\n#include <g.h>\n#include \"inc/g.h\"\n#include <o.h>\n#include \"m.h\"\n#include HDR\n"
+    "#include \"./inc/g.h\"\n#include \"./inc/o.h\"\n#include \"inc/../inc/o.h\"\n"
+    "#if defined(x) && (1 << 10) / 4 == 256 && -1 < 0 && (0u - 1 > 0) && 'a' == 97 && __has_include(<g.h>)\n"
+    "int yes = __LINE__;\n#elif 1\nint no;\n#endif\n"
+    "void h(void) {\n  pr(\"a\"); pr(\"%d %s\", 1, xstr(glue(x, y)));\n  show(one, \"two\",  three);\n"
+    "  int xglue(v, x) = f(2) + g(f(1)) + t(t(g)(0) + t)(1);\n  G a = sizeof(O) + __STDC_VERSION__;\n}\n";
+  auto a = (dir / "a.c").string();
+
+  auto tokens = [](const string& text) {
+    string lines;
+    istringstream in(text);
+    for(string line; getline(in, line);) {
+      if(!line.starts_with('#')) {
+        lines += line + '\n';
+      }
+    }
+    vector<string> texts;
+    for(auto& t: pp_tokenize(lines)) {
+      texts.emplace_back(t.text);
+    }
+    return texts;
+  };
+
+  auto options = builtin_options_from({"cc"});
+  options.includeDirs.push_back((dir / "inc").string());
+  SourceFileCache files;
+  options.files = &files;
+  Preprocessor builtin(a, {.builtin = &options});
+  string ours(istreambuf_iterator<char>(builtin.output()), {});
+  EXPECT_EQ(builtin.wait(), 0);
+  Preprocessor system(a, {.command = {"cc", "-E", "-I" + (dir / "inc").string()}});
+  string theirs(istreambuf_iterator<char>(system.output()), {});
+  EXPECT_EQ(system.wait(), 0);
+  EXPECT_EQ(tokens(ours), tokens(theirs));
+  EXPECT_THAT(ours, HasSubstr("int yes = 11;"));
+
+// the guarded header is known by its guard under any path, linemarkers enter each header once however it is spelled
+  EXPECT_EQ(files.guard(*files.load((dir / "inc" / "g.h").string())), "G_H");
+  EXPECT_EQ(files.guard(*files.load((dir / "." / "inc" / "g.h").string())), "G_H");
+  auto markers = read_linemarkers(ours);
+  EXPECT_EQ(ranges::count_if(markers, [](auto& m) { return m.enter && m.filename.ends_with("/g.h"); }), 1);
+  EXPECT_EQ(ranges::count_if(markers, [](auto& m) { return m.enter && m.filename.ends_with("/o.h"); }), 1);
+  EXPECT_TRUE(ranges::any_of(markers, [](auto& m) { return m.enter && m.system && m.filename.ends_with("stdio.h"); }));
+
+// errors point to source lines as with the system preprocessor
+  ofstream(dir / "t.h") << "typedef int T;\n#ifdef BAD\nint y = ;\n#endif\n";
+  ofstream(dir / "b.c") << "#include \"t.h\"\n\nint main(void) {\n  T x = ;\n  return N;\n}\n";
+  ofstream(dir / "c.c") << "#include \"missing.h\"\n";
+  auto defines = options;
+  defines.predefined += "#define BAD 1\n#define N 1\n";
+  PreprocessorOptions preprocessor{.builtin = &defines};
+  auto result = BatchParser({.threads = 1, .preprocessor = &preprocessor})(vector<string>{(dir / "b.c").string(), (dir / "c.c").string()});
+  filesystem::remove_all(dir);
+
+  auto& diagnostics = result.files[0].diagnostics;
+  ASSERT_EQ(diagnostics.size(), 2u);
+  EXPECT_THAT(*diagnostics[0].loc.begin.filename, EndsWith("t.h"));
+  EXPECT_EQ(diagnostics[0].loc.begin.line, 3);
+  EXPECT_THAT(*diagnostics[1].loc.begin.filename, EndsWith("b.c"));
+  EXPECT_EQ(diagnostics[1].loc.begin.line, 4);
+  EXPECT_EQ(diagnostics[1].loc.begin.column, 9);
+  EXPECT_EQ(result.files[1].status, -1);
+}
+
+
+// a source is parsed again when a save changes it or a header it includes, and not for a save that changes nothing
+TEST(C11Parser, 3180_watch_changed_files) {
+  auto dir = filesystem::temp_directory_path() / format("c11parser_watch_{}", getpid());
+  filesystem::remove_all(dir);
+  filesystem::create_directories(dir / "src");
+  filesystem::create_directories(dir / ".git");
+  ofstream(dir / "t.h") << "typedef int T;\n";
+  ofstream(dir / "a.c") << "#include \"t.h\"\nT a;\n";
+  ofstream(dir / "src" / "b.c") << "int b = ;\n";
+  ofstream(dir / ".git" / "c.c") << "int c;\n";
+  ofstream(dir / "notes.txt") << "text\n";
+
+  PreprocessorOptions preprocessor{.command = {"cc", "-E"}};
+  SourceWatcher watcher({dir.string()}, {.batch = {.threads = 2, .preprocessor = &preprocessor}});
+  auto filenames = [](const BatchParseResult& result) {
+    vector<string> names;
+    for(auto& file: result.files) {
+      names.push_back(filesystem::path(file.filename).filename().string());
+    }
+    return names;
+  };
+  auto save = [&](const filesystem::path& path, const string& text) {
+    ofstream(dir / path) << text;
+  };
+  constexpr chrono::milliseconds wait{2000};
+
+  auto scan = watcher.scan();
+  EXPECT_EQ(filenames(scan), (vector<string>{"a.c", "b.c"}));
+  EXPECT_EQ(scan.failed, 1u);
+  EXPECT_EQ(watcher.directories(), 2u);
+
+  save("src/b.c", "int b = 1;\n");
+  auto fixed = watcher.changes(wait);
+  EXPECT_EQ(filenames(fixed), vector<string>{"b.c"});
+  EXPECT_EQ(fixed.passed, 1u);
+
+// same content, and a file that is neither source nor header of one
+  save("src/b.c", "int b = 1;\n");
+  save("notes.txt", "more\n");
+  EXPECT_TRUE(watcher.changes(chrono::milliseconds(200)).files.empty());
+
+  save("t.h", "typedef int U;\n");
+  auto header = watcher.changes(wait);
+  EXPECT_EQ(filenames(header), vector<string>{"a.c"});
+  EXPECT_EQ(header.failed, 1u);
+
+// sources in a new directory are found, a removed source is forgotten
+  filesystem::create_directories(dir / "new");
+  save("new/d.c", "int d;\n");
+  auto added = watcher.changes(wait);
+  EXPECT_THAT(filenames(added), Contains("d.c"));
+  filesystem::remove(dir / "src" / "b.c");
+  watcher.changes(chrono::milliseconds(200));
+  EXPECT_EQ(watcher.sources(), 2u);
+  EXPECT_EQ(watcher.failed(), 1u);
+
+  jthread stopper([&] { watcher.stop(); });
+  EXPECT_TRUE(watcher.changes().files.empty());
+  filesystem::remove_all(dir);
+}
+
+
+// files read ahead with io_uring or reader threads give the same results as files read by their parser threads
+TEST(C11Parser, 3190_prefetch_batch_input) {
+  auto dir = filesystem::temp_directory_path() / format("c11parser_prefetch_{}", getpid());
+  filesystem::remove_all(dir);
+  filesystem::create_directories(dir);
+  vector<string> files;
+  for(int i = 0; i < 40; ++i) {
+    auto path = (dir / format("f{}.c", i)).string();
+    ofstream(path) << format("int f{}(void) {{ return {}; }}\n", i, string(i, '1')) << (i % 7 == 0? "int bad = ;\n": "");
+    files.push_back(path);
+  }
+  files.push_back((dir / "missing.c").string());
+
+  auto plain = BatchParser({.threads = 3})(files);
+  for(auto uring: {true, false}) {
+    PrefetchOptions prefetch{.queueDepth = 4, .memoryLimit = 200, .uring = uring};
+    auto result = BatchParser({.threads = 3, .prefetch = &prefetch})(files);
+    EXPECT_EQ(result.passed, plain.passed);
+    EXPECT_EQ(result.failed, plain.failed);
+    EXPECT_GT(result.prefetched, 0u);
+    for(size_t i = 0; i < files.size(); ++i) {
+      EXPECT_EQ(result.files[i].status, plain.files[i].status);
+      EXPECT_EQ(result.files[i].diagnostics.size(), plain.files[i].diagnostics.size());
+      EXPECT_EQ(result.files[i].bytes, plain.files[i].bytes);
+    }
+    EXPECT_EQ(result.files.back().status, -1);
+
+// taken in an order other than read ahead, never more held than the ceiling
+    vector<size_t> order, sizes;
+    for(size_t i = 0; i < files.size(); ++i) {
+      order.push_back(i);
+      error_code ec;
+      sizes.push_back(filesystem::file_size(files[i], ec));
+    }
+// a file whose size changed since it was seen is a miss and not cut to the old size
+    sizes[1] -= 1;
+    sizes[2] += 1;
+    FilePrefetcher prefetcher(files, order, sizes, prefetch);
+    string text;
+    for(auto i = files.size(); i-- > 0;) {
+      if(prefetcher.take(i, text)) {
+        ifstream in(files[i]);
+        EXPECT_EQ(text, string(istreambuf_iterator<char>(in), {}));
+        EXPECT_NE(i, 1u);
+        EXPECT_NE(i, 2u);
+      }
+    }
+    EXPECT_LE(prefetcher.peakBuffered, 200u);
+  }
+
+// a pipe is not read ahead as an empty file, its taker finds it cannot be read as a whole
+  auto fifo = (dir / "fifo.c").string();
+  ASSERT_EQ(mkfifo(fifo.c_str(), 0600), 0);
+  jthread writer([&] {
+    close(open(fifo.c_str(), O_WRONLY));
+  });
+  PrefetchOptions prefetch{.queueDepth = 4};
+  auto result = BatchParser({.threads = 1, .prefetch = &prefetch})(vector{fifo});
+  EXPECT_EQ(result.files[0].status, -1);
+  ASSERT_EQ(result.files[0].diagnostics.size(), 1u);
+  EXPECT_EQ(result.files[0].diagnostics[0].message, "cannot read file");
+  writer.join();
+  filesystem::remove_all(dir);
+}
+
+TEST(C11Parser, 3200_declaration_index) {
+  auto input = R"%(typedef int T;
+static int x, (*fp)(int a);
+extern _Thread_local int tl;
+enum E { A, B = 2 };
+struct S { int m; };
+static int f(int c) {
+  register int y;
+  { int z; }
+  return c;
+}
+int k(void);
+void r(a) int a; { }
+int s(a, b, c) int a; char b; long c; { }
+)%"s;
+
+  auto parse = [&](DeclarationWriter& writer) {
+    stringstream s(input);
+    Lexer lexer(s);
+    BisonParam bisonParam;
+    bisonParam.events = &writer;
+    string filename = "d.c";
+    LexParam lexParam{.loc = location(&filename)};
+    C11Parser parser([&lexer](LexParam& lexParam) -> C11Parser::symbol_type {
+      return lexer.yylex(lexParam);
+    },
+    bisonParam,
+    lexParam);
+    EXPECT_EQ(parser(), 0);
+    writer.close();
+  };
+
+// small blocks so records cross many handoffs to the writer thread
+  stringstream binary;
+  DeclarationWriter writer(binary, {.blockSize = 16, .maxQueued = 1});
+  parse(writer);
+  EXPECT_EQ(writer.count(), 20u);
+  auto records = read_declarations(binary);
+  ASSERT_TRUE(records);
+
+  vector<string> summary;
+  for(auto& d: *records) {
+    EXPECT_EQ(d.filename, "d.c");
+    EXPECT_LT(d.begin, d.end);
+    summary.push_back(format("{} {} [{}] {}{} {} {}", declaration_kind_name(d.kind), d.name, storage_class_names(d.storage), d.depth, d.definition? " definition": "", d.line, input.substr(d.begin, d.end - d.begin)));
+  }
+  EXPECT_THAT(summary, ElementsAre(
+    "typedef T [] 0 1 T",
+    "variable x [static] 0 2 x",
+    "variable a [] 1 2 a",
+    "variable fp [static] 0 2 (*fp)(int a)",
+    "variable tl [extern _Thread_local] 0 3 tl",
+    "enumerator A [] 0 4 A",
+    "enumerator B [] 0 4 B = 2",
+    "tag E [] 0 4 enum E { A, B = 2 }",
+    "tag S [] 0 5 struct S { int m; }",
+    "variable c [] 1 6 c",
+    "function f [static] 0 definition 6 f(int c)",
+    "variable y [register] 1 7 y",
+    "variable z [] 2 8 z",
+    "function k [] 0 11 k(void)",
+    "function r [] 0 definition 12 r(a)",
+    "variable a [] 1 12 a",
+// every declaration of a K&R parameter list is at parameter depth
+    "function s [] 0 definition 13 s(a, b, c)",
+    "variable a [] 1 13 a",
+    "variable b [] 1 13 b",
+    "variable c [] 1 13 c"
+  ));
+
+  stringstream jsonl;
+  DeclarationWriter jsonWriter(jsonl, {.format = DeclarationFormat::jsonl});
+  parse(jsonWriter);
+  string first;
+  getline(jsonl, first);
+  EXPECT_EQ(first, R"({"file":"d.c","kind":"typedef","name":"T","storage":"","depth":0,"definition":false,"begin":12,"end":13,"line":1,"column":13})");
+}
+
+TEST(C11Parser, 3210_name_resolution) {
+  auto input = R"%(typedef int T;
+int g;
+enum { K = 3 };
+int f(int a, int b[a]);
+int h(int a) {
+  T t = a + g + K;
+  { int g = t; a = g; }
+  { g; }
+  return f(g, 0) + h(a) + undeclared;
+}
+int m = sizeof(T);
+int p(int q);
+int r(void) { return q; }
+int i;
+int w(void) { for(int i = 0; i < 3; ++i) g += i; switch(i) { case 0: ; } return i; }
+int b = 5;
+int kr(a, b) int a; char b; { return a + b; }
+int use = b;
+)%"s;
+  stringstream s(input);
+  Lexer lexer(s);
+  NameResolver resolver;
+  BisonParam bisonParam;
+  bisonParam.resolver = &resolver;
+  LexParam lexParam;
+  C11Parser parser([&lexer](LexParam& lexParam) -> C11Parser::symbol_type {
+    return lexer.yylex(lexParam);
+  },
+  bisonParam,
+  lexParam);
+  EXPECT_EQ(parser(), 0);
+
+// each use as name:line and the line and text of the declaration it resolves to
+  auto line = [&](uint64_t offset) { return ranges::count(input.substr(0, offset), '\n') + 1; };
+  auto& index = resolver.index();
+  ASSERT_EQ(index.uses.size(), index.declarations.size());
+  vector<string> resolved;
+  for(size_t i = 0; i < index.size(); ++i) {
+    auto use = index.uses[i];
+    auto name = input.substr(use, input.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_", use) - use);
+    auto declaration = index.declarations[i];
+    resolved.push_back(format("{}:{} {}", name, line(use), declaration == UseIndex::unresolved? "unresolved"s: format("{}:{}", line(declaration), input.substr(declaration, name.size()))));
+  }
+  EXPECT_THAT(resolved, ElementsAre(
+    "a:4 4:a",
+    "T:6 1:T",
+    "a:6 5:a",
+    "g:6 2:g",
+    "K:6 3:K",
+    "t:7 6:t",
+    "a:7 5:a",
+    "g:7 7:g",
+    "g:8 2:g",
+    "f:9 4:f",
+    "g:9 2:g",
+    "h:9 5:h",
+    "a:9 5:a",
+    "undeclared:9 unresolved",
+    "T:11 1:T",
+    "q:13 unresolved",
+// the loop variable is gone after the loop
+    "i:15 15:i",
+    "i:15 15:i",
+    "g:15 2:g",
+    "i:15 15:i",
+    "i:15 14:i",
+    "i:15 14:i",
+// K&R parameters are in scope in the body and only there
+    "a:17 17:a",
+    "b:17 17:b",
+    "b:18 16:b"
+  ));
+
+  stringstream out;
+  write_use_index(out, index);
+  EXPECT_EQ(out.str().size(), use_index_magic.size() + 8 + 16 * index.size());
+  EXPECT_TRUE(out.str().starts_with(use_index_magic));
+
+// a reset resolver reused for the next translation unit knows nothing of the last one
+  resolver.reset();
+  resolver.use("g", 0);
+  EXPECT_EQ(resolver.index().declarations, vector<uint64_t>{UseIndex::unresolved});
+}
+
+TEST(C11Parser, 3220_symbol_database) {
+  auto dir = filesystem::temp_directory_path() / format("c11parser_symbols_{}", getpid());
+  filesystem::remove_all(dir);
+  filesystem::create_directories(dir);
+  auto a = (dir / "a.c").string();
+  auto b = (dir / "b.c").string();
+  auto path = (dir / "symbols.db").string();
+  ofstream(a) << "typedef int T;\nstruct S { int x; };\nextern int shared;\nint fa(void) { int local; return 0; }\nenum { KA };\n";
+  ofstream(b) << "extern int shared;\nint shared = 1;\nstatic int fb(int p);\nint fa(void);\nint kr(shared, q) int shared; char q; { return q; }\n";
+
+  vector<string> files{a, b};
+  auto result = BatchParser({.threads = 2, .symbols = true})(files);
+  EXPECT_EQ(result.passed, 2u);
+  EXPECT_EQ(result.symbols.size(), 2u);
+  SymbolDatabaseBuilder builder(2);
+  builder.add(std::move(result.symbols), {translation_unit(a), translation_unit(b)});
+  builder.write(path);
+  EXPECT_EQ(builder.symbols(), 10u);
+
+  auto declarations = [](const SymbolDatabase& db, span<const SymbolRecord> symbols) {
+    vector<string> found;
+    for(auto& s: symbols) {
+      auto storage = storage_class_names(s.storage);
+      found.push_back(format("{} {}{}{} {}:{}:{}", db.name(s), declaration_kind_name(s.declaration_kind()), storage.empty()? "": " " + storage, s.definition()? " definition": "",
+        filesystem::path(db.file(s)).filename().string(), s.line, s.column));
+    }
+    return found;
+  };
+  {
+    SymbolDatabase db(path);
+    EXPECT_EQ(db.size(), 10u);
+    ASSERT_EQ(db.units().size(), 2u);
+    EXPECT_EQ(db.path(db.units()[0]), translation_unit(a).path);
+    EXPECT_EQ(db.units()[1].hash, translation_unit(b).hash);
+    EXPECT_THAT(declarations(db, db.lookup("shared")), ElementsAre("shared variable extern a.c:3:12", "shared variable extern b.c:1:12", "shared variable b.c:2:5"));
+    EXPECT_THAT(declarations(db, db.lookup("fa")), ElementsAre("fa function definition a.c:4:5", "fa function b.c:4:5"));
+    EXPECT_THAT(declarations(db, db.lookup("S")), ElementsAre("S tag a.c:2:1"));
+    EXPECT_TRUE(db.lookup("local").empty());
+    EXPECT_TRUE(db.lookup("p").empty());
+// K&R parameters are not global even when they share a global's name
+    EXPECT_TRUE(db.lookup("q").empty());
+    EXPECT_THAT(declarations(db, db.lookup("kr")), ElementsAre("kr function definition b.c:5:5"));
+    EXPECT_TRUE(db.lookup("missing").empty());
+    vector<string> names;
+    for(auto& s: db.prefix("f")) {
+      names.push_back(string(db.name(s)));
+    }
+    EXPECT_THAT(names, ElementsAre("fa", "fa", "fb"));
+    EXPECT_TRUE(ranges::is_sorted(db.symbols(), less{}, [&](auto& s) { return db.name(s); }));
+  }
+
+// b changes and is parsed again alone, the symbols of a are kept and those of b replaced
+  SymbolDatabase earlier(path);
+  ofstream(b, ios::trunc) << "int fc;\n";
+  auto again = BatchParser({.threads = 1, .symbols = true})(vector<string>{b});
+  SymbolDatabaseBuilder update(2);
+  update.keep(earlier);
+  update.add(std::move(again.symbols), {translation_unit(b)});
+  update.write(path);
+  EXPECT_EQ(update.kept_symbols(), 5u);
+  EXPECT_EQ(update.symbols(), 6u);
+
+  SymbolDatabase db(path);
+  EXPECT_EQ(db.units().size(), 2u);
+  EXPECT_TRUE(db.lookup("fb").empty());
+  EXPECT_EQ(db.lookup("fa").size(), 1u);
+  EXPECT_EQ(db.lookup("shared").size(), 1u);
+  ASSERT_EQ(db.lookup("fc").size(), 1u);
+  EXPECT_EQ(db.path(*db.unit(db.lookup("fc")[0])), translation_unit(b).path);
+  EXPECT_EQ(db.lookup("KA")[0].declaration_kind(), DeclarationKind::enumerator);
+// a reader mapping the file before the update still sees the whole earlier database
+  EXPECT_EQ(earlier.lookup("fb").size(), 1u);
+
+  ofstream(path, ios::trunc) << "not a database";
+  EXPECT_THROW(SymbolDatabase{path}, runtime_error);
+  filesystem::remove_all(dir);
+}
+
+}
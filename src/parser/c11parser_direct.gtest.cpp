@@ -0,0 +1,249 @@
+// c11parser_direct.gtest.cpp
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <sstream>
+#include <string>
+
+#include <fmt/format.h>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "lexer/c11parser_lexer.h"
+#include "c11parser.bison.h"
+#include "c11parser.bison.direct.h"
+
+using namespace std;
+using namespace fmt;
+
+using namespace ::testing;
+
+namespace c11parser::testing {
+
+// everything observable from one parse
+struct ParseOutcome {
+  int status;
+  vector<string> events;
+  Context::context context;
+  vector<string> errors;
+  int line;
+};
+
+template<typename Parser>
+ParseOutcome parse_with(const string& input, const BisonParam::Limits& limits, ParseEntry entry) {
+  struct Recorder: ParseEvents {
+    vector<string> events;
+
+    void enter(ParseEventKind kind, const location& loc) override {
+      events.push_back(format("enter {} {} {}", (int)kind, loc.begin.offset, loc.end.offset));
+    }
+
+    void exit(ParseEventKind kind, const location& loc) override {
+      events.push_back(format("exit {} {} {}", (int)kind, loc.begin.offset, loc.end.offset));
+    }
+  } recorder;
+
+  istringstream s(input);
+  Lexer lexer(s);
+  BisonParam bisonParam;
+  bisonParam.events = &recorder;
+  bisonParam.limits = limits;
+  bisonParam.entry = entry;
+  LexParam lexParam;
+
+  Parser parser(lexer, bisonParam, lexParam);
+
+  auto status = parser();
+
+  vector<string> errors;
+  for(auto& diagnostic: bisonParam.diagnostics) {
+    errors.push_back((ostringstream() << diagnostic).str());
+  }
+
+  return {status, recorder.events, bisonParam.context.current, errors, lexParam.loc.end.line};
+}
+
+void expect_same_outcome(const string& input, const BisonParam::Limits& limits = {}, ParseEntry entry = ParseEntry::translation_unit) {
+  auto expected = parse_with<C11Parser>(input, limits, entry);
+  auto actual = parse_with<C11DirectParser>(input, limits, entry);
+
+  EXPECT_EQ(actual.status, expected.status);
+  EXPECT_EQ(actual.events, expected.events);
+  EXPECT_EQ(actual.context, expected.context);
+  EXPECT_EQ(actual.errors, expected.errors);
+  EXPECT_EQ(actual.line, expected.line);
+}
+
+TEST(C11DirectParser, 100_same_as_bison_parser) {
+  expect_same_outcome(R"%(
+typedef int T;
+typedef struct S { int a; T b : 3; } S_t, *S_p;
+enum { A, B = A + 1 } e;
+T x, *y = &x;
+int f(T T) {
+  T = sizeof(S_t) + (T) * 2;
+  for(int T = 0; T < 10; ++T) {
+    if(T) x += T; else { typedef long T; T z = 0; (void)z; }
+  }
+  switch(T) { case 1: return 0; default: break; }
+  return T ? x : T << 2 | 1;
+}
+T g(void) {
+  T (*p)[3] = 0;
+  return p != 0 && f(1) || "abc"[0];
+}
+)%");
+}
+
+TEST(C11DirectParser, 110_same_as_bison_parser_gcc_extensions) {
+  expect_same_outcome(R"%(
+int f(int x) __attribute__((unused));
+int g() {
+  int r;
+  __asm__ volatile ("nop" : "=r" (r) : : "memory");
+  return ({ int y = r; y; });
+}
+)%");
+}
+
+TEST(C11DirectParser, 200_same_syntax_error) {
+  expect_same_outcome(R"%(
+typedef int T;
+T z z;
+)%");
+}
+
+TEST(C11DirectParser, 210_same_syntax_error_expecting_tokens) {
+  expect_same_outcome(R"%(
+int f(void) {
+  return (1;
+}
+)%");
+}
+
+TEST(C11DirectParser, 220_same_syntax_error_at_end_of_input) {
+  expect_same_outcome(R"%(
+int f(void) {
+  return 1;
+)%");
+}
+
+TEST(C11DirectParser, 230_same_error_recovery) {
+  expect_same_outcome(R"%(
+typedef int T;
+int f(int T) {
+  T = 1 +;
+  { typedef long U; U u = ; }
+  return T;
+}
+T x = 1 2;
+__extension__ int y;
+int g(void) {
+  if(x) {
+    return @;
+  }
+  return 0;
+}
+T z;
+)%");
+}
+
+TEST(C11DirectParser, 240_same_nesting_limits) {
+  string input = "typedef int T;\nint f(void) {\n";
+  for(auto i = 0; i < 300; ++i) {
+    input += "if(1) { T x = (((x))); ";
+  }
+  input += "\n}\n";
+
+  for(auto depth: {100, 500, 1000, 2000}) {
+    expect_same_outcome(input, {.maxStackDepth = size_t(depth)});
+  }
+  for(auto bytes: {1000, 10000, 100000}) {
+    expect_same_outcome(input, {.maxContextBytes = size_t(bytes)});
+  }
+}
+
+TEST(C11DirectParser, 250_same_entry_points) {
+  expect_same_outcome("a * (b + 1) ? c : d[2]", {}, ParseEntry::expression);
+  expect_same_outcome("a * b = ", {}, ParseEntry::expression);
+  expect_same_outcome("{ typedef int T; T x; if(x) return x; }", {}, ParseEntry::statement);
+  expect_same_outcome("typedef int T, *P;", {}, ParseEntry::declaration);
+  expect_same_outcome("int x", {}, ParseEntry::declaration);
+  expect_same_outcome("const int *(*)[3]", {}, ParseEntry::type_name);
+  expect_same_outcome("int x;", {}, ParseEntry::type_name);
+}
+
+TEST(C11DirectParser, 260_same_stop_on_cancel) {
+  string input = "typedef int T;\n";
+  for(auto i = 0; i < 200; ++i) {
+    input += format("T f{0}(T x) {{ if(x) {{ return (x + {0}); }} return 0; }}\n", i);
+  }
+
+  auto parse = [&]<typename Parser>(size_t cancelAt) {
+    istringstream s(input);
+    Lexer lexer(s);
+    atomic<bool> cancel = false;
+    BisonParam bisonParam;
+    bisonParam.control.cancel = &cancel;
+    bisonParam.control.checkInterval = 7;
+    bisonParam.control.progress = [&](size_t offset) {
+      cancel = offset >= cancelAt;
+    };
+    LexParam lexParam;
+    Parser parser(lexer, bisonParam, lexParam);
+    auto status = bisonParam.status(parser());
+    return make_tuple(status, bisonParam.diagnostics.empty()? ""s: (ostringstream() << bisonParam.diagnostics[0]).str(), bisonParam.context.current);
+  };
+
+  for(auto cancelAt: {0uz, 100uz, 1000uz, 5000uz}) {
+    auto expected = parse.operator()<C11Parser>(cancelAt);
+    EXPECT_EQ(get<0>(expected), parse_cancelled);
+    EXPECT_EQ(parse.operator()<C11DirectParser>(cancelAt), expected);
+  }
+}
+
+TEST(C11DirectParser, 300_reuse_parser) {
+  stringstream s1("typedef int T;\nT x;\n");
+  stringstream s2("int T;\nint y = T;\n");
+
+  Lexer lexer(s1);
+  BisonParam bisonParam;
+  LexParam lexParam;
+
+  C11DirectParser parser(lexer, bisonParam, lexParam);
+
+  EXPECT_EQ(parser(), 0);
+  EXPECT_TRUE(bisonParam.context.is_typedefname("T"));
+
+  lexer.reset(s2);
+  bisonParam.reset();
+  lexParam.reset();
+
+  EXPECT_EQ(parser(), 0);
+  EXPECT_FALSE(bisonParam.context.is_typedefname("T"));
+}
+
+}
@@ -0,0 +1,100 @@
+#ifndef C11PARSER_COMMAND_LINE_H
+#define C11PARSER_COMMAND_LINE_H
+// parser/command_line.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// helpers shared by the command lines of c11parse, c11parsed and c11parsec
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "diagnostic.h"
+
+namespace c11parser {
+using namespace std;
+
+// whole argument as a number no more than max, nullopt if it is anything else
+inline optional<unsigned long> option_number(const char* arg, unsigned long max = numeric_limits<unsigned>::max()) {
+  unsigned long n;
+  auto end = arg + strlen(arg);
+  auto [p, ec] = from_chars(arg, end, n);
+  if(ec != errc() || p != end || n > max) {
+    return nullopt;
+  }
+  return n;
+}
+
+// reports an option argument that is not a number and prints the usage, returns the exit status
+inline int bad_number(const char* arg, void (*usage)()) {
+  fprintf(stderr, "invalid number %s\n", arg);
+  usage();
+  return 1;
+}
+
+// file arguments in order with each @listfile replaced by its non-empty lines, false if a list file cannot be read
+inline bool expand_file_list(int argc, char* argv[], int first, vector<string>& files) {
+  for(auto i = first; i < argc; ++i) {
+    string arg = argv[i];
+    if(!arg.starts_with('@')) {
+      files.push_back(arg);
+      continue;
+    }
+    ifstream list(arg.substr(1));
+    if(!list) {
+      fprintf(stderr, "cannot read list file %s\n", arg.c_str() + 1);
+      return false;
+    }
+    for(string line; getline(list, line);) {
+      if(!line.empty()) {
+        files.push_back(line);
+      }
+    }
+  }
+  return true;
+}
+
+// all errors from a parse are written together in input order
+inline void print_diagnostics(const vector<Diagnostic>& diagnostics) {
+  if(diagnostics.empty()) {
+    return;
+  }
+  ostringstream s;
+  for(auto& diagnostic: diagnostics) {
+    s << diagnostic << "\n";
+  }
+  fputs(s.str().c_str(), stderr);
+}
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef C11PARSER_CONTENT_HASH_H
+#define C11PARSER_CONTENT_HASH_H
+// parser/content_hash.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// fast non-cryptographic hash of input bytes for keying cached results
+// the XXH64 algorithm, written out here so the parser has no extra dependency
+// reads input as little-endian words so hashes agree with the reference implementation on little-endian hosts only
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace c11parser {
+using namespace std;
+
+inline uint64_t xxh64(string_view input, uint64_t seed = 0) {
+  constexpr uint64_t P1 = 11400714785074694791ull;
+  constexpr uint64_t P2 = 14029467366897019727ull;
+  constexpr uint64_t P3 = 1609587929392839161ull;
+  constexpr uint64_t P4 = 9650029242287828579ull;
+  constexpr uint64_t P5 = 2870177450012600261ull;
+
+  auto read64 = [](const char* p) { uint64_t v; memcpy(&v, p, 8); return v; };
+  auto read32 = [](const char* p) { uint32_t v; memcpy(&v, p, 4); return v; };
+  auto round = [](uint64_t acc, uint64_t in) { return rotl(acc + in * P2, 31) * P1; };
+  auto merge = [&](uint64_t acc, uint64_t v) { return (acc ^ round(0, v)) * P1 + P4; };
+
+  auto p = input.data();
+  auto end = p + input.size();
+  uint64_t h;
+
+  if(input.size() >= 32) {
+    uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+    for(; end - p >= 32; p += 32) {
+      v1 = round(v1, read64(p));
+      v2 = round(v2, read64(p + 8));
+      v3 = round(v3, read64(p + 16));
+      v4 = round(v4, read64(p + 24));
+    }
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+  } else {
+    h = seed + P5;
+  }
+
+  h += input.size();
+  for(; end - p >= 8; p += 8) {
+    h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+  }
+  if(end - p >= 4) {
+    h = rotl(h ^ read32(p) * P1, 23) * P2 + P3;
+    p += 4;
+  }
+  for(; p != end; ++p) {
+    h = rotl(h ^ (uint8_t)*p * P5, 11) * P1;
+  }
+
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
+
+}
+
+#endif
+
@@ -0,0 +1,361 @@
+#ifndef C11PARSER_DECL_INDEX_H
+#define C11PARSER_DECL_INDEX_H
+// parser/decl_index.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// declarations streamed from parse events to an output stream as they are parsed, for code search and other indexers
+//
+// the parser thread encodes records into blocks and a writer thread of its own writes them so parsing does not wait on output
+// the parser waits only when the writer falls behind by more than a set number of blocks
+//
+// binary format, integers little-endian:
+//
+// header:   "C11DECL1"
+// record:   u32 size of the rest of the record, then u8 kind
+// file:     kind 255, then the filename, declarations after it until the next file record are in that file
+// declared: kind as DeclarationKind, u8 StorageClass bits, u8 flags with 1 for a function definition, u16 depth,
+//           u64 begin offset, u64 end offset, u32 line, u32 column, then the name
+//
+// a reader skips a record whose kind it does not know by its size
+// the jsonl format has one object per declaration with its filename
+//
+// offsets are bytes of the parsed input, with a preprocessor that is its output, lines and filenames are those of the source
+
+#include <algorithm>
+#include <bit>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "lexer/linemarker.h"
+#include "parser/parse_events.h"
+
+namespace c11parser {
+using namespace std;
+
+enum class DeclarationFormat {
+  binary,
+  jsonl,
+};
+
+inline constexpr string_view declaration_index_magic = "C11DECL1";
+inline constexpr uint8_t declaration_file_record = 255;
+
+struct DeclarationWriterOptions {
+  DeclarationFormat format = DeclarationFormat::binary;
+// linemarkers of preprocessed input as the lexer reads them, on the parser thread
+  const vector<Linemarker>* linemarkers = nullptr;
+// bytes encoded before a block goes to the writer thread
+  size_t blockSize = 1 << 16;
+// blocks waiting to be written before the parser waits
+  size_t maxQueued = 16;
+};
+
+inline string_view declaration_kind_name(DeclarationKind kind) {
+  switch(kind) {
+  case DeclarationKind::typedef_name:
+    return "typedef";
+  case DeclarationKind::variable:
+    return "variable";
+  case DeclarationKind::function:
+    return "function";
+  case DeclarationKind::enumerator:
+    return "enumerator";
+  case DeclarationKind::tag:
+    return "tag";
+  }
+  return "unknown";
+}
+
+// storage class keywords separated by spaces, empty for none
+inline string storage_class_names(uint8_t storage) {
+  static constexpr pair<uint8_t, string_view> names[] = {
+    {storage_extern, "extern"},
+    {storage_static, "static"},
+    {storage_thread_local, "_Thread_local"},
+    {storage_auto, "auto"},
+    {storage_register, "register"},
+  };
+  string s;
+  for(auto [bit, name]: names) {
+    if(storage & bit) {
+      if(!s.empty()) {
+        s += ' ';
+      }
+      s += name;
+    }
+  }
+  return s;
+}
+
+inline void append_json_string(string& out, string_view s) {
+  out += '"';
+  for(unsigned char c: s) {
+    if(c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if(c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+class DeclarationWriter: public ParseEvents {
+public:
+
+  DeclarationWriter(ostream& out, DeclarationWriterOptions options = {}):
+    out(out),
+    options(options),
+    writer([this] { write_blocks(); }) {
+    if(options.format == DeclarationFormat::binary) {
+      block += declaration_index_magic;
+    }
+  }
+
+  DeclarationWriter(const DeclarationWriter&) = delete;
+  DeclarationWriter& operator=(const DeclarationWriter&) = delete;
+
+  ~DeclarationWriter() {
+    close();
+  }
+
+  void declare(const Declaration& d) override {
+    auto pos = d.loc.begin;
+    string_view filename = pos.filename? string_view(*pos.filename): string_view();
+    if(auto marker = options.linemarkers? linemarker_before(*options.linemarkers, pos.offset): nullptr) {
+      filename = marker->filename;
+      pos.line = marker->line + (pos.line - marker->inputLine - 1);
+    }
+    if(options.format == DeclarationFormat::binary) {
+      if(filename != file) {
+        file = filename;
+        put<uint32_t>(1 + file.size());
+        put<uint8_t>(declaration_file_record);
+        block += file;
+      }
+      put<uint32_t>(1 + 1 + 1 + 2 + 8 + 8 + 4 + 4 + d.name.size());
+      put<uint8_t>((uint8_t)d.kind);
+      put<uint8_t>(d.storage);
+      put<uint8_t>(d.definition? 1: 0);
+      put<uint16_t>(clamp(d.depth, 0, 0xffff));
+      put<uint64_t>(d.loc.begin.offset);
+      put<uint64_t>(d.loc.end.offset);
+      put<uint32_t>(pos.line);
+      put<uint32_t>(pos.column);
+      block += d.name;
+    } else {
+      block += "{\"file\":";
+      append_json_string(block, filename);
+      block += ",\"kind\":\"";
+      block += declaration_kind_name(d.kind);
+      block += "\",\"name\":";
+      append_json_string(block, d.name);
+      block += ",\"storage\":\"" + storage_class_names(d.storage) + "\"";
+      block += ",\"depth\":" + to_string(d.depth);
+      block += d.definition? ",\"definition\":true": ",\"definition\":false";
+      block += ",\"begin\":" + to_string(d.loc.begin.offset) + ",\"end\":" + to_string(d.loc.end.offset);
+      block += ",\"line\":" + to_string(pos.line) + ",\"column\":" + to_string(pos.column) + "}\n";
+    }
+    ++declared;
+    if(block.size() >= options.blockSize) {
+      send();
+    }
+  }
+
+// writes everything encoded, flushes the stream and ends the writer thread, no declarations may follow
+  void close() {
+    if(!writer.joinable()) {
+      return;
+    }
+    send();
+    {
+      lock_guard guard(lock);
+      done = true;
+    }
+    ready.notify_all();
+    writer.join();
+    out.flush();
+  }
+
+  size_t count() const {
+    return declared;
+  }
+
+// false if the stream failed, good after close if every record was written
+  bool good() const {
+    return out.good();
+  }
+
+private:
+
+  template<class T>
+  void put(T value) {
+    if constexpr(endian::native == endian::big) {
+      value = byteswap(value);
+    }
+    block.append((const char*)&value, sizeof(value));
+  }
+
+// hands the block to the writer thread, waits while too many are queued
+  void send() {
+    if(block.empty()) {
+      return;
+    }
+    unique_lock guard(lock);
+    written.wait(guard, [&] { return queue.size() < options.maxQueued; });
+    queue.push_back(std::move(block));
+    guard.unlock();
+    ready.notify_one();
+    block.clear();
+    block.reserve(options.blockSize + 256);
+  }
+
+  void write_blocks() {
+    for(;;) {
+      unique_lock guard(lock);
+      ready.wait(guard, [&] { return !queue.empty() || done; });
+      if(queue.empty()) {
+        return;
+      }
+      auto next = std::move(queue.front());
+      queue.pop_front();
+      guard.unlock();
+      written.notify_one();
+      out.write(next.data(), next.size());
+    }
+  }
+
+  ostream& out;
+  DeclarationWriterOptions options;
+  string block;
+// filename of the last file record
+  string file;
+  size_t declared = 0;
+  mutex lock;
+  condition_variable ready;
+  condition_variable written;
+  deque<string> queue;
+  bool done = false;
+// started last after everything it uses
+  thread writer;
+};
+
+// a declaration read back from the binary format
+struct DeclarationRecord {
+  DeclarationKind kind = DeclarationKind::variable;
+  string name{};
+  string filename{};
+  uint8_t storage = storage_none;
+  int depth = 0;
+  bool definition = false;
+  uint64_t begin = 0;
+  uint64_t end = 0;
+  int line = 0;
+  int column = 0;
+};
+
+// reads a binary declaration stream, nullopt if it is not one or is cut short
+inline optional<vector<DeclarationRecord>> read_declarations(istream& in) {
+  string magic(declaration_index_magic.size(), '\0');
+  if(!in.read(magic.data(), magic.size()) || magic != declaration_index_magic) {
+    return nullopt;
+  }
+  vector<DeclarationRecord> records;
+  string filename;
+  for(string record;;) {
+    uint32_t size;
+    if(!in.read((char*)&size, sizeof(size))) {
+      if(in.gcount() == 0) {
+        break;
+      }
+      return nullopt;
+    }
+    if constexpr(endian::native == endian::big) {
+      size = byteswap(size);
+    }
+    record.resize(size);
+    if(size == 0 || !in.read(record.data(), size)) {
+      return nullopt;
+    }
+    size_t at = 1;
+    auto get = [&]<class T>(T& value) {
+      memcpy(&value, record.data() + at, sizeof(value));
+      if constexpr(endian::native == endian::big) {
+        value = byteswap(value);
+      }
+      at += sizeof(value);
+    };
+    auto kind = (uint8_t)record[0];
+    if(kind == declaration_file_record) {
+      filename = record.substr(1);
+      continue;
+    }
+    if(kind > (uint8_t)DeclarationKind::tag) {
+      continue;
+    }
+    if(size < 1 + 1 + 1 + 2 + 8 + 8 + 4 + 4) {
+      return nullopt;
+    }
+    DeclarationRecord d{.kind = (DeclarationKind)kind, .filename = filename};
+    uint8_t storage, flags;
+    uint16_t depth;
+    uint32_t line, column;
+    get(storage);
+    get(flags);
+    get(depth);
+    get(d.begin);
+    get(d.end);
+    get(line);
+    get(column);
+    d.storage = storage;
+    d.definition = flags & 1;
+    d.depth = depth;
+    d.line = line;
+    d.column = column;
+    d.name = record.substr(at);
+    records.push_back(std::move(d));
+  }
+  return records;
+}
+
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef C11PARSER_DIAGNOSTIC_H
+#define C11PARSER_DIAGNOSTIC_H
+// parser/diagnostic.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <iostream>
+#include <string>
+
+#include "location.h"
+
+namespace c11parser {
+using namespace std;
+
+// lexical or syntax error collected during a parse, the parser recovers and keeps going so one pass can report many
+struct Diagnostic {
+  location loc;
+  string message;
+};
+
+template<typename YYChar>
+basic_ostream<YYChar>& operator<<(basic_ostream<YYChar>& ostr, const Diagnostic& diagnostic) {
+  return ostr << "error at " << diagnostic.loc << ": " << diagnostic.message;
+}
+
+}
+
+#endif
+
@@ -0,0 +1,485 @@
+#ifndef C11PARSER_DOCUMENT_H
+#define C11PARSER_DOCUMENT_H
+// parser/document.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// incremental reparse of an edited translation unit at top-level declaration granularity
+//
+// the text is kept as regions, each running from the end of one top-level declaration to the end of the next
+// at a region boundary the parser stack holds only the declarations before it and the lexer is between tokens
+// so a run of regions parses the same on its own as inside the whole input, given the typedef context at its start
+// each region records the names it declared and every few regions keep a copy of the typedef context at their start
+//
+// an edit reparses the regions it touches starting from the context before them
+// if the context after them differs from before the edit, later regions that mention a name whose membership changed are parsed again
+// the rest are kept after a quick scan of their identifiers, until the contexts agree again
+// a run that fails to parse is extended over more regions since an edit can open a scope that later text closes
+// so reparse time depends on the size of the edit and the declarations around it, not on the size of the text
+// text from the declaration with the first error to the end does not parse and is kept as a single region with its errors
+//
+// parse events and function body skipping are not supported, the document uses events itself to find declarations
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <spanstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "lexer/c11parser_lexer.h"
+#include "c11parser.bison.h"
+
+namespace c11parser {
+using namespace std;
+
+class Document {
+public:
+
+// work done by the last parse or edit
+  struct Stats {
+    size_t reparsedBytes = 0;
+    size_t reparsedDeclarations = 0;
+// parser runs including failed runs that were extended
+    size_t parses = 0;
+  };
+
+// byte range of a top-level declaration including the whitespace and comments before it
+  struct Range {
+    position begin;
+    size_t size = 0;
+  };
+
+  explicit Document(LexerOptions lexerOptions = {}, const string* filename = nullptr):
+    worker(lexerOptions, filename),
+    filename(filename) {}
+
+// replace the whole text and parse it, returns parser status
+  int parse(string newText) {
+    text = std::move(newText);
+    regions.clear();
+    finalContext.clear();
+    errors.clear();
+    return update(0, 0);
+  }
+
+// replace removed bytes at offset with inserted text and reparse what the edit affects, returns parser status of the whole text
+  int edit(size_t offset, size_t removed, string_view inserted) {
+    if(offset > text.size() || removed > text.size() - offset) {
+      throw out_of_range("edit outside document text");
+    }
+    if(regions.empty()) {
+      text.replace(offset, removed, inserted);
+      return parse(std::move(text));
+    }
+
+    auto first = region_at(offset);
+    auto last = region_at(offset + removed);
+
+// positions of the end of the edit before and after it, later positions move by their difference
+    auto start = regions[first].begin;
+    auto oldEnd = advance(start, string_view(text).substr(start.offset, offset + removed - start.offset));
+    text.replace(offset, removed, inserted);
+    auto newEnd = advance(start, string_view(text).substr(start.offset, offset + inserted.size() - start.offset));
+
+    auto shift = [&](position& p) {
+      if(p.line == oldEnd.line) {
+        p.column += newEnd.column - oldEnd.column;
+      }
+      p.line += newEnd.line - oldEnd.line;
+      p.offset += newEnd.offset - oldEnd.offset;
+    };
+    for(auto i = last + 1; i < regions.size(); ++i) {
+      shift(regions[i].begin);
+    }
+    for(auto& diagnostic: errors) {
+      if(diagnostic.loc.begin.offset >= oldEnd.offset) {
+        shift(diagnostic.loc.begin);
+        shift(diagnostic.loc.end);
+      }
+    }
+
+    return update(first, last + 1);
+  }
+
+  const string& source() const {
+    return text;
+  }
+
+// typedef context at end of text
+  const Context::context& context() const {
+    return finalContext;
+  }
+
+// parser status of the whole text, 0 on success
+  int status() const {
+    return parseStatus;
+  }
+
+// errors of the whole text in input order
+  const vector<Diagnostic>& diagnostics() const {
+    return errors;
+  }
+
+  size_t declarations() const {
+    return regions.size();
+  }
+
+  Range declaration(size_t i) const {
+    auto end = i + 1 < regions.size()? regions[i + 1].begin.offset: text.size();
+    return {regions[i].begin, end - regions[i].begin.offset};
+  }
+
+  const Stats& stats() const {
+    return lastStats;
+  }
+
+private:
+
+  struct Region {
+    position begin;
+// names the region declared with whether each is a typedef name after the region, in declaration order
+    vector<pair<string, bool>> changes{};
+// typedef context at start of region, kept on the first region and then every snapshotInterval regions or so
+    shared_ptr<const Context::context> snapshot{};
+  };
+
+// copies of the typedef context cost memory per region kept, walking changes from one costs time per region passed
+  static constexpr size_t snapshotInterval = 64;
+
+// finds top-level declarations from parse events, declarations inside functions come between function definition enter and exit
+// declarations inside top-level initializers such as gcc statement expressions are merged into the declaration that contains them
+  struct Boundaries: ParseEvents {
+    Context* context = nullptr;
+    Context::context declared{};
+    vector<Region> regions{};
+    position begin{};
+    vector<pair<string, bool>> pending{};
+    int depth = 0;
+
+    void enter(ParseEventKind kind, const location&) override {
+      if(kind == ParseEventKind::function_definition) {
+        ++depth;
+      }
+    }
+
+    void exit(ParseEventKind kind, const location& loc) override {
+      if(kind == ParseEventKind::function_definition) {
+        --depth;
+      }
+      if(depth == 0 && (kind == ParseEventKind::function_definition || kind == ParseEventKind::declaration)) {
+        boundary(loc);
+      }
+    }
+
+    void boundary(const location& loc) {
+      record();
+      auto changes = std::move(pending);
+      while(!regions.empty() && begin.offset > loc.begin.offset) {
+        auto& inner = regions.back();
+        inner.changes.insert(inner.changes.end(), make_move_iterator(changes.begin()), make_move_iterator(changes.end()));
+        changes = std::move(inner.changes);
+        begin = inner.begin;
+        regions.pop_back();
+      }
+      regions.push_back({begin, std::move(changes)});
+      pending.clear();
+      begin = loc.end;
+    }
+
+// names declared since the last boundary with their membership now
+    void record() {
+      for(auto& id: declared) {
+        pending.emplace_back(id, context->current.contains(id));
+      }
+      declared.clear();
+    }
+
+// text after the last declaration belongs to it, all of it is one region if there was no declaration
+    void finish() {
+      record();
+      if(regions.empty()) {
+        regions.push_back({begin});
+      }
+      auto& back = regions.back().changes;
+      back.insert(back.end(), make_move_iterator(pending.begin()), make_move_iterator(pending.end()));
+      pending.clear();
+    }
+  };
+
+// parser objects reused for every run
+  struct Worker {
+    Lexer lexer;
+    BisonParam bisonParam;
+    LexParam lexParam;
+    Boundaries boundaries;
+    C11Parser parser;
+    const string* filename;
+
+    Worker(const LexerOptions& lexerOptions, const string* filename):
+      parser(lexer, bisonParam, lexParam),
+      filename(filename) {
+      lexer.options = lexerOptions;
+      boundaries.context = &bisonParam.context;
+      bisonParam.events = &boundaries;
+    }
+
+    int parse(string_view text, const position& begin, const Context::context& initial) {
+      ispanstream s(span<const char>(text.data(), text.size()));
+      lexer.reset(s);
+      bisonParam.reset();
+      bisonParam.context.current = initial;
+      bisonParam.context.declared = &boundaries.declared;
+      boundaries.regions.clear();
+      boundaries.declared.clear();
+      boundaries.pending.clear();
+      boundaries.depth = 0;
+      boundaries.begin = begin;
+      lexParam.loc.initialize(filename, begin.line, begin.column, begin.offset);
+      auto status = bisonParam.status(parser());
+      boundaries.finish();
+      return status;
+    }
+  };
+
+  Worker worker;
+  const string* filename;
+  string text{};
+  vector<Region> regions{};
+  Context::context finalContext{};
+  vector<Diagnostic> errors{};
+  int parseStatus = 0;
+  Stats lastStats{};
+
+// region containing offset, a region starting exactly at offset counts since text inserted there joins its first token
+  size_t region_at(size_t offset) const {
+    auto it = upper_bound(regions.begin(), regions.end(), offset, [](size_t o, const Region& r) { return o < r.begin.offset; });
+    return it == regions.begin()? 0: it - regions.begin() - 1;
+  }
+
+  static position advance(position p, string_view s) {
+    for(auto c: s) {
+      if(c == '\n') {
+        p.lines();
+      } else {
+        p.columns();
+      }
+    }
+    return p;
+  }
+
+  static void apply(Context::context& ctx, const vector<pair<string, bool>>& changes) {
+    for(auto& [id, typedefname]: changes) {
+      if(typedefname) {
+        ctx.emplace(id);
+      } else if(auto it = ctx.find(id); it != ctx.end()) {
+        ctx.erase(it);
+      }
+    }
+  }
+
+  string_view region_text(size_t i) const {
+    auto end = i + 1 < regions.size()? regions[i + 1].begin.offset: text.size();
+    return string_view(text).substr(regions[i].begin.offset, end - regions[i].begin.offset);
+  }
+
+// names in exactly one of the contexts
+  static unordered_set<string_view> difference(const Context::context& a, const Context::context& b) {
+    unordered_set<string_view> names;
+    for(auto& id: a) {
+      if(!b.contains(id)) {
+        names.insert(id);
+      }
+    }
+    for(auto& id: b) {
+      if(!a.contains(id)) {
+        names.insert(id);
+      }
+    }
+    return names;
+  }
+
+// whether text may contain any of the names as an identifier
+// scans every run of identifier characters including those in comments and literals, a false match only costs a reparse
+  static bool mentions(string_view s, const unordered_set<string_view>& names) {
+    for(size_t i = 0; i < s.size();) {
+      if(!isalnum((unsigned char)s[i]) && s[i] != '_') {
+        ++i;
+        continue;
+      }
+      auto start = i;
+      while(i < s.size() && (isalnum((unsigned char)s[i]) || s[i] == '_')) {
+        ++i;
+      }
+      if(!isdigit((unsigned char)s[start]) && names.contains(s.substr(start, i - start))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+// typedef context before region i, from the nearest snapshot at or before it
+  Context::context context_before(size_t i) const {
+    if(i == regions.size()) {
+      return finalContext;
+    }
+    auto j = i;
+    while(!regions[j].snapshot) {
+      --j;
+    }
+    auto ctx = *regions[j].snapshot;
+    for(; j < i; ++j) {
+      apply(ctx, regions[j].changes);
+    }
+    return ctx;
+  }
+
+// reparse regions from first up to next, taking in more regions until the text parses and the context after it is unchanged
+// string views of changed names stay valid while regions that do not mention them are applied to the contexts
+  int update(size_t first, size_t next) {
+    lastStats = {};
+    auto initial = context_before(first);
+    auto ctx = initial;
+// context before the edit at old region oldAt, kept in step with the reparse to see where it converges
+    auto oldCtx = initial;
+    auto oldAt = first;
+    auto begin = first < regions.size()? regions[first].begin: position(filename);
+    vector<Region> fresh;
+    size_t extend = 1;
+    bool reachedEnd = false;
+    bool parsedToEnd = false;
+    int status = 0;
+
+    auto advance_old = [&](size_t to) {
+      for(; oldAt < to; ++oldAt) {
+        apply(oldCtx, regions[oldAt].changes);
+      }
+    };
+
+    for(;;) {
+      auto end = next < regions.size()? regions[next].begin.offset: text.size();
+      ++lastStats.parses;
+      lastStats.reparsedBytes += end - begin.offset;
+      status = worker.parse(string_view(text).substr(begin.offset, end - begin.offset), begin, ctx);
+
+// a run that does not parse may be completed by text after it
+      if(status != 0 && next < regions.size()) {
+        next = min(regions.size(), next + extend);
+        extend *= 2;
+        continue;
+      }
+
+      auto& found = worker.boundaries.regions;
+// declarations ending after the first error may come from error recovery and are not boundaries a later reparse could start from
+      if(status != 0) {
+        auto& diagnostics = worker.bisonParam.diagnostics;
+        auto error = diagnostics.empty()? begin.offset: diagnostics.front().loc.begin.offset;
+        size_t tail = 0;
+        while(tail + 1 < found.size() && found[tail + 1].begin.offset <= error) {
+          ++tail;
+        }
+        for(auto k = tail + 1; k < found.size(); ++k) {
+          found[tail].changes.insert(found[tail].changes.end(), make_move_iterator(found[k].changes.begin()), make_move_iterator(found[k].changes.end()));
+        }
+        found.resize(tail + 1);
+      }
+      lastStats.reparsedDeclarations += found.size();
+      fresh.insert(fresh.end(), make_move_iterator(found.begin()), make_move_iterator(found.end()));
+// in the worker's memory which lasts as long as the document
+      ctx = std::move(worker.bisonParam.context.current);
+
+      if(next == regions.size()) {
+        reachedEnd = parsedToEnd = true;
+        break;
+      }
+
+// names whose typedef membership differs from before the edit, a region that never mentions one parses the same as before
+      advance_old(next);
+      auto changed = difference(ctx, oldCtx);
+      while(!changed.empty() && next < regions.size() && !mentions(region_text(next), changed)) {
+        advance_old(next + 1);
+        apply(ctx, regions[next].changes);
+        fresh.push_back(std::move(regions[next]));
+        fresh.back().snapshot.reset();
+        ++next;
+      }
+      if(changed.empty()) {
+        break;
+      }
+      if(next == regions.size()) {
+        reachedEnd = true;
+        break;
+      }
+
+// region may parse differently in the new context
+      begin = regions[next].begin;
+      ++next;
+      extend = 1;
+    }
+
+// keep the snapshot of the first region since the context before it did not change
+    auto gap = snapshotInterval;
+    if(first < regions.size() && regions[first].snapshot) {
+      fresh.front().snapshot = regions[first].snapshot;
+      gap = 0;
+    } else if(first > 0) {
+      gap = 1;
+      for(auto j = first - 1; !regions[j].snapshot; --j) {
+        ++gap;
+      }
+    }
+    auto running = std::move(initial);
+    for(auto& region: fresh) {
+      if(!region.snapshot && gap >= snapshotInterval) {
+        region.snapshot = make_shared<const Context::context>(running);
+        gap = 0;
+      }
+      ++gap;
+      apply(running, region.changes);
+    }
+
+    regions.erase(regions.begin() + first, regions.begin() + next);
+    regions.insert(regions.begin() + first, make_move_iterator(fresh.begin()), make_move_iterator(fresh.end()));
+
+    if(reachedEnd) {
+      finalContext = std::move(ctx);
+    }
+    if(parsedToEnd) {
+      errors = std::move(worker.bisonParam.diagnostics);
+      parseStatus = status;
+    }
+    return parseStatus;
+  }
+
+};
+
+}
+
+#endif
+
@@ -0,0 +1,435 @@
+#ifndef C11PARSER_FILE_PREFETCH_H
+#define C11PARSER_FILE_PREFETCH_H
+// parser/file_prefetch.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// files of a batch read ahead of the parser threads so they do not wait on open and read
+//
+// files are read in the order the batch is expected to take them, a bounded number at once and up to a ceiling on bytes read and not yet taken
+// reads go through io_uring where the kernel has it, set up with raw system calls so there is no library to depend on,
+// otherwise a pool of reader threads with blocking reads keeps the same number in flight
+// a parser thread taking a file gets its buffer swapped into its own, the text is not copied
+// a file not yet started when it is taken is left to the taker to read so a thread is never stuck behind read ahead for other files
+// a file is read to its end, one whose size changed since the batch started is a miss and also left to the taker
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace c11parser {
+using namespace std;
+
+struct PrefetchOptions {
+// reads in flight at once, also the number of reader threads without io_uring
+  unsigned queueDepth = 32;
+// bytes read ahead and not yet taken, one file bigger than this is still read when nothing else is held
+  size_t memoryLimit = size_t(256) << 20;
+// io_uring if the kernel has it, else reader threads
+  bool uring = true;
+};
+
+// submission and completion rings of an io_uring, for one thread
+class IoUring {
+public:
+
+// false if the kernel has no io_uring or it is not allowed
+  bool setup(unsigned entries) {
+    io_uring_params params{};
+    fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(fd < 0) {
+      return false;
+    }
+    sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+      sqSize = cqSize = max(sqSize, cqSize);
+    }
+    sq = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq = params.features & IORING_FEAT_SINGLE_MMAP? sq: mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes = (io_uring_sqe*)mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+      return false;
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    auto field = [](void* ring, unsigned offset) { return (unsigned*)((char*)ring + offset); };
+    sqHead = field(sq, params.sq_off.head);
+    sqTail = field(sq, params.sq_off.tail);
+    sqMask = *field(sq, params.sq_off.ring_mask);
+    sqArray = field(sq, params.sq_off.array);
+    cqHead = field(cq, params.cq_off.head);
+    cqTail = field(cq, params.cq_off.tail);
+    cqMask = *field(cq, params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)((char*)cq + params.cq_off.cqes);
+    entryCount = params.sq_entries;
+    return true;
+  }
+
+  ~IoUring() {
+    if(sqes && sqes != MAP_FAILED) {
+      munmap(sqes, sqesSize);
+    }
+    if(cq && cq != MAP_FAILED && cq != sq) {
+      munmap(cq, cqSize);
+    }
+    if(sq && sq != MAP_FAILED) {
+      munmap(sq, sqSize);
+    }
+    if(fd >= 0) {
+      close(fd);
+    }
+  }
+
+// next free submission entry cleared, null if the ring is full
+  io_uring_sqe* get() {
+    auto tail = *sqTail;
+    if(tail - atomic_ref(*sqHead).load(memory_order_acquire) == entryCount) {
+      return nullptr;
+    }
+    auto sqe = &sqes[tail & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[tail & sqMask] = tail & sqMask;
+    atomic_ref(*sqTail).store(tail + 1, memory_order_release);
+    ++unsubmitted;
+    return sqe;
+  }
+
+// submits entries got since the last call and waits for at least one completion
+  int submit_and_wait() {
+    auto n = syscall(__NR_io_uring_enter, fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if(n >= 0) {
+      unsubmitted -= n;
+    }
+    return n < 0? -errno: 0;
+  }
+
+// calls f with each completion there is now
+  template<typename F>
+  void completions(F f) {
+    auto head = *cqHead;
+    for(auto tail = atomic_ref(*cqTail).load(memory_order_acquire); head != tail; ++head) {
+      f(cqes[head & cqMask]);
+    }
+    atomic_ref(*cqHead).store(head, memory_order_release);
+  }
+
+private:
+  int fd = -1;
+  void* sq = nullptr;
+  void* cq = nullptr;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqSize = 0, cqSize = 0, sqesSize = 0;
+  unsigned *sqHead = nullptr, *sqTail = nullptr, *sqArray = nullptr, *cqHead = nullptr, *cqTail = nullptr;
+  unsigned sqMask = 0, cqMask = 0, entryCount = 0;
+  io_uring_cqe* cqes = nullptr;
+  unsigned unsubmitted = 0;
+};
+
+class FilePrefetcher {
+public:
+
+// order lists indexes of filenames in the order they are expected to be taken, sizes are their sizes as last seen
+// files not in order are never read ahead, which is how a caller keeps out anything but regular files
+  FilePrefetcher(const vector<string>& filenames, const vector<size_t>& order, const vector<size_t>& sizes, PrefetchOptions options = {}):
+    options(options),
+    order(order),
+    files(filenames.size()) {
+    for(size_t i = 0; i < files.size(); ++i) {
+      files[i].path = filenames[i];
+      files[i].size = sizes[i];
+    }
+    this->options.queueDepth = max(this->options.queueDepth, 1u);
+    if(options.uring && ring.setup(this->options.queueDepth)) {
+      uring = true;
+      readers.emplace_back([this] { read_uring(); });
+    } else {
+      for(auto i = this->options.queueDepth; i > 0; --i) {
+        readers.emplace_back([this] { read_blocking(); });
+      }
+    }
+  }
+
+  FilePrefetcher(const FilePrefetcher&) = delete;
+  FilePrefetcher& operator=(const FilePrefetcher&) = delete;
+
+// reads in flight are finished before the buffers go
+  ~FilePrefetcher() {
+    {
+      lock_guard guard(lock);
+      stopping = true;
+    }
+    room.notify_all();
+    readers.clear();
+  }
+
+// swaps the text of file i into text and returns true, or returns false for the caller to read the file itself
+// if it was not read ahead or could not be read
+  bool take(size_t i, string& text) {
+    unique_lock guard(lock);
+    auto& file = files[i];
+    if(file.state == State::pending) {
+      file.state = State::taken;
+      return false;
+    }
+    if(file.state == State::reading) {
+      ++waits;
+      done.wait(guard, [&] { return file.state != State::reading; });
+    }
+    auto read = file.state == State::ready;
+    if(read) {
+      swap(text, file.text);
+      ++prefetched;
+    }
+    buffered -= file.size;
+    file.state = State::taken;
+    file.text = string();
+    room.notify_all();
+    return read;
+  }
+
+  bool using_uring() const {
+    return uring;
+  }
+
+// files handed over already read, takes that waited for a read in flight, most bytes held at once
+  size_t prefetched = 0;
+  size_t waits = 0;
+  size_t peakBuffered = 0;
+
+private:
+
+  enum class State {pending, reading, ready, failed, taken};
+
+  struct File {
+    string path;
+    size_t size = 0;
+    State state = State::pending;
+    string text{};
+// open descriptor and bytes read while reading with io_uring
+    int fd = -1;
+    size_t offset = 0;
+  };
+
+// next file to read if the limits allow one now, called with the lock held
+  optional<size_t> next_file() {
+    for(; next < order.size(); ++next) {
+      auto& file = files[order[next]];
+      if(file.state != State::pending) {
+        continue;
+      }
+      if(inFlight == options.queueDepth || (buffered > 0 && buffered + file.size > options.memoryLimit)) {
+        return nullopt;
+      }
+      file.state = State::reading;
+      buffered += file.size;
+      peakBuffered = max(peakBuffered, buffered);
+      ++inFlight;
+      return order[next++];
+    }
+    return nullopt;
+  }
+
+  bool finished() const {
+    return stopping || next == order.size();
+  }
+
+  void complete(File& file, bool ok) {
+    {
+      lock_guard guard(lock);
+      --inFlight;
+      if(ok) {
+        file.state = State::ready;
+      } else {
+        file.state = State::failed;
+        file.text = string();
+      }
+    }
+    done.notify_all();
+  }
+
+  void read_blocking() {
+    for(;;) {
+      size_t i;
+      {
+        unique_lock guard(lock);
+        optional<size_t> n;
+        room.wait(guard, [&] { return finished() || (n = next_file()); });
+        if(!n) {
+          return;
+        }
+        i = *n;
+      }
+      auto& file = files[i];
+      auto fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+      auto ok = fd >= 0;
+      if(ok) {
+// one byte past the size to see the end of the file
+        file.text.resize(file.size + 1);
+        size_t got = 0;
+        for(ssize_t r; got < file.text.size() && (r = ::read(fd, file.text.data() + got, file.text.size() - got)) != 0;) {
+          if(r < 0 && errno != EINTR) {
+            ok = false;
+            break;
+          }
+          got += max<ssize_t>(r, 0);
+        }
+        ok = ok && got == file.size;
+        file.text.resize(got);
+        close(fd);
+      }
+      complete(file, ok);
+    }
+  }
+
+// one thread submits opens and reads and handles their completions, a file is opened, read in one or more reads and closed
+// a file has one operation in flight at most so the ring, as deep as the queue, always has room
+  void read_uring() {
+    for(;;) {
+      {
+        unique_lock guard(lock);
+        room.wait(guard, [&] { return inFlight > 0 || finished() || can_start(); });
+        if(inFlight == 0 && finished()) {
+          return;
+        }
+        while(!stopping) {
+          auto i = next_file();
+          if(!i) {
+            break;
+          }
+          auto sqe = ring.get();
+          sqe->opcode = IORING_OP_OPENAT;
+          sqe->fd = AT_FDCWD;
+          sqe->addr = (uintptr_t)files[*i].path.c_str();
+          sqe->open_flags = O_RDONLY | O_CLOEXEC;
+          sqe->user_data = *i;
+        }
+      }
+      if(auto e = ring.submit_and_wait(); e < 0 && e != -EINTR && e != -EAGAIN && e != -EBUSY) {
+        abandon();
+        return;
+      }
+      ring.completions([&](const io_uring_cqe& cqe) {
+        auto& file = files[cqe.user_data];
+        if(cqe.res < 0) {
+          finish(file, false);
+          return;
+        }
+        if(file.fd < 0) {
+// one byte past the size to see the end of the file
+          file.fd = cqe.res;
+          file.text.resize(file.size + 1);
+        } else if(cqe.res == 0) {
+          file.text.resize(file.offset);
+          finish(file, file.offset == file.size);
+          return;
+        } else {
+          file.offset += cqe.res;
+        }
+        if(file.offset == file.text.size()) {
+// longer than its size when the batch started
+          finish(file, false);
+          return;
+        }
+        auto sqe = ring.get();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = file.fd;
+        sqe->addr = (uintptr_t)(file.text.data() + file.offset);
+        sqe->len = file.text.size() - file.offset;
+        sqe->off = file.offset;
+        sqe->user_data = cqe.user_data;
+      });
+    }
+  }
+
+  void finish(File& file, bool ok) {
+    if(file.fd >= 0) {
+      close(file.fd);
+    }
+    complete(file, ok);
+  }
+
+// the ring cannot be used any more, what is in flight is given up and every file not read is left to its taker
+  void abandon() {
+    {
+      lock_guard guard(lock);
+      for(auto& file: files) {
+        if(file.state == State::reading) {
+          if(file.fd >= 0) {
+            close(file.fd);
+          }
+          file.state = State::failed;
+        }
+      }
+      inFlight = 0;
+      stopping = true;
+    }
+    done.notify_all();
+  }
+
+// a file could be started now, called with the lock held
+  bool can_start() const {
+    for(auto k = next; k < order.size(); ++k) {
+      auto& file = files[order[k]];
+      if(file.state == State::pending) {
+        return inFlight < options.queueDepth && (buffered == 0 || buffered + file.size <= options.memoryLimit);
+      }
+    }
+    return false;
+  }
+
+  PrefetchOptions options;
+  vector<size_t> order;
+  vector<File> files;
+  IoUring ring;
+  bool uring = false;
+
+  mutex lock;
+// reader waits for room to read another file, taker waits for a read to finish
+  condition_variable room;
+  condition_variable done;
+  size_t next = 0;
+  size_t inFlight = 0;
+  size_t buffered = 0;
+  bool stopping = false;
+
+  vector<jthread> readers;
+};
+
+}
+
+#endif
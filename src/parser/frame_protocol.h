@@ -0,0 +1,210 @@
+#ifndef C11PARSER_FRAME_PROTOCOL_H
+#define C11PARSER_FRAME_PROTOCOL_H
+// parser/frame_protocol.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// stream of translation units in and parse results out over one pair of pipes
+//
+// every frame starts with a header line of decimal byte counts followed by exactly that many bytes, so names and sources can hold any bytes
+//
+// request:   "<name bytes> <source bytes>\n" name source
+// response:  "<name bytes> <status> <diagnostics>\n" name
+//            then for each diagnostic "<line> <column> <end line> <end column> <message bytes>\n" message
+//
+// status is the parser return value, 0 when the source is valid
+// a response is written and flushed for each request before the next one is read so a client can wait for it
+// one parser serves every request and keeps its memory between them
+
+#include <algorithm>
+#include <chrono>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <spanstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lexer/c11parser_lexer.h"
+#include "c11parser.bison.h"
+
+namespace c11parser {
+using namespace std;
+
+struct FrameRequest {
+  string name;
+  string source;
+};
+
+struct FrameResponse {
+  string name;
+  int status = 0;
+  vector<Diagnostic> diagnostics{};
+};
+
+struct FrameServerOptions {
+  LexerOptions lexerOptions{};
+  bool skipFunctionBodies = false;
+// limit on the parse of each request
+  optional<chrono::milliseconds> timeout{};
+};
+
+// bounds on the sizes a header can give, a larger size is a malformed header rather than an allocation of that size
+// the name bound also applies to diagnostic messages
+inline constexpr size_t frame_max_name_bytes = 64 << 10;
+inline constexpr size_t frame_max_source_bytes = size_t(1) << 30;
+
+// reads size bytes into text in chunks so a size past the end of the stream fails there without allocating all of it
+inline bool read_bytes(istream& in, string& text, size_t size) {
+  constexpr size_t chunk = 64 << 10;
+  text.clear();
+  while(text.size() < size) {
+    auto at = text.size();
+    auto n = min(chunk, size - at);
+    text.resize(at + n);
+    if(!in.read(text.data() + at, n)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// reads next request into the given one to reuse its buffers, false at end of input between frames
+// throws runtime_error for a malformed or truncated frame since the stream cannot be resynchronized after it
+inline bool read_frame(istream& in, FrameRequest& request, size_t maxSourceBytes = frame_max_source_bytes) {
+  size_t nameSize, sourceSize;
+  if(!(in >> nameSize)) {
+    if(in.eof()) {
+      return false;
+    }
+    throw runtime_error("bad frame header");
+  }
+  if(!(in >> sourceSize) || in.get() != '\n' || nameSize > frame_max_name_bytes || sourceSize > maxSourceBytes) {
+    throw runtime_error("bad frame header");
+  }
+  if(!read_bytes(in, request.name, nameSize) || !read_bytes(in, request.source, sourceSize)) {
+    throw runtime_error("truncated frame");
+  }
+  return true;
+}
+
+inline void write_frame(ostream& out, const FrameRequest& request) {
+  out << request.name.size() << ' ' << request.source.size() << '\n' << request.name << request.source;
+}
+
+inline void write_response(ostream& out, const string& name, int status, const vector<Diagnostic>& diagnostics) {
+  out << name.size() << ' ' << status << ' ' << diagnostics.size() << '\n' << name;
+  for(auto& diagnostic: diagnostics) {
+    auto& loc = diagnostic.loc;
+    out << loc.begin.line << ' ' << loc.begin.column << ' ' << loc.end.line << ' ' << loc.end.column << ' ' << diagnostic.message.size() << '\n' << diagnostic.message;
+  }
+}
+
+// client side of write_response, diagnostic locations have no filename since the response may be moved, the name is in the response
+inline bool read_response(istream& in, FrameResponse& response) {
+  size_t nameSize, count;
+  if(!(in >> nameSize)) {
+    if(in.eof()) {
+      return false;
+    }
+    throw runtime_error("bad response header");
+  }
+  if(!(in >> response.status >> count) || in.get() != '\n' || nameSize > frame_max_name_bytes) {
+    throw runtime_error("bad response header");
+  }
+  if(!read_bytes(in, response.name, nameSize)) {
+    throw runtime_error("truncated response");
+  }
+// grown as diagnostics are read so a bad count fails at the end of the stream
+  response.diagnostics.clear();
+  for(; count > 0; --count) {
+    auto& diagnostic = response.diagnostics.emplace_back();
+    auto& loc = diagnostic.loc;
+    size_t messageSize;
+    if(!(in >> loc.begin.line >> loc.begin.column >> loc.end.line >> loc.end.column >> messageSize) || in.get() != '\n' || messageSize > frame_max_name_bytes) {
+      throw runtime_error("bad diagnostic header");
+    }
+    if(!read_bytes(in, diagnostic.message, messageSize)) {
+      throw runtime_error("truncated diagnostic");
+    }
+  }
+  return true;
+}
+
+class FrameServer {
+public:
+
+  explicit FrameServer(FrameServerOptions options = {}):
+    parser(lexer, bisonParam, lexParam),
+    options(options) {}
+
+// answers every request until end of input, returns the number of requests whose source failed to parse
+  size_t serve(istream& in, ostream& out) {
+    size_t failed = 0;
+    while(read_frame(in, request)) {
+      auto status = parse(request);
+      write_response(out, request.name, status, bisonParam.diagnostics);
+      out.flush();
+      failed += status != 0;
+    }
+    return failed;
+  }
+
+  int parse(const FrameRequest& request) {
+    return parse(request, options);
+  }
+
+// parse with options other than the server's, the parser is the same whatever the options
+  int parse(const FrameRequest& request, const FrameServerOptions& options) {
+    lexer.options = options.lexerOptions;
+    ispanstream s(span<const char>(request.source.data(), request.source.size()));
+    lexer.reset(s);
+    bisonParam.reset();
+    bisonParam.skipFunctionBodies = options.skipFunctionBodies;
+    bisonParam.control.deadline = options.timeout? chrono::steady_clock::now() + *options.timeout: chrono::steady_clock::time_point::max();
+    lexParam.loc.initialize(&request.name);
+    return bisonParam.status(parser());
+  }
+
+  const vector<Diagnostic>& diagnostics() const {
+    return bisonParam.diagnostics;
+  }
+
+private:
+
+  Lexer lexer;
+  BisonParam bisonParam;
+  LexParam lexParam;
+  C11Parser parser;
+  FrameServerOptions options;
+// reused for every request
+  FrameRequest request;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,299 @@
+#ifndef C11PARSER_HEADER_REGIONS_H
+#define C11PARSER_HEADER_REGIONS_H
+// parser/header_regions.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// skipping header text of a preprocessed translation unit that was already parsed in an earlier one
+//
+// linemarkers split the text at its outermost includes, a header region runs from the marker entering an included file from the main file
+// up to the marker returning to it so it covers nested includes too, the return marker is left out since its line number depends on where the include was
+// the text is parsed one region at a time, each starting from the typedef context at the end of the one before, like the chunks of a parallel parse
+// a region boundary is almost always a top-level declaration boundary and then parsing region by region is the same as parsing the whole text
+// if any region fails to parse, for example because an include was inside a declaration, the whole text is parsed again in one go
+// so the result and errors are always those of a plain parse
+//
+// a header region that parsed is recorded in a cache shared by many translation units under a hash of its bytes and of the typedef context it started from
+// with the names it declared and whether each is a typedef name after it
+// the same region starting from the same context in a later translation unit gets those changes applied instead of being parsed
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <spanstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "lexer/c11parser_lexer.h"
+#include "lexer/linemarker.h"
+#include "parser/content_hash.h"
+#include "c11parser.bison.h"
+
+namespace c11parser {
+using namespace std;
+
+struct SourceRegion {
+  size_t offset = 0;
+  size_t size = 0;
+// physical line of the first byte
+  int line = 1;
+// text brought in by an include from the main file
+  bool header = false;
+};
+
+// regions in input order covering all of the text, a header left open at the end of the text is not a header region
+inline vector<SourceRegion> split_header_regions(string_view text) {
+  vector<SourceRegion> regions;
+  SourceRegion open;
+  auto close = [&](size_t end, bool header) {
+    if(end > open.offset) {
+      regions.push_back({open.offset, end - open.offset, open.line, header});
+    }
+  };
+
+  int depth = 0;
+  for(auto& marker: read_linemarkers(text)) {
+    if(marker.enter && depth++ == 0) {
+      close(marker.offset, false);
+      open = {marker.offset, 0, marker.inputLine};
+    } else if(marker.leave && depth > 0 && --depth == 0) {
+      close(marker.offset, true);
+      open = {marker.offset, 0, marker.inputLine};
+    }
+  }
+  close(text.size(), false);
+  return regions;
+}
+
+// text without tokens, only blank lines, linemarkers and pragmas which the lexer skips
+inline bool blank_region(string_view text) {
+  for(size_t pos = 0; pos < text.size();) {
+    auto eol = text.find('\n', pos);
+    auto next = eol == string_view::npos? text.size(): eol + 1;
+    auto line = text.substr(pos, next - pos);
+    auto p = line.find_first_not_of(" \t\r\v\f\n");
+    if(p != string_view::npos) {
+      if(line[p] != '#') {
+        return false;
+      }
+      auto directive = line.substr(min(line.find_first_not_of(" \t", p + 1), line.size()));
+      if(!parse_linemarker(line) && !(directive.starts_with("pragma") && directive.size() > 6 && (directive[6] == ' ' || directive[6] == '\t'))) {
+        return false;
+      }
+    }
+    pos = next;
+  }
+  return true;
+}
+
+class HeaderRegionCache {
+public:
+
+// names a region declared with whether each is a typedef name after it
+  using Changes = vector<pair<string, bool>>;
+
+  struct Key {
+    uint64_t text = 0;
+    size_t size = 0;
+    uint64_t context = 0;
+    int flags = 0;
+    bool operator==(const Key&) const = default;
+  };
+
+  shared_ptr<const Changes> find(const Key& key) {
+    lock_guard guard(lock);
+    auto it = regions.find(key);
+    if(it == regions.end()) {
+      ++misses;
+      return nullptr;
+    }
+    ++hits;
+    skippedBytes += key.size;
+    return it->second;
+  }
+
+  void insert(const Key& key, Changes changes) {
+    lock_guard guard(lock);
+    regions.try_emplace(key, make_shared<const Changes>(std::move(changes)));
+  }
+
+  size_t size() const {
+    lock_guard guard(lock);
+    return regions.size();
+  }
+
+  atomic<size_t> hits = 0;
+  atomic<size_t> misses = 0;
+  atomic<size_t> skippedBytes = 0;
+
+private:
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return key.text ^ key.context * 0x9e3779b97f4a7c15ull ^ key.size ^ key.flags;
+    }
+  };
+
+  mutable mutex lock;
+  unordered_map<Key, shared_ptr<const Changes>, KeyHash> regions;
+};
+
+// parses text region by region with header regions seen before taken from the cache
+// uses the given parser objects, which keep their options, and leaves the result in them as a plain parse would apart from stats
+// a parse against an enclosing context is always plain since cached changes do not carry its hidden entries
+class HeaderSkippingParser {
+public:
+
+  HeaderSkippingParser(Lexer& lexer, BisonParam& bisonParam, LexParam& lexParam, C11Parser& parser, HeaderRegionCache& cache):
+    lexer(lexer),
+    bisonParam(bisonParam),
+    lexParam(lexParam),
+    parser(parser),
+    cache(cache),
+    running(bisonParam.resource),
+    declared(bisonParam.resource) {}
+
+// same return value as the parser, diagnostics are in bisonParam
+  int operator()(string_view text, const string* filename) {
+    if(bisonParam.context.enclosing) {
+      return plain(text, filename);
+    }
+    auto regions = split_header_regions(text);
+    if(ranges::none_of(regions, &SourceRegion::header)) {
+      return plain(text, filename);
+    }
+
+    running.clear();
+    vector<location> skippedFunctionBodies;
+    bool tokens = false;
+    auto flags = (lexer.options.atomic_strict_syntax? 0: 1) | lexer.options.enableGccExtensions << 1 | bisonParam.skipFunctionBodies << 2;
+
+    for(auto& region: regions) {
+      auto part = text.substr(region.offset, region.size);
+      if(blank_region(part)) {
+        continue;
+      }
+      tokens = true;
+
+      HeaderRegionCache::Key key;
+      if(region.header) {
+        key = {xxh64(part), part.size(), context_hash(running), flags};
+        if(auto changes = cache.find(key)) {
+          apply(*changes);
+          continue;
+        }
+      }
+
+      declared.clear();
+      auto status = parse(part, filename, region.line, region.offset, region.header? &declared: nullptr);
+      if(status != 0 || !bisonParam.diagnostics.empty()) {
+        return plain(text, filename);
+      }
+      ranges::move(bisonParam.skippedFunctionBodies, back_inserter(skippedFunctionBodies));
+
+      if(region.header) {
+        HeaderRegionCache::Changes changes;
+        changes.reserve(declared.size());
+        for(auto& id: declared) {
+          changes.emplace_back(string(id), running.contains(id));
+        }
+        cache.insert(key, std::move(changes));
+      }
+    }
+
+// an empty translation unit is an error the plain parse reports
+    if(!tokens) {
+      return plain(text, filename);
+    }
+
+    bisonParam.reset();
+    swap(bisonParam.context.current, running);
+    bisonParam.skippedFunctionBodies = std::move(skippedFunctionBodies);
+    return 0;
+  }
+
+// order independent so equal sets hash the same whatever their bucket order
+  static uint64_t context_hash(const Context::context& ctx) {
+    uint64_t h = ctx.size();
+    for(auto& id: ctx) {
+      h += xxh64(id);
+    }
+    return xxh64(string_view((const char*)&h, sizeof(h)));
+  }
+
+private:
+
+  int plain(string_view text, const string* filename) {
+    running.clear();
+    auto status = parse(text, filename, 1, 0);
+    swap(bisonParam.context.current, running);
+    return status;
+  }
+
+// parses part of the text starting from the running context and leaves the context after it running
+  int parse(string_view part, const string* filename, int line, size_t offset, Context::context* record = nullptr) {
+    ispanstream s(span<const char>(part.data(), part.size()));
+    lexer.reset(s);
+    bisonParam.reset();
+    swap(bisonParam.context.current, running);
+    bisonParam.context.declared = record;
+    lexParam.loc.initialize(filename, line, 1, offset);
+    auto status = bisonParam.status(parser());
+    bisonParam.context.declared = nullptr;
+    swap(bisonParam.context.current, running);
+    return status;
+  }
+
+  void apply(const HeaderRegionCache::Changes& changes) {
+    for(auto& [id, typedefname]: changes) {
+      if(typedefname) {
+        running.emplace(id);
+      } else if(auto it = running.find(id); it != running.end()) {
+        running.erase(it);
+      }
+    }
+  }
+
+  Lexer& lexer;
+  BisonParam& bisonParam;
+  LexParam& lexParam;
+  C11Parser& parser;
+  HeaderRegionCache& cache;
+// typedef context between regions and names declared by the region being parsed, in parser memory
+  Context::context running;
+  Context::context declared;
+};
+
+}
+
+#endif
+
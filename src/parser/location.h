@@ -0,0 +1,198 @@
+#ifndef C11PARSER_LOCATION_H
+#define C11PARSER_LOCATION_H
+// parser/location.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// location type for the bison parser, same interface as the location class bison generates with an added byte offset
+// the lexer advances locations only through columns() and lines() so the offset always counts every byte consumed
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+namespace c11parser {
+using namespace std;
+
+class position {
+public:
+  using filename_type = const string;
+  using counter_type = int;
+  using offset_type = size_t;
+
+  explicit position(filename_type* f = nullptr, counter_type l = 1, counter_type c = 1, offset_type o = 0):
+    filename(f),
+    line(l),
+    column(c),
+    offset(o) {}
+
+  void initialize(filename_type* fn = nullptr, counter_type l = 1, counter_type c = 1, offset_type o = 0) {
+    filename = fn;
+    line = l;
+    column = c;
+    offset = o;
+  }
+
+// each count is one newline byte
+  void lines(counter_type count = 1) {
+    if(count) {
+      column = 1;
+      line = add(line, count, 1);
+      offset += count;
+    }
+  }
+
+  void columns(counter_type count = 1) {
+    column = add(column, count, 1);
+    offset += count;
+  }
+
+  filename_type* filename;
+  counter_type line;
+  counter_type column;
+// byte offset from start of input
+  offset_type offset;
+
+private:
+
+  static counter_type add(counter_type lhs, counter_type rhs, counter_type min) {
+    return lhs + rhs < min? min: lhs + rhs;
+  }
+};
+
+inline position& operator+=(position& res, position::counter_type width) {
+  res.columns(width);
+  return res;
+}
+
+inline position operator+(position res, position::counter_type width) {
+  return res += width;
+}
+
+inline position& operator-=(position& res, position::counter_type width) {
+  return res += -width;
+}
+
+inline position operator-(position res, position::counter_type width) {
+  return res -= width;
+}
+
+template<typename YYChar>
+basic_ostream<YYChar>& operator<<(basic_ostream<YYChar>& ostr, const position& pos) {
+  if(pos.filename) {
+    ostr << *pos.filename << ':';
+  }
+  return ostr << pos.line << '.' << pos.column;
+}
+
+class location {
+public:
+  using filename_type = position::filename_type;
+  using counter_type = position::counter_type;
+  using offset_type = position::offset_type;
+
+  location(const position& b, const position& e):
+    begin(b),
+    end(e) {}
+
+  explicit location(const position& p = position()):
+    begin(p),
+    end(p) {}
+
+  explicit location(filename_type* f, counter_type l = 1, counter_type c = 1, offset_type o = 0):
+    begin(f, l, c, o),
+    end(f, l, c, o) {}
+
+  void initialize(filename_type* f = nullptr, counter_type l = 1, counter_type c = 1, offset_type o = 0) {
+    begin.initialize(f, l, c, o);
+    end = begin;
+  }
+
+  void step() {
+    begin = end;
+  }
+
+  void columns(counter_type count = 1) {
+    end += count;
+  }
+
+  void lines(counter_type count = 1) {
+    end.lines(count);
+  }
+
+// number of bytes covered
+  offset_type size() const {
+    return end.offset - begin.offset;
+  }
+
+  position begin;
+  position end;
+};
+
+inline location& operator+=(location& res, const location& end) {
+  res.end = end.end;
+  return res;
+}
+
+inline location operator+(location res, const location& end) {
+  return res += end;
+}
+
+inline location& operator+=(location& res, location::counter_type width) {
+  res.columns(width);
+  return res;
+}
+
+inline location operator+(location res, location::counter_type width) {
+  return res += width;
+}
+
+inline location& operator-=(location& res, location::counter_type width) {
+  return res += -width;
+}
+
+inline location operator-(location res, location::counter_type width) {
+  return res -= width;
+}
+
+// same output format as the bison generated location
+template<typename YYChar>
+basic_ostream<YYChar>& operator<<(basic_ostream<YYChar>& ostr, const location& loc) {
+  auto end_col = 0 < loc.end.column? loc.end.column - 1: 0;
+  ostr << loc.begin;
+  if(loc.end.filename && (!loc.begin.filename || *loc.begin.filename != *loc.end.filename)) {
+    ostr << '-' << loc.end.filename << ':' << loc.end.line << '.' << end_col;
+  } else if(loc.begin.line < loc.end.line) {
+    ostr << '-' << loc.end.line << '.' << end_col;
+  } else if(loc.begin.column < end_col) {
+    ostr << '-' << end_col;
+  }
+  return ostr;
+}
+
+}
+
+#endif
+
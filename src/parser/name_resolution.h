@@ -0,0 +1,224 @@
+#ifndef C11PARSER_NAME_RESOLUTION_H
+#define C11PARSER_NAME_RESOLUTION_H
+// parser/name_resolution.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// uses of ordinary identifiers resolved to their declarations as the parser reduces them
+//
+// a use is a variable, function or enumeration constant named in an expression or a typedef name in a type specifier
+// a declaration is known by the byte offset its declarator or enumerator starts at, the begin offset of its record in parser/decl_index.h
+// declarations are bound in a scoped symbol table of every ordinary identifier where each name has a chain of bindings, innermost first
+// closing a scope is O(1), it is only marked closed and lookups drop closed bindings from the front of a chain as they meet them
+//
+// scopes follow declaration depth, a declaration or block at some depth closes any deeper scope still open
+// so the parameter scope of a prototype ends with the declaration it is in, and a function definition keeps its parameters for its body
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "parser/parse_events.h"
+
+namespace c11parser {
+using namespace std;
+
+// use sites and the declarations they resolve to in two columns of the same length in input order
+struct UseIndex {
+// a name with no declaration in scope, such as a function called without a prototype
+  static constexpr uint64_t unresolved = numeric_limits<uint64_t>::max();
+
+  vector<uint64_t> uses{};
+  vector<uint64_t> declarations{};
+
+  size_t size() const {
+    return uses.size();
+  }
+
+  void clear() {
+    uses.clear();
+    declarations.clear();
+  }
+};
+
+inline constexpr string_view use_index_magic = "C11USES1";
+
+// columnar binary form, magic, u64 count, the use column then the declaration column, all little-endian
+inline void write_use_index(ostream& out, const UseIndex& index) {
+  auto put = [&](uint64_t value) {
+    if constexpr(endian::native == endian::big) {
+      value = byteswap(value);
+    }
+    out.write((const char*)&value, sizeof(value));
+  };
+  out << use_index_magic;
+  put(index.size());
+  for(auto column: {&index.uses, &index.declarations}) {
+    if constexpr(endian::native == endian::little) {
+      out.write((const char*)column->data(), column->size() * sizeof(uint64_t));
+    } else {
+      for(auto value: *column) {
+        put(value);
+      }
+    }
+  }
+}
+
+class NameResolver {
+public:
+
+  NameResolver() {
+    open_to(1);
+  }
+
+// forgets everything from the last translation unit, keeps allocated memory
+  void reset() {
+    names.clear();
+    bindings.clear();
+    scopes.clear();
+    closed.clear();
+    useIndex.clear();
+    open_to(1);
+  }
+
+  void declare(const Declaration& d) {
+// tags have a name space of their own
+    if(d.kind == DeclarationKind::tag) {
+      return;
+    }
+    size_t depth = d.depth;
+    auto parameters = depth + 1 < scopes.size() && scopes[depth + 1].first >= d.loc.begin.offset && scopes[depth + 1].first < d.loc.end.offset;
+    close_to(d.definition && parameters? depth + 2: depth + 1);
+    open_to(depth + 1);
+    auto& scope = scopes[depth];
+    scope.first = min<uint64_t>(scope.first, d.loc.begin.offset);
+
+    auto it = names.find(d.name);
+    if(it == names.end()) {
+      it = names.emplace(string(d.name), none).first;
+    }
+    bindings.push_back({.declaration = d.loc.begin.offset, .scope = scope.id, .shadowed = live(it->second)});
+    it->second = bindings.size() - 1;
+  }
+
+// depth of the block, a function body shares the scope of its parameters
+  void enter_block(size_t depth, bool functionBody) {
+    close_to(functionBody? depth + 1: depth);
+    open_to(depth + 1);
+  }
+
+// depth of the scope around the block that ended
+  void exit_block(size_t depth) {
+    close_to(depth + 1);
+  }
+
+  void use(string_view name, uint64_t offset) {
+    auto declaration = UseIndex::unresolved;
+    if(auto it = names.find(name); it != names.end()) {
+      it->second = live(it->second);
+      if(it->second != none) {
+        declaration = bindings[it->second].declaration;
+      }
+    }
+    useIndex.uses.push_back(offset);
+    useIndex.declarations.push_back(declaration);
+  }
+
+  const UseIndex& index() const {
+    return useIndex;
+  }
+
+// the index is moved out and the resolver starts a new one
+  UseIndex take() {
+    auto index = std::move(useIndex);
+    useIndex.clear();
+    return index;
+  }
+
+private:
+
+  static constexpr uint32_t none = numeric_limits<uint32_t>::max();
+
+  struct Binding {
+    uint64_t declaration = 0;
+    uint32_t scope = 0;
+// next binding of the same name further out, none if there is none
+    uint32_t shadowed = none;
+  };
+
+  struct Scope {
+    uint32_t id = 0;
+// offset of the first declaration in the scope, to tell a function's own parameters from those of an earlier prototype
+    uint64_t first = numeric_limits<uint64_t>::max();
+  };
+
+  struct NameHash {
+    using is_transparent = void;
+
+    size_t operator()(string_view s) const {
+      return hash<string_view>{}(s);
+    }
+  };
+
+// first binding in the chain from i whose scope is still open
+  uint32_t live(uint32_t i) const {
+    while(i != none && closed[bindings[i].scope]) {
+      i = bindings[i].shadowed;
+    }
+    return i;
+  }
+
+  void close_to(size_t depth) {
+    for(; scopes.size() > depth; scopes.pop_back()) {
+      closed[scopes.back().id] = true;
+    }
+  }
+
+  void open_to(size_t depth) {
+    while(scopes.size() < depth) {
+      scopes.push_back({.id = (uint32_t)closed.size()});
+      closed.push_back(false);
+    }
+  }
+
+  unordered_map<string, uint32_t, NameHash, equal_to<>> names;
+  vector<Binding> bindings;
+// open scopes, file scope first
+  vector<Scope> scopes;
+// by scope id
+  vector<bool> closed;
+  UseIndex useIndex;
+};
+
+}
+
+#endif
@@ -0,0 +1,400 @@
+#ifndef C11PARSER_PARALLEL_PARSE_H
+#define C11PARSER_PARALLEL_PARSE_H
+// parser/parallel_parse.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// speculative parallel parse of a single translation unit
+//
+// input is split at likely top-level declaration boundaries, ie a line ending in ; or the closing brace of a function body at brace depth 0
+// each chunk is parsed concurrently starting from a typedef context predicted by a quick scan of typedef declarations before it
+// a chunk records every name it looked up or declared, membership of any name only depends on its initial membership and the actions of the chunk
+// so if every recorded name has the same membership in the predicted and actual contexts the chunk parsed exactly as it would have sequentially
+// chunks are then validated in order against the actual context, mispredicted chunks are parsed again and a chunk that fails to parse makes the rest of the input parse sequentially
+// the result is always the same as a sequential parse of the whole input
+//
+// parse events and function body skipping are not supported, chunks run on different threads and may be parsed twice
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <spanstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "lexer/c11parser_lexer.h"
+#include "c11parser.bison.h"
+
+namespace c11parser {
+using namespace std;
+
+struct ParallelParseOptions {
+// worker threads, 0 means hardware concurrency
+  unsigned threads = 0;
+// smallest chunk worth parsing on its own
+  size_t minChunkSize = 64 * 1024;
+  LexerOptions lexerOptions{};
+};
+
+struct ParallelParseResult {
+// same as parser return value, 0 on success
+  int status = 0;
+// typedef context at end of input
+  Context::context context{};
+  size_t chunks = 0;
+// chunks parsed again because their predicted typedef context was wrong
+  size_t reparsed = 0;
+// a chunk failed to parse so input from its start was parsed sequentially
+  bool sequentialFallback = false;
+// errors from the sequential parse of a failed chunk, same as a sequential parse of the whole input
+  vector<Diagnostic> diagnostics{};
+};
+
+class ParallelParser {
+public:
+
+  explicit ParallelParser(ParallelParseOptions options = {}): options(options) {}
+
+  ParallelParseResult operator()(string_view input, const string* filename = nullptr) {
+    ParallelParseResult result;
+
+    auto threads = options.threads? options.threads: max(thread::hardware_concurrency(), 1u);
+    auto chunks = split(input, threads);
+    result.chunks = chunks.size();
+
+    if(chunks.size() > 1) {
+      atomic<size_t> next = 0;
+      vector<jthread> workers;
+      for(auto i = min<size_t>(threads, chunks.size()); i > 0; --i) {
+        workers.emplace_back([&] {
+          Worker worker(options.lexerOptions, filename);
+          for(size_t k; (k = next++) < chunks.size();) {
+            auto& chunk = chunks[k];
+            chunk.status = worker.parse(input.substr(chunk.offset, chunk.size), chunk.line, chunk.offset, chunk.predicted, &chunk.declared, &chunk.lookups);
+// copied since the worker's memory goes away with its thread
+            chunk.final = worker.bisonParam.context.current;
+          }
+        });
+      }
+      workers.clear();
+    }
+
+// validate chunks in order against the actual context
+    Worker worker(options.lexerOptions, filename);
+    auto& actual = result.context;
+
+    for(size_t k = 0; k < chunks.size(); ++k) {
+      auto& chunk = chunks[k];
+
+      if(chunks.size() > 1 && chunk.status == 0 && agrees(chunk.lookups, chunk.predicted, actual) && agrees(chunk.declared, chunk.predicted, actual)) {
+        for(auto& id: chunk.declared) {
+          if(chunk.final.contains(id)) {
+            actual.insert(id);
+          } else {
+            actual.erase(id);
+          }
+        }
+        continue;
+      }
+
+// parse again with actual context unless the chunk already failed with a context that made no difference
+      if(chunks.size() > 1 && (chunk.status == 0 || !(agrees(chunk.lookups, chunk.predicted, actual) && agrees(chunk.declared, chunk.predicted, actual)))) {
+        ++result.reparsed;
+        if(worker.parse(input.substr(chunk.offset, chunk.size), chunk.line, chunk.offset, actual) == 0) {
+          actual = worker.bisonParam.context.current;
+          continue;
+        }
+      }
+
+// failed chunk, parse the rest sequentially to get the same errors as a sequential parse
+      result.sequentialFallback = chunks.size() > 1;
+      result.status = worker.parse(input.substr(chunk.offset), chunk.line, chunk.offset, actual);
+      result.diagnostics = std::move(worker.bisonParam.diagnostics);
+      actual = worker.bisonParam.context.current;
+      break;
+    }
+
+    return result;
+  }
+
+private:
+
+  struct Chunk {
+    size_t offset = 0;
+    size_t size = 0;
+    int line = 1;
+    Context::context predicted{};
+// results of speculative parse
+    int status = 0;
+    Context::context final{};
+    Context::context declared{};
+    unordered_set<string> lookups{};
+  };
+
+// parser objects reused for every chunk a thread parses
+  struct Worker {
+    Lexer lexer;
+    BisonParam bisonParam;
+    LexParam lexParam;
+    unordered_set<string>* lookups = nullptr;
+    C11Parser parser;
+    const string* filename;
+
+    Worker(const LexerOptions& lexerOptions, const string* filename):
+      parser(lexer, bisonParam, lexParam),
+      filename(filename) {
+      lexer.options = lexerOptions;
+      lexParam.is_typedefname = [this](const string& id) -> bool {
+        if(lookups) {
+          lookups->insert(id);
+        }
+        return bisonParam.context.is_typedefname(id);
+      };
+    }
+
+    int parse(string_view text, int line, size_t offset, const Context::context& initial, Context::context* declared = nullptr, unordered_set<string>* lookups = nullptr) {
+      ispanstream s(span<const char>(text.data(), text.size()));
+      lexer.reset(s);
+      bisonParam.reset();
+      bisonParam.context.current = initial;
+      bisonParam.context.declared = declared;
+      this->lookups = lookups;
+      lexParam.loc.initialize(filename, line, 1, offset);
+      return bisonParam.status(parser());
+    }
+  };
+
+  ParallelParseOptions options;
+
+  static bool agrees(const auto& names, const Context::context& predicted, const Context::context& actual) {
+    return ranges::all_of(names, [&](const auto& id) { return predicted.contains(id) == actual.contains(id); });
+  }
+
+  static bool is_keyword(string_view id) {
+    static const unordered_set<string_view> keywords = {
+      "auto", "char", "const", "double", "enum", "extern", "float", "inline", "int", "long", "register", "restrict",
+      "short", "signed", "static", "struct", "union", "unsigned", "void", "volatile",
+      "_Alignas", "_Atomic", "_Bool", "_Complex", "_Imaginary", "_Noreturn", "_Thread_local",
+      "__extension__", "__inline", "__inline__", "__restrict", "__restrict__", "__signed__", "__volatile", "__volatile__",
+      "__const", "__const__", "__typeof__", "__typeof", "typeof", "__builtin_va_list",
+    };
+    return keywords.contains(id);
+  }
+
+// split input into chunks at likely top-level declaration boundaries and predict the typedef context at the start of each chunk
+// a wrong boundary or prediction only costs a reparse so this scan is deliberately simple
+  vector<Chunk> split(string_view in, unsigned threads) const {
+    vector<Chunk> chunks(1);
+    auto target = max(options.minChunkSize, in.size() / (threads * 4) + 1);
+
+    Context::context typedefs;
+    int line = 1;
+    int braceDepth = 0;
+    int parenDepth = 0;
+// for each open brace whether it opens a function body
+    vector<bool> bodyBraces;
+// last significant character
+    char prev = 0;
+    bool lineBegin = true;
+    bool assignment = false;
+// last token ended an external declaration
+    bool ended = false;
+// start of line after an external declaration, accepted once the next token shows it is not a K&R function body
+    auto pending = string_view::npos;
+    int pendingLine = 0;
+
+// typedef name prediction
+    bool inTypedef = false;
+    string candidate;
+// paren groups closed in a typedef declarator, identifiers in parameter lists are not candidates
+    int groups = 0;
+    bool attribute = false;
+    int attributeDepth = -1;
+
+    auto endDeclaration = [&] {
+      if(inTypedef && !candidate.empty()) {
+        typedefs.emplace(candidate);
+      }
+      inTypedef = false;
+      candidate.clear();
+      groups = 0;
+      assignment = false;
+      ended = true;
+    };
+
+    for(size_t i = 0; i < in.size();) {
+      auto c = in[i];
+
+      if(c == '\n') {
+        ++line;
+        ++i;
+        lineBegin = true;
+        if(ended && pending == string_view::npos) {
+          pending = i;
+          pendingLine = line;
+        }
+        continue;
+      }
+
+      if(isspace((unsigned char)c)) {
+        ++i;
+        continue;
+      }
+
+// preprocessor lines are whole lines for the lexer
+      if(lineBegin && c == '#') {
+        i = min(in.find('\n', i), in.size());
+        continue;
+      }
+      lineBegin = false;
+
+      if(in.substr(i, 2) == "//") {
+        i = min(in.find('\n', i), in.size());
+        continue;
+      }
+      if(in.substr(i, 2) == "/*") {
+        auto end = min(in.find("*/", i + 2), in.size());
+        line += count(in.begin() + i, in.begin() + end, '\n');
+        i = min(end + 2, in.size());
+        continue;
+      }
+
+      if(pending != string_view::npos) {
+        if(c != '{' && pending - chunks.back().offset >= target) {
+          chunks.back().size = pending - chunks.back().offset;
+          chunks.push_back({.offset = pending, .line = pendingLine, .predicted = typedefs});
+        }
+        pending = string_view::npos;
+      }
+      ended = false;
+
+      if(c == '"' || c == '\'') {
+        for(++i; i < in.size() && in[i] != c && in[i] != '\n'; ++i) {
+          if(in[i] == '\\' && i + 1 < in.size() && in[i + 1] != '\n') {
+            ++i;
+          }
+        }
+        ++i;
+        prev = c;
+        continue;
+      }
+
+      if(isalpha((unsigned char)c) || c == '_') {
+        auto start = i;
+        while(i < in.size() && (isalnum((unsigned char)in[i]) || in[i] == '_')) {
+          ++i;
+        }
+        auto id = in.substr(start, i - start);
+
+        if(braceDepth == 0) {
+          if(id == "typedef") {
+            inTypedef = true;
+          } else if(id.starts_with("__attribute") || id.starts_with("__asm") || id == "asm") {
+            attribute = true;
+          } else if(inTypedef && attributeDepth < 0 && !is_keyword(id) && (parenDepth == 0 || (groups == 0 && prev == '*'))) {
+            candidate = id;
+          }
+        }
+        prev = 'a';
+        continue;
+      }
+
+      if(isdigit((unsigned char)c)) {
+        while(i < in.size() && (isalnum((unsigned char)in[i]) || in[i] == '_' || in[i] == '.')) {
+          ++i;
+        }
+        prev = '0';
+        continue;
+      }
+
+      switch(c) {
+      case '{':
+        bodyBraces.push_back(braceDepth == 0 && parenDepth == 0 && !assignment && (prev == ')' || prev == ';'));
+        ++braceDepth;
+        break;
+      case '}':
+        if(braceDepth > 0) {
+          --braceDepth;
+          auto body = bodyBraces.back();
+          bodyBraces.pop_back();
+          if(braceDepth == 0 && body) {
+            endDeclaration();
+          }
+        }
+        break;
+      case '(':
+        if(attribute && braceDepth == 0) {
+          attribute = false;
+          attributeDepth = parenDepth;
+        }
+        ++parenDepth;
+        break;
+      case ')':
+        if(parenDepth > 0) {
+          --parenDepth;
+        }
+        if(braceDepth == 0 && parenDepth == attributeDepth) {
+          attributeDepth = -1;
+        } else if(braceDepth == 0 && parenDepth == 0 && inTypedef) {
+          ++groups;
+        }
+        break;
+      case ';':
+        if(braceDepth == 0 && parenDepth == 0) {
+          endDeclaration();
+        }
+        break;
+      case ',':
+        if(braceDepth == 0 && parenDepth == 0 && inTypedef) {
+          if(!candidate.empty()) {
+            typedefs.emplace(candidate);
+          }
+          candidate.clear();
+          groups = 0;
+        }
+        break;
+      case '=':
+        if(braceDepth == 0 && parenDepth == 0) {
+          assignment = true;
+        }
+        break;
+      }
+      prev = c;
+      ++i;
+    }
+
+    chunks.back().size = in.size() - chunks.back().offset;
+    return chunks;
+  }
+
+};
+
+}
+
+#endif
+
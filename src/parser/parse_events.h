@@ -0,0 +1,94 @@
+#ifndef C11PARSER_PARSE_EVENTS_H
+#define C11PARSER_PARSE_EVENTS_H
+// parser/parse_events.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cstdint>
+#include <string_view>
+
+#include "location.h"
+
+namespace c11parser {
+
+enum class ParseEventKind {
+  declaration,
+  function_definition,
+  statement,
+  expression,
+// compound statement
+  block,
+};
+
+enum class DeclarationKind: uint8_t {
+  typedef_name,
+  variable,
+  function,
+  enumerator,
+// struct, union or enum tag, sent where the tag is defined with a body
+  tag,
+};
+
+// storage class specifiers of a declaration as bits, typedef is a kind of declaration here and not a storage class
+enum StorageClass: uint8_t {
+  storage_none = 0,
+  storage_extern = 1 << 0,
+  storage_static = 1 << 1,
+  storage_thread_local = 1 << 2,
+  storage_auto = 1 << 3,
+  storage_register = 1 << 4,
+};
+
+struct Declaration {
+  DeclarationKind kind = DeclarationKind::variable;
+// points into parser memory, valid only for the call it is sent with
+  std::string_view name{};
+// StorageClass bits
+  uint8_t storage = storage_none;
+// 0 at file scope, one more for each block or parameter list around the name
+  int depth = 0;
+// function declarator that starts a function definition
+  bool definition = false;
+// declarator, enumerator or tag specifier
+  location loc{};
+};
+
+// streaming sink for parse events, for tools that want facts from a single pass without building a syntax tree
+// events are called directly from grammar actions with locations that carry byte offsets, nothing is allocated per event
+// the parser is bottom-up so exit events arrive in post-order, children before parents
+// enter events are only sent where the grammar has committed to a construct before its body: function definitions after their declarator and blocks after the opening brace
+struct ParseEvents {
+  virtual ~ParseEvents() = default;
+
+  virtual void enter(ParseEventKind, const location&) {}
+  virtual void exit(ParseEventKind, const location&) {}
+// a name declared, sent when its declarator is reduced except a function declarator which waits for the end of its declaration to know whether it starts a definition
+  virtual void declare(const Declaration&) {}
+};
+
+}
+
+#endif
+
@@ -0,0 +1,268 @@
+#ifndef C11PARSER_PREPROCESSOR_H
+#define C11PARSER_PREPROCESSOR_H
+// parser/preprocessor.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// the system C preprocessor run as a child process with its output read through a pipe
+//
+// the lexer reads the pipe as the preprocessor writes it so preprocessing and parsing overlap and nothing goes to temporary files
+// the preprocessor writes its own errors to the inherited stderr
+// linemarkers in its output say which source file and line each part came from, map_to_source moves diagnostics there
+// or the preprocessor in preprocessor/c_preprocessor.h run in this process, given the compiler's predefined macros and search paths
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "lexer/linemarker.h"
+#include "parser/diagnostic.h"
+#include "preprocessor/c_preprocessor.h"
+
+extern char** environ;
+
+namespace c11parser {
+using namespace std;
+
+// $CPP split at spaces if set, else the C compiler driver
+inline vector<string> default_preprocessor_command() {
+  auto cpp = getenv("CPP");
+  if(!cpp || !*cpp) {
+    return {"cc", "-E"};
+  }
+  vector<string> command;
+  istringstream words(cpp);
+  for(string word; words >> word;) {
+    command.push_back(word);
+  }
+  return command;
+}
+
+struct PreprocessorOptions {
+// program and arguments such as include directories and macro definitions, the input filename is added last
+  vector<string> command = default_preprocessor_command();
+// runs the built-in preprocessor instead of the command if set
+  const BuiltinPreprocessorOptions* builtin = nullptr;
+};
+
+// output of a shell command, empty if it could not be run
+inline string command_output(const string& command) {
+  string text;
+  if(auto pipe = popen(command.c_str(), "r")) {
+    char buf[4096];
+    for(size_t n; (n = fread(buf, 1, sizeof(buf), pipe)) > 0;) {
+      text.append(buf, n);
+    }
+    pclose(pipe);
+  }
+  return text;
+}
+
+// predefined macros and include search paths of a C compiler driver such as cc or gcc for the built-in preprocessor
+// the compiler is asked for them once, with -dM for the macros and -v for the search list it prints to stderr
+inline BuiltinPreprocessorOptions builtin_options_from(const vector<string>& compiler) {
+  string cc;
+  for(auto& word: compiler) {
+    cc += "'" + word + "' ";
+  }
+  BuiltinPreprocessorOptions options;
+  options.predefined = command_output(cc + "-dM -E -x c /dev/null 2>/dev/null");
+
+  istringstream search(command_output(cc + "-E -Wp,-v -x c /dev/null 2>&1 >/dev/null"));
+  vector<string>* dirs = nullptr;
+  for(string line; getline(search, line);) {
+    if(line.starts_with("#include \"...\" search starts here")) {
+      dirs = &options.quoteDirs;
+    } else if(line.starts_with("#include <...> search starts here")) {
+      dirs = &options.systemDirs;
+    } else if(line.starts_with("End of search list")) {
+      break;
+    } else if(dirs && line.starts_with(' ')) {
+      auto dir = line.substr(1);
+      if(auto framework = dir.find(" (framework directory)"); framework != string::npos) {
+        continue;
+      }
+      dirs->push_back(dir);
+    }
+  }
+  return options;
+}
+
+// stream buffer over the read end of a pipe, does not own the descriptor
+class pipe_streambuf: public streambuf {
+public:
+
+  explicit pipe_streambuf(int fd): fd(fd) {
+    setg(in, in, in);
+  }
+
+protected:
+
+  int_type underflow() override {
+    ssize_t n;
+    while((n = ::read(fd, in, sizeof(in))) < 0 && errno == EINTR) {
+    }
+    if(n <= 0) {
+      return traits_type::eof();
+    }
+    setg(in, in, in + n);
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+  int fd;
+  char in[1 << 16];
+};
+
+class Preprocessor {
+public:
+
+// starts preprocessing filename, - for stdin, throws system_error if the preprocessor cannot be started
+  Preprocessor(const string& filename, const PreprocessorOptions& options = {}) {
+    if(options.builtin) {
+      builtin = make_unique<CPreprocessor>(filename, *options.builtin);
+      return;
+    }
+    if(options.command.empty()) {
+      throw system_error(make_error_code(errc::invalid_argument), "empty preprocessor command");
+    }
+    vector<char*> argv;
+    for(auto& arg: options.command) {
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(const_cast<char*>(filename.c_str()));
+    argv.push_back(nullptr);
+
+    int fds[2];
+    if(pipe2(fds, O_CLOEXEC) != 0) {
+      throw system_error(errno, generic_category(), "pipe");
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    auto err = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if(err != 0) {
+      close(fds[0]);
+      throw system_error(err, generic_category(), "cannot run " + options.command[0]);
+    }
+    fd = fds[0];
+    buf.emplace(fd);
+    in.rdbuf(&*buf);
+  }
+
+  Preprocessor(const Preprocessor&) = delete;
+  Preprocessor& operator=(const Preprocessor&) = delete;
+
+// a preprocessor still writing gets a broken pipe and is reaped
+  ~Preprocessor() {
+    if(fd >= 0) {
+      close(fd);
+    }
+    if(pid > 0) {
+      while(waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {
+      }
+    }
+  }
+
+// preprocessed text as it is produced
+  istream& output() {
+    return builtin? builtin->output(): in;
+  }
+
+// reads whatever output is left and waits for the preprocessor to exit
+// returns its exit status, 128 plus the signal number if a signal ended it, the built-in preprocessor exits with 1 after errors
+  int wait() {
+    if(builtin) {
+      auto& out = builtin->output();
+      out.ignore(numeric_limits<streamsize>::max());
+      return builtin->error_count() > 0? 1: 0;
+    }
+    if(pid <= 0) {
+      return status;
+    }
+    for(char discard[4096];;) {
+      auto n = ::read(fd, discard, sizeof(discard));
+      if(n == 0 || (n < 0 && errno != EINTR)) {
+        break;
+      }
+    }
+    close(fd);
+    fd = -1;
+    int wstatus = 0;
+    while(waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {
+    }
+    pid = -1;
+    status = WIFEXITED(wstatus)? WEXITSTATUS(wstatus): 128 + WTERMSIG(wstatus);
+    return status;
+  }
+
+private:
+  pid_t pid = -1;
+  int fd = -1;
+  int status = 0;
+  optional<pipe_streambuf> buf;
+  istream in{nullptr};
+  unique_ptr<CPreprocessor> builtin;
+};
+
+// diagnostics of preprocessed input moved to the source file and line each came from by the last linemarker on a line before it
+// goes by line since cached diagnostics have no offsets, columns and offsets stay those of the preprocessed input
+// filenames point into markers which must outlive the diagnostics
+inline void map_to_source(vector<Diagnostic>& diagnostics, const vector<Linemarker>& markers) {
+  auto map = [&](position& pos) {
+    auto it = ranges::upper_bound(markers, pos.line - 1, less{}, &Linemarker::inputLine);
+    if(it == markers.begin()) {
+      return;
+    }
+    --it;
+    pos.filename = &it->filename;
+    pos.line = it->line + (pos.line - it->inputLine - 1);
+  };
+  for(auto& diagnostic: diagnostics) {
+    map(diagnostic.loc.begin);
+    map(diagnostic.loc.end);
+  }
+}
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef C11PARSER_RESULT_CACHE_H
+#define C11PARSER_RESULT_CACHE_H
+// parser/result_cache.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// parse results kept on disk across runs, keyed by the content of the input
+//
+// the key is two xxh64 hashes of the input with different seeds, its size, the parse options and a hash of the parser's own sources
+// so a rebuilt parser with a changed grammar or lexer never reads results of the old one
+// each entry is a file named for its key under a directory named for the first two hex digits of the key
+// holding the status and diagnostics in the response format of parser/frame_protocol.h
+//
+// an entry is written to a temporary file in its directory and renamed over the entry name
+// so a reader in any process sees either no entry or a whole one, and concurrent writers of the same key write the same bytes
+// an entry that cannot be read or parsed is a miss, a failure to write is ignored and only costs a parse next time
+//
+// only results that depend on nothing but the input and options are stored, a parse stopped by a deadline or cancel is not
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "parser/content_hash.h"
+#include "parser/frame_protocol.h"
+
+// set by the build to a hash of the grammar, lexer and declarator sources
+#ifndef C11PARSER_SOURCE_HASH
+#define C11PARSER_SOURCE_HASH "unversioned"
+#endif
+
+namespace c11parser {
+using namespace std;
+
+class ResultCache {
+public:
+
+// creates the directory if needed, throws filesystem_error if it cannot
+  explicit ResultCache(filesystem::path dir): dir(std::move(dir)) {
+    filesystem::create_directories(this->dir);
+  }
+
+  static string key(string_view input, const LexerOptions& lexerOptions, bool skipFunctionBodies) {
+    auto flags = (lexerOptions.atomic_strict_syntax? 0: 1) | lexerOptions.enableGccExtensions << 1 | skipFunctionBodies << 2;
+    auto version = xxh64(C11PARSER_SOURCE_HASH);
+    char buf[80];
+    snprintf(buf, sizeof(buf), "%016llx%016llx%zx-%x-%016llx", (unsigned long long)xxh64(input, 0), (unsigned long long)xxh64(input, version), input.size(), (unsigned)flags, (unsigned long long)version);
+    return buf;
+  }
+
+// statuses worth keeping, a syntax error is as much a property of the input as success
+  static bool cacheable(int status) {
+    return status == 0 || status == 1;
+  }
+
+// diagnostics of a hit have the given filename
+  bool load(const string& key, int& status, vector<Diagnostic>& diagnostics, const string* filename = nullptr) const {
+    ifstream in(path(key), ios::binary);
+    if(!in) {
+      return false;
+    }
+    FrameResponse entry;
+    try {
+      if(!read_response(in, entry) || entry.name != key) {
+        return false;
+      }
+    } catch(const runtime_error&) {
+      return false;
+    }
+    status = entry.status;
+    diagnostics = std::move(entry.diagnostics);
+    for(auto& diagnostic: diagnostics) {
+      diagnostic.loc.begin.filename = diagnostic.loc.end.filename = filename;
+    }
+    return true;
+  }
+
+// returns whether the entry was written
+  bool store(const string& key, int status, const vector<Diagnostic>& diagnostics) const {
+    if(!cacheable(status)) {
+      return false;
+    }
+    auto target = path(key);
+    error_code ec;
+    filesystem::create_directories(target.parent_path(), ec);
+    if(ec) {
+      return false;
+    }
+
+// unique among processes by pid and among threads by counter
+    static atomic<unsigned> counter = 0;
+    auto temp = target;
+    temp += ".tmp." + to_string(getpid()) + "." + to_string(counter++);
+    {
+      ofstream out(temp, ios::binary);
+// key as the name guards against a truncated or misplaced file reading as a valid entry
+      write_response(out, key, status, diagnostics);
+      if(!out.flush()) {
+        out.close();
+        filesystem::remove(temp, ec);
+        return false;
+      }
+    }
+    if(rename(temp.c_str(), target.c_str()) != 0) {
+      filesystem::remove(temp, ec);
+      return false;
+    }
+    return true;
+  }
+
+  const filesystem::path& directory() const {
+    return dir;
+  }
+
+private:
+
+  filesystem::path path(const string& key) const {
+    return dir / key.substr(0, 2) / key;
+  }
+
+  filesystem::path dir;
+};
+
+}
+
+#endif
+
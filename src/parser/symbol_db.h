@@ -0,0 +1,651 @@
+#ifndef C11PARSER_SYMBOL_DB_H
+#define C11PARSER_SYMBOL_DB_H
+// parser/symbol_db.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// file-scope declarations of many translation units in one file that is mapped and queried in place
+//
+// each batch parser thread collects the declarations of the files it parses into a partial index of its own
+// the partial indexes are merged on as many threads, their strings first and then their sorted symbols, in rounds of pairs
+// an update keeps the symbols of every translation unit of the earlier database that is not parsed again and replaces the rest
+// the new database is written to a temporary file renamed over the old one so a reader that has it mapped keeps a whole file
+//
+// layout, read in place so only on little-endian hosts, every section 8-byte aligned:
+//
+// header:   SymbolDatabaseHeader, "C11SYMDB", version, counts and section offsets
+// symbols:  SymbolRecord sorted by name, then translation unit, then offset
+// units:    UnitRecord, path and content hash of each translation unit
+// buckets:  SymbolBucket, the run of symbols of a name at xxh64 of the name, linear probing, a power of two in number at most half full
+// strings:  names, filenames and paths each once in sorted order, so comparing offsets of two strings compares the strings
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "lexer/linemarker.h"
+#include "parser/content_hash.h"
+#include "parser/parse_events.h"
+
+namespace c11parser {
+using namespace std;
+
+inline constexpr string_view symbol_database_magic = "C11SYMDB";
+inline constexpr uint32_t symbol_database_version = 1;
+
+struct SymbolDatabaseHeader {
+  char magic[8]{};
+  uint32_t version = 0;
+  uint32_t reserved = 0;
+  uint64_t symbols = 0;
+  uint64_t units = 0;
+  uint64_t buckets = 0;
+  uint64_t stringBytes = 0;
+// byte offsets of the sections from the start of the file
+  uint64_t symbolsAt = 0;
+  uint64_t unitsAt = 0;
+  uint64_t bucketsAt = 0;
+  uint64_t stringsAt = 0;
+};
+
+struct SymbolRecord {
+// strings are offset and size in the string section
+  uint32_t name = 0;
+  uint32_t nameSize = 0;
+// source file of the declaration, a header for one included by the translation unit
+  uint32_t file = 0;
+  uint32_t fileSize = 0;
+  uint32_t unit = 0;
+  uint32_t line = 0;
+  uint32_t column = 0;
+// DeclarationKind
+  uint8_t kind = 0;
+// StorageClass bits
+  uint8_t storage = 0;
+// 1 for a function definition
+  uint8_t flags = 0;
+  uint8_t reserved = 0;
+// byte offset of the declarator in the parsed input of its translation unit
+  uint64_t offset = 0;
+
+  DeclarationKind declaration_kind() const {
+    return (DeclarationKind)kind;
+  }
+
+  bool definition() const {
+    return flags & 1;
+  }
+};
+
+struct UnitRecord {
+  uint32_t path = 0;
+  uint32_t pathSize = 0;
+// xxh64 of the source file content when it was parsed, 0 if it could not be read or failed to parse so it is never taken as unchanged
+  uint64_t hash = 0;
+};
+
+// empty when count is 0
+struct SymbolBucket {
+  uint32_t first = 0;
+  uint32_t count = 0;
+};
+
+static_assert(sizeof(SymbolDatabaseHeader) == 80 && sizeof(SymbolRecord) == 40 && sizeof(UnitRecord) == 16 && sizeof(SymbolBucket) == 8);
+
+// a source file parsed into the database
+struct TranslationUnit {
+  string path;
+  uint64_t hash = 0;
+};
+
+// canonical path of the file and hash of its content, hash 0 if it cannot be read
+inline TranslationUnit translation_unit(const string& filename) {
+  error_code ec;
+  auto path = filesystem::weakly_canonical(filename, ec);
+  TranslationUnit unit{.path = ec? filename: path.string()};
+  if(ifstream in(filename, ios::binary); in) {
+    unit.hash = xxh64(string(istreambuf_iterator<char>(in), {}));
+  }
+  return unit;
+}
+
+// symbol of a partial index whose name and file are string ids of that index
+struct PartialSymbol {
+  uint32_t name = 0;
+  uint32_t file = 0;
+// translation unit, the file's place in its batch
+  uint32_t unit = 0;
+  uint32_t line = 0;
+  uint32_t column = 0;
+  uint8_t kind = 0;
+  uint8_t storage = 0;
+  uint8_t flags = 0;
+  uint64_t offset = 0;
+};
+
+// symbols one thread collected with their strings interned
+class PartialSymbolIndex {
+public:
+
+  void add(string_view name, string_view file, PartialSymbol symbol) {
+    symbol.name = intern(name);
+    symbol.file = intern(file);
+    entries.push_back(symbol);
+  }
+
+  const vector<PartialSymbol>& symbols() const {
+    return entries;
+  }
+
+// by string id
+  const vector<string_view>& strings() const {
+    return byId;
+  }
+
+  size_t size() const {
+    return entries.size();
+  }
+
+private:
+
+  struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(string_view s) const {
+      return hash<string_view>{}(s);
+    }
+  };
+
+  uint32_t intern(string_view s) {
+    auto it = ids.find(s);
+    if(it == ids.end()) {
+// map nodes never move so views of their keys stay valid, also when the index is moved
+      it = ids.emplace(string(s), (uint32_t)byId.size()).first;
+      byId.push_back(it->first);
+    }
+    return it->second;
+  }
+
+  vector<PartialSymbol> entries;
+  unordered_map<string, uint32_t, StringHash, equal_to<>> ids;
+  vector<string_view> byId;
+};
+
+// parse events sink of one batch parser thread, keeps the file-scope declarations of every file the thread parses
+class SymbolCollector: public ParseEvents {
+public:
+
+// the next translation unit, with the linemarkers of its preprocessed input as the lexer reads them if any
+  void begin(uint32_t unit, const vector<Linemarker>* linemarkers = nullptr) {
+    this->unit = unit;
+    this->linemarkers = linemarkers;
+  }
+
+  void declare(const Declaration& d) override {
+    if(d.depth != 0) {
+      return;
+    }
+    auto pos = d.loc.begin;
+    string_view filename = pos.filename? string_view(*pos.filename): string_view();
+    if(auto marker = linemarkers? linemarker_before(*linemarkers, pos.offset): nullptr) {
+      filename = marker->filename;
+      pos.line = marker->line + (pos.line - marker->inputLine - 1);
+    }
+    index.add(d.name, filename, {
+      .unit = unit,
+      .line = (uint32_t)max(pos.line, 0),
+      .column = (uint32_t)max(pos.column, 0),
+      .kind = (uint8_t)d.kind,
+      .storage = d.storage,
+      .flags = uint8_t(d.definition? 1: 0),
+      .offset = pos.offset,
+    });
+  }
+
+// the index is moved out and the collector starts a new one
+  PartialSymbolIndex take() {
+    auto partial = std::move(index);
+    index = {};
+    return partial;
+  }
+
+private:
+  PartialSymbolIndex index;
+  uint32_t unit = 0;
+  const vector<Linemarker>* linemarkers = nullptr;
+};
+
+// a database file mapped read only, lookups touch only the pages they need
+class SymbolDatabase {
+public:
+
+// throws system_error if the file cannot be mapped and runtime_error if it is not a symbol database
+  explicit SymbolDatabase(const string& path) {
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+      throw system_error(errno, system_category(), path);
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+      auto e = errno;
+      ::close(fd);
+      throw system_error(e, system_category(), path);
+    }
+    bytes = st.st_size;
+    if(bytes < sizeof(SymbolDatabaseHeader)) {
+      ::close(fd);
+      throw runtime_error(path + ": not a symbol database");
+    }
+    auto p = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    auto e = errno;
+    ::close(fd);
+    if(p == MAP_FAILED) {
+      throw system_error(e, system_category(), path);
+    }
+    data = (const char*)p;
+    if(!valid()) {
+      munmap(p, bytes);
+      throw runtime_error(path + ": not a symbol database");
+    }
+  }
+
+  SymbolDatabase(const SymbolDatabase&) = delete;
+  SymbolDatabase& operator=(const SymbolDatabase&) = delete;
+
+  ~SymbolDatabase() {
+    munmap((void*)data, bytes);
+  }
+
+  size_t size() const {
+    return header().symbols;
+  }
+
+  span<const SymbolRecord> symbols() const {
+    return {(const SymbolRecord*)(data + header().symbolsAt), header().symbols};
+  }
+
+  span<const UnitRecord> units() const {
+    return {(const UnitRecord*)(data + header().unitsAt), header().units};
+  }
+
+// every symbol of the name, in translation unit order
+  span<const SymbolRecord> lookup(string_view name) const {
+    span<const SymbolBucket> buckets((const SymbolBucket*)(data + header().bucketsAt), header().buckets);
+    auto mask = buckets.size() - 1;
+    auto b = xxh64(name) & mask;
+    for(size_t probes = 0; probes < buckets.size(); ++probes, b = (b + 1) & mask) {
+      auto bucket = buckets[b];
+      if(bucket.count == 0 || bucket.first + (uint64_t)bucket.count > size()) {
+        break;
+      }
+      if(string_at(symbols()[bucket.first].name, symbols()[bucket.first].nameSize) == name) {
+        return symbols().subspan(bucket.first, bucket.count);
+      }
+    }
+    return {};
+  }
+
+// every symbol whose name starts with prefix, in name order
+  span<const SymbolRecord> prefix(string_view prefix) const {
+    auto all = symbols();
+    auto first = ranges::partition_point(all, [&](auto& s) { return name(s) < prefix; });
+    auto last = partition_point(first, all.end(), [&](auto& s) { return name(s).starts_with(prefix); });
+    return {first, last};
+  }
+
+  string_view name(const SymbolRecord& symbol) const {
+    return string_at(symbol.name, symbol.nameSize);
+  }
+
+  string_view file(const SymbolRecord& symbol) const {
+    return string_at(symbol.file, symbol.fileSize);
+  }
+
+  string_view path(const UnitRecord& unit) const {
+    return string_at(unit.path, unit.pathSize);
+  }
+
+  const UnitRecord* unit(const SymbolRecord& symbol) const {
+    return symbol.unit < header().units? &units()[symbol.unit]: nullptr;
+  }
+
+private:
+
+  const SymbolDatabaseHeader& header() const {
+    return *(const SymbolDatabaseHeader*)data;
+  }
+
+// a string out of bounds in a damaged file reads as empty
+  string_view string_at(uint32_t offset, uint32_t size) const {
+    auto& h = header();
+    if(offset + (uint64_t)size > h.stringBytes) {
+      return {};
+    }
+    return {data + h.stringsAt + offset, size};
+  }
+
+  bool valid() const {
+    auto& h = header();
+    auto section = [&](uint64_t at, uint64_t count, size_t size) {
+      return at % 8 == 0 && at >= sizeof(SymbolDatabaseHeader) && at <= bytes && count <= (bytes - at) / size;
+    };
+    return endian::native == endian::little &&
+      string_view(h.magic, sizeof(h.magic)) == symbol_database_magic &&
+      h.version == symbol_database_version &&
+      section(h.symbolsAt, h.symbols, sizeof(SymbolRecord)) &&
+      section(h.unitsAt, h.units, sizeof(UnitRecord)) &&
+      section(h.bucketsAt, h.buckets, sizeof(SymbolBucket)) &&
+      section(h.stringsAt, h.stringBytes, 1) &&
+      (h.buckets == 0? h.symbols == 0: has_single_bit(h.buckets));
+  }
+
+  const char* data = nullptr;
+  size_t bytes = 0;
+};
+
+// merges the partial indexes of a batch, and the symbols of an earlier database it does not replace, into a new database
+class SymbolDatabaseBuilder {
+public:
+
+// threads for the merge, 0 means hardware concurrency
+  explicit SymbolDatabaseBuilder(unsigned threads = 0):
+    threads(threads? threads: max(thread::hardware_concurrency(), 1u)) {}
+
+// keeps the symbols of every translation unit of db the batch does not have, db must stay open until write
+  void keep(const SymbolDatabase& db) {
+    earlier = &db;
+  }
+
+// partial indexes of a batch whose unit ids index units, the translation units in batch order
+  void add(vector<PartialSymbolIndex> partials, vector<TranslationUnit> units) {
+    this->partials = std::move(partials);
+    batchUnits = std::move(units);
+  }
+
+// merges and writes the database to path, throws system_error if it cannot be written
+  void write(const string& path) {
+    if constexpr(endian::native != endian::little) {
+      throw runtime_error("symbol database needs a little-endian host");
+    }
+
+// translation units, those of the earlier database not in the batch in their old order, then the batch's
+    vector<pair<string_view, uint64_t>> units;
+    unordered_set<string_view> replaced;
+    for(auto& unit: batchUnits) {
+      replaced.insert(unit.path);
+    }
+    vector<uint32_t> earlierUnits;
+    if(earlier) {
+      for(auto& unit: earlier->units()) {
+        auto path = earlier->path(unit);
+        earlierUnits.push_back(replaced.contains(path)? none: (uint32_t)units.size());
+        if(!replaced.contains(path)) {
+          units.push_back({path, unit.hash});
+        }
+      }
+    }
+    vector<uint32_t> unitIds;
+    for(auto& unit: batchUnits) {
+      unitIds.push_back(units.size());
+      units.push_back({unit.path, unit.hash});
+    }
+
+// one source of strings and symbols per partial index, one for the earlier database and one for unit paths
+    vector<Source> sources(partials.size());
+    parallel_for(partials.size(), [&](size_t i) {
+      auto& source = sources[i];
+      source.strings = partials[i].strings();
+      source.records.reserve(partials[i].size());
+      for(auto& s: partials[i].symbols()) {
+        source.records.push_back({.name = s.name, .file = s.file, .unit = s.unit < unitIds.size()? unitIds[s.unit]: none,
+          .line = s.line, .column = s.column, .kind = s.kind, .storage = s.storage, .flags = s.flags, .offset = s.offset});
+      }
+      erase_if(source.records, [](auto& r) { return r.unit == none; });
+    });
+    kept = 0;
+    if(earlier) {
+      auto& source = sources.emplace_back();
+      unordered_map<uint32_t, uint32_t> ids;
+      auto id = [&](uint32_t offset, string_view s) {
+        auto [it, added] = ids.try_emplace(offset, (uint32_t)source.strings.size());
+        if(added) {
+          source.strings.push_back(s);
+        }
+        return it->second;
+      };
+      for(auto& symbol: earlier->symbols()) {
+        if(symbol.unit < earlierUnits.size() && earlierUnits[symbol.unit] != none) {
+          auto record = symbol;
+          record.unit = earlierUnits[symbol.unit];
+          record.name = id(symbol.name, earlier->name(symbol));
+          record.file = id(symbol.file, earlier->file(symbol));
+          source.records.push_back(record);
+        }
+      }
+      kept = source.records.size();
+    }
+    auto& paths = sources.emplace_back();
+    for(auto& unit: units) {
+      paths.strings.push_back(unit.first);
+    }
+
+// every string once in sorted order, each source's sorted on a thread of its own and then merged
+    vector<vector<string_view>> runs(sources.size());
+    parallel_for(sources.size(), [&](size_t i) {
+      runs[i] = sources[i].strings;
+      ranges::sort(runs[i]);
+    });
+    auto strings = merge_runs(std::move(runs), less{}, true);
+    string table;
+    vector<uint32_t> offsets;
+    for(auto s: strings) {
+      offsets.push_back(table.size());
+      table += s;
+    }
+    if(table.size() > numeric_limits<uint32_t>::max()) {
+      throw length_error("symbol database strings over 4GB");
+    }
+
+// source string ids to string offsets, then each source's symbols sorted and merged
+    auto byName = [](const SymbolRecord& a, const SymbolRecord& b) {
+      return tie(a.name, a.unit, a.offset) < tie(b.name, b.unit, b.offset);
+    };
+    vector<vector<SymbolRecord>> recordRuns(sources.size());
+    parallel_for(sources.size(), [&](size_t i) {
+      auto& source = sources[i];
+      vector<uint32_t> stringOffsets;
+      for(auto s: source.strings) {
+        stringOffsets.push_back(offsets[ranges::lower_bound(strings, s) - strings.begin()]);
+      }
+      for(auto& record: source.records) {
+        record.nameSize = source.strings[record.name].size();
+        record.name = stringOffsets[record.name];
+        record.fileSize = source.strings[record.file].size();
+        record.file = stringOffsets[record.file];
+      }
+      ranges::sort(source.records, byName);
+      recordRuns[i] = std::move(source.records);
+    });
+    auto symbols = merge_runs(std::move(recordRuns), byName, false);
+    if(symbols.size() >= numeric_limits<uint32_t>::max()) {
+      throw length_error("symbol database over 4G symbols");
+    }
+
+    vector<UnitRecord> unitRecords;
+    for(auto& [path, hash]: units) {
+      unitRecords.push_back({.path = offsets[ranges::lower_bound(strings, path) - strings.begin()], .pathSize = (uint32_t)path.size(), .hash = hash});
+    }
+
+    size_t names = 0;
+    for(size_t i = 0; i < symbols.size(); ++i) {
+      names += i == 0 || symbols[i].name != symbols[i - 1].name;
+    }
+    vector<SymbolBucket> buckets(names? bit_ceil(2 * names): 0);
+    auto mask = buckets.size() - 1;
+    for(size_t i = 0; i < symbols.size();) {
+      auto first = i;
+      for(++i; i < symbols.size() && symbols[i].name == symbols[first].name; ++i) {
+      }
+      auto b = xxh64(string_view(table).substr(symbols[first].name, symbols[first].nameSize)) & mask;
+      while(buckets[b].count) {
+        b = (b + 1) & mask;
+      }
+      buckets[b] = {(uint32_t)first, (uint32_t)(i - first)};
+    }
+
+    SymbolDatabaseHeader header{.version = symbol_database_version, .symbols = symbols.size(), .units = unitRecords.size(), .buckets = buckets.size(), .stringBytes = table.size()};
+    memcpy(header.magic, symbol_database_magic.data(), sizeof(header.magic));
+    header.symbolsAt = sizeof(header);
+    header.unitsAt = header.symbolsAt + symbols.size() * sizeof(SymbolRecord);
+    header.bucketsAt = header.unitsAt + unitRecords.size() * sizeof(UnitRecord);
+    header.stringsAt = header.bucketsAt + buckets.size() * sizeof(SymbolBucket);
+
+    auto temporary = path + ".tmp";
+    {
+      ofstream out(temporary, ios::binary | ios::trunc);
+      out.write((const char*)&header, sizeof(header));
+      out.write((const char*)symbols.data(), symbols.size() * sizeof(SymbolRecord));
+      out.write((const char*)unitRecords.data(), unitRecords.size() * sizeof(UnitRecord));
+      out.write((const char*)buckets.data(), buckets.size() * sizeof(SymbolBucket));
+      out.write(table.data(), table.size());
+      out.close();
+      if(!out) {
+        error_code ec;
+        filesystem::remove(temporary, ec);
+        throw system_error(make_error_code(errc::io_error), temporary);
+      }
+    }
+    filesystem::rename(temporary, path);
+    written = symbols.size();
+    writtenUnits = units.size();
+  }
+
+// counts of the last write, symbols kept from the earlier database are among all symbols
+  size_t symbols() const {
+    return written;
+  }
+
+  size_t units() const {
+    return writtenUnits;
+  }
+
+  size_t kept_symbols() const {
+    return kept;
+  }
+
+private:
+
+  static constexpr uint32_t none = numeric_limits<uint32_t>::max();
+
+// symbols whose name and file are ids of strings until they are merged
+  struct Source {
+    vector<string_view> strings{};
+    vector<SymbolRecord> records{};
+  };
+
+// f(i) for every i below n on up to the builder's threads
+  template<class F>
+  void parallel_for(size_t n, F f) const {
+    if(threads == 1 || n <= 1) {
+      for(size_t i = 0; i < n; ++i) {
+        f(i);
+      }
+      return;
+    }
+    atomic<size_t> next = 0;
+    vector<jthread> pool;
+    for(size_t t = 0; t < min<size_t>(threads, n); ++t) {
+      pool.emplace_back([&] {
+        for(size_t i; (i = next++) < n;) {
+          f(i);
+        }
+      });
+    }
+  }
+
+// sorted runs merged in pairs, the pairs of a round on threads of their own, with duplicates dropped if unique
+  template<class T, class Less>
+  vector<T> merge_runs(vector<vector<T>> runs, Less less, bool unique) const {
+    auto same = [&](const T& a, const T& b) { return !less(a, b) && !less(b, a); };
+    if(runs.size() == 1 && unique) {
+      runs[0].erase(ranges::unique(runs[0], same).begin(), runs[0].end());
+    }
+    while(runs.size() > 1) {
+      vector<vector<T>> merged((runs.size() + 1) / 2);
+      parallel_for(merged.size(), [&](size_t i) {
+        if(2 * i + 1 == runs.size()) {
+          merged[i] = std::move(runs[2 * i]);
+          return;
+        }
+        auto& a = runs[2 * i];
+        auto& b = runs[2 * i + 1];
+        merged[i].reserve(a.size() + b.size());
+        ranges::merge(a, b, back_inserter(merged[i]), less);
+        if(unique) {
+          merged[i].erase(ranges::unique(merged[i], same).begin(), merged[i].end());
+        }
+        a = {};
+        b = {};
+      });
+      runs = std::move(merged);
+    }
+    return runs.empty()? vector<T>(): std::move(runs[0]);
+  }
+
+  unsigned threads;
+  const SymbolDatabase* earlier = nullptr;
+  vector<PartialSymbolIndex> partials;
+  vector<TranslationUnit> batchUnits;
+  size_t written = 0;
+  size_t writtenUnits = 0;
+  size_t kept = 0;
+};
+
+}
+
+#endif
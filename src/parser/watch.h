@@ -0,0 +1,314 @@
+#ifndef C11PARSER_WATCH_H
+#define C11PARSER_WATCH_H
+// parser/watch.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// sources under directory trees parsed once and then again as they change, with inotify
+//
+// the batch parser, its threads' parsers and the header region and source file caches live as long as the watcher so every parse after the first is warm
+// a source is parsed again only when a save changed its content, or with a preprocessor when a header it included last time changed
+// the events of one save, often several for an editor writing a temporary file and renaming it, are taken together before parsing
+// directories whose names start with a dot are not watched
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <set>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "parser/batch_parse.h"
+#include "parser/content_hash.h"
+
+namespace c11parser {
+using namespace std;
+
+struct SourceWatcherOptions {
+  BatchParseOptions batch{};
+// files with these extensions are sources, any other file changing matters only as a header
+  vector<string> extensions = {".c", ".i"};
+// quiet time that ends the events of one save
+  chrono::milliseconds settle{10};
+};
+
+class SourceWatcher {
+public:
+
+// watches every directory under the roots, throws system_error if inotify cannot be set up
+  SourceWatcher(vector<string> roots, SourceWatcherOptions options = {}):
+    options(std::move(options)),
+    parser(this->options.batch) {
+    if((inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+      throw system_error(errno, system_category(), "inotify_init1");
+    }
+    if((stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+      auto e = errno;
+      close(inotifyFd);
+      throw system_error(e, system_category(), "eventfd");
+    }
+    for(auto& root: roots) {
+      vector<string> found;
+      watch_tree(root, found);
+    }
+  }
+
+  SourceWatcher(const SourceWatcher&) = delete;
+  SourceWatcher& operator=(const SourceWatcher&) = delete;
+
+  ~SourceWatcher() {
+    close(inotifyFd);
+    close(stopFd);
+  }
+
+// parses every source under the roots
+  BatchParseResult scan() {
+    vector<string> files;
+    for(auto& dir: dirs) {
+      error_code ec;
+      for(auto& entry: filesystem::directory_iterator(dir.second, ec)) {
+        if(entry.is_regular_file(ec) && source(entry.path())) {
+          files.push_back(entry.path().string());
+        }
+      }
+    }
+    ranges::sort(files);
+    return parse(files);
+  }
+
+// waits for saves and parses the sources they changed, returns an empty result on timeout or after stop
+  BatchParseResult changes(optional<chrono::milliseconds> timeout = nullopt) {
+    auto deadline = timeout? chrono::steady_clock::now() + *timeout: chrono::steady_clock::time_point::max();
+    for(set<string> changed; wait(deadline, changed); changed.clear()) {
+      if(auto files = affected(changed); !files.empty()) {
+        return parse(files);
+      }
+    }
+    return {};
+  }
+
+// ends a wait for changes now and any later one at once, safe from any thread
+  void stop() {
+    uint64_t one = 1;
+    while(::write(stopFd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+  }
+
+// sources known and those whose last parse failed
+  size_t sources() const {
+    return states.size();
+  }
+
+  size_t failed() const {
+    return ranges::count_if(states, [](auto& entry) { return entry.second.status != 0; });
+  }
+
+  size_t directories() const {
+    return dirs.size();
+  }
+
+private:
+
+  struct SourceState {
+    uint64_t hash = 0;
+    int status = 0;
+// canonical paths of the files its last preprocessed parse read
+    unordered_set<string> includes{};
+  };
+
+  bool source(const filesystem::path& path) const {
+    return ranges::find(options.extensions, path.extension().string()) != options.extensions.end();
+  }
+
+// adds watches on dir and every directory under it, sources in directories added after the first scan are found
+  void watch_tree(const filesystem::path& dir, vector<string>& found) {
+    error_code ec;
+    auto path = filesystem::weakly_canonical(dir, ec);
+    if(ec) {
+      return;
+    }
+    auto wd = inotify_add_watch(inotifyFd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR);
+    if(wd < 0) {
+      return;
+    }
+    dirs[wd] = path.string();
+    for(auto& entry: filesystem::directory_iterator(path, ec)) {
+      auto name = entry.path().filename().string();
+      if(entry.is_directory(ec) && !entry.is_symlink(ec) && !name.starts_with('.')) {
+        watch_tree(entry.path(), found);
+      } else if(entry.is_regular_file(ec) && source(entry.path())) {
+        found.push_back(entry.path().string());
+      }
+    }
+  }
+
+// waits for events until the deadline and then for the rest of the save, false on timeout or stop
+  bool wait(chrono::steady_clock::time_point deadline, set<string>& changed) {
+    pollfd fds[] = {{inotifyFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+    for(;;) {
+      auto now = chrono::steady_clock::now();
+      if(now >= deadline) {
+        return false;
+      }
+      auto left = deadline == chrono::steady_clock::time_point::max()? -1: (int)chrono::ceil<chrono::milliseconds>(deadline - now).count();
+      auto n = poll(fds, 2, left);
+      if(n < 0 && errno != EINTR) {
+        return false;
+      }
+      if(fds[1].revents) {
+        return false;
+      }
+      if(n > 0 && fds[0].revents) {
+        break;
+      }
+    }
+    do {
+      read_events(changed);
+    } while(poll(fds, 1, options.settle.count()) > 0);
+    return true;
+  }
+
+  void read_events(set<string>& changed) {
+    alignas(inotify_event) char buf[1 << 16];
+    for(;;) {
+      auto n = ::read(inotifyFd, buf, sizeof(buf));
+      if(n <= 0) {
+        if(n < 0 && errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      for(auto p = buf; p < buf + n;) {
+        auto event = (const inotify_event*)p;
+        p += sizeof(inotify_event) + event->len;
+        if(event->mask & IN_IGNORED) {
+          dirs.erase(event->wd);
+          continue;
+        }
+        auto dir = dirs.find(event->wd);
+        if(dir == dirs.end() || event->len == 0) {
+          continue;
+        }
+        auto path = dir->second + "/" + event->name;
+        if(event->mask & IN_ISDIR) {
+          if(event->mask & (IN_CREATE | IN_MOVED_TO) && !string_view(event->name).starts_with('.')) {
+            vector<string> found;
+            watch_tree(path, found);
+            changed.insert(found.begin(), found.end());
+          }
+          continue;
+        }
+// a created file is parsed when it is closed after writing, a file moved or deleted away is forgotten
+        if(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)) {
+          changed.insert(path);
+        }
+      }
+    }
+  }
+
+// sources to parse for changed files, in path order
+  vector<string> affected(const set<string>& changed) {
+    auto files = options.batch.preprocessor && options.batch.preprocessor->builtin? options.batch.preprocessor->builtin->files: nullptr;
+    set<string> parse;
+    for(auto& path: changed) {
+      if(files) {
+        files->forget(path);
+      }
+      if(source(path)) {
+        ifstream in(path, ios::binary);
+        if(!in) {
+          states.erase(path);
+          continue;
+        }
+        string text(istreambuf_iterator<char>(in), {});
+        auto hash = xxh64(text);
+        if(auto it = states.find(path); it == states.end() || it->second.hash != hash || it->second.status < 0) {
+          parse.insert(path);
+          hashes[path] = hash;
+        }
+      }
+      if(options.batch.preprocessor) {
+        for(auto& [file, state]: states) {
+          if(file != path && state.includes.contains(path)) {
+            parse.insert(file);
+          }
+        }
+      }
+    }
+    return {parse.begin(), parse.end()};
+  }
+
+  BatchParseResult parse(const vector<string>& files) {
+    auto result = parser(files);
+    for(auto& file: result.files) {
+      auto& state = states[file.filename];
+      state.status = file.status;
+      if(auto hash = hashes.find(file.filename); hash != hashes.end()) {
+        state.hash = hash->second;
+        hashes.erase(hash);
+      } else {
+        ifstream in(file.filename, ios::binary);
+        state.hash = xxh64(string(istreambuf_iterator<char>(in), {}));
+      }
+      state.includes.clear();
+      for(auto& marker: file.linemarkers) {
+        if(!marker.filename.starts_with('<')) {
+          error_code ec;
+          auto path = filesystem::weakly_canonical(marker.filename, ec);
+          if(!ec) {
+            state.includes.insert(path.string());
+          }
+        }
+      }
+    }
+    return result;
+  }
+
+  SourceWatcherOptions options;
+  BatchParser parser;
+  int inotifyFd = -1;
+  int stopFd = -1;
+// watch descriptor to canonical directory path
+  unordered_map<int, string> dirs;
+  unordered_map<string, SourceState> states;
+// content hashes of sources read to see if they changed, until their parse is done
+  unordered_map<string, uint64_t> hashes;
+};
+
+}
+
+#endif
@@ -0,0 +1,1430 @@
+#ifndef C11PARSER_C_PREPROCESSOR_H
+#define C11PARSER_C_PREPROCESSOR_H
+// preprocessor/c_preprocessor.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// C11 preprocessor in the parser's own process, translation phases 3 and 4 of C11 5.1.1.2
+//
+// output is preprocessed text with GCC linemarkers written as it is produced into a stream the lexer reads
+// the lexer stays the one place that turns text into parser tokens since it also does the typedef name feedback
+//
+// macro expansion is the hideset algorithm of Dave Prosser's C90 rationale as most small preprocessors do it
+// every token carries the names of macros whose expansion it came from and a name in its own hideset is not expanded again
+// results of an expansion go back on a stack of pending tokens in front of the file and are rescanned from there
+//
+// directives, conditional groups, #include with quote, -I and system search paths and GCC's #include_next,
+// #line, #error, #pragma once, _Pragma and the GNU , ## __VA_ARGS__ comma are handled
+// a file whose text is all inside #ifndef X ... #endif is remembered in the file cache as guarded by X and not opened again while X is defined
+// errors are written to stderr like a compiler's and counted
+
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <set>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "preprocessor/pp_token.h"
+
+namespace c11parser {
+using namespace std;
+
+// immutable list shared between tokens
+struct Hideset {
+  string_view name;
+  const Hideset* next = nullptr;
+};
+
+struct Macro {
+  vector<PPToken> body;
+  vector<string_view> params;
+// index of the parameter each body token names, -1 for any other token
+  vector<int> param;
+  bool function = false;
+  bool variadic = false;
+};
+
+struct BuiltinPreprocessorOptions {
+// searched for #include "..." only, after the directory of the including file
+  vector<string> quoteDirs{};
+// -I directories
+  vector<string> includeDirs{};
+// searched last, files found here are system headers
+  vector<string> systemDirs{};
+// source read before the input, the compiler's predefined macros and -D and -U as #define and #undef lines
+  string predefined{};
+// shared by many preprocessors, each has its own if not given
+  SourceFileCache* files = nullptr;
+};
+
+class CPreprocessor {
+public:
+
+// filename - reads stdin
+  CPreprocessor(const string& filename, BuiltinPreprocessorOptions options = {}):
+    options(std::move(options)),
+    output_buf(*this),
+    out_stream(&output_buf) {
+    files = this->options.files;
+    if(!files) {
+      ownFiles = make_unique<SourceFileCache>();
+      files = ownFiles.get();
+    }
+    for(auto* list: {&this->options.quoteDirs, &this->options.includeDirs, &this->options.systemDirs}) {
+      if(list == &this->options.includeDirs) {
+        angledStart = dirs.size();
+      } else if(list == &this->options.systemDirs) {
+        systemStart = dirs.size();
+      }
+      dirs.insert(dirs.end(), list->begin(), list->end());
+    }
+
+    if(filename == "-") {
+      main = make_source_file("<stdin>", string(istreambuf_iterator<char>(cin), {}));
+    } else if(!(main = files->load(filename))) {
+      fprintf(stderr, "%s: cannot read file\n", filename.c_str());
+      ++errors;
+      return;
+    }
+    baseName = name(main->path);
+    open.push_back({.file = main, .name = baseName});
+    markers.push_back({baseName, 1, ""});
+
+    builtin = make_source_file("<built-in>", predefined_text() + this->options.predefined);
+    open.push_back({.file = builtin, .name = name(builtin->path), .silent = true});
+  }
+
+  CPreprocessor(const CPreprocessor&) = delete;
+  CPreprocessor& operator=(const CPreprocessor&) = delete;
+
+// preprocessed text as it is produced
+  istream& output() {
+    return out_stream;
+  }
+
+// appends at least n bytes of output, or what is left of it, returns false once all output is written
+  bool produce(string& text, size_t n) {
+    auto start = text.size();
+    swap(out, text);
+    while(!done && out.size() - start < n) {
+      auto token = next_expanded();
+      if(token.kind == PPTokenKind::end) {
+        flush_markers();
+        if(lineHasTokens) {
+          out += '\n';
+        }
+        done = true;
+        break;
+      }
+      write(token);
+    }
+    swap(out, text);
+    return text.size() > start;
+  }
+
+  size_t error_count() const {
+    return errors;
+  }
+
+private:
+
+  struct OpenFile {
+    shared_ptr<const SourceFile> file;
+    size_t pos = 0;
+    const string* name = nullptr;
+// presumed line minus physical line, changed by #line
+    int lineDelta = 0;
+// search directory the file was found in, -1 if not found by searching
+    int dir = -1;
+    bool system = false;
+// produces no linemarkers, for the predefined macros
+    bool silent = false;
+// conditional groups open when the file was entered
+    size_t conditionals = 0;
+// presumed line in this file after the #include being processed
+    int resumeLine = 0;
+// whole file guarded by #ifndef guard ... #endif, found while reading it
+    enum class Guard {start, inside, after, none} guardState = Guard::start;
+    string_view guard{};
+    size_t guardDepth = 0;
+  };
+
+  struct Conditional {
+// some group of this #if has been taken
+    bool taken = false;
+    bool sawElse = false;
+  };
+
+// linemarker waiting for the next token written
+  struct Marker {
+    const string* name;
+    int line;
+    string flags;
+  };
+
+  struct OutputBuffer: streambuf {
+    explicit OutputBuffer(CPreprocessor& pp): pp(pp) {}
+
+    int_type underflow() override {
+      chunk.clear();
+      if(!pp.produce(chunk, 1 << 16)) {
+        return traits_type::eof();
+      }
+      setg(chunk.data(), chunk.data(), chunk.data() + chunk.size());
+      return traits_type::to_int_type(*gptr());
+    }
+
+    CPreprocessor& pp;
+    string chunk;
+  };
+
+  static string predefined_text() {
+    return "#define __STDC__ 1\n#define __STDC_VERSION__ 201710L\n#define __STDC_HOSTED__ 1\n";
+  }
+
+// stable copy of text made by the preprocessor
+  string_view keep(string text) {
+    return strings.emplace_back(std::move(text));
+  }
+
+  const string* name(string text) {
+    return &strings.emplace_back(std::move(text));
+  }
+
+  static PPToken end_token() {
+    return {};
+  }
+
+// reading
+
+  PPToken next_raw() {
+    if(!pending.empty()) {
+      auto token = pending.back();
+      pending.pop_back();
+      return token;
+    }
+    return read_file();
+  }
+
+// next token of the current file after any directives before it
+  PPToken read_file() {
+    for(;;) {
+      if(open.empty()) {
+        return end_token();
+      }
+      auto& f = open.back();
+      auto& tokens = f.file->tokens;
+      if(f.pos == tokens.size()) {
+        leave_file();
+        continue;
+      }
+      auto& t = tokens[f.pos];
+      if(t.bol && (t.is("#") || t.is("%:"))) {
+        if(auto pragma = directive(); pragma.kind != PPTokenKind::end) {
+          return pragma;
+        }
+        continue;
+      }
+      ++f.pos;
+      if(f.guardState != OpenFile::Guard::inside) {
+        f.guardState = OpenFile::Guard::none;
+      }
+      auto token = t;
+      token.line += f.lineDelta;
+      token.filename = f.name;
+      return token;
+    }
+  }
+
+  void leave_file() {
+    auto& f = open.back();
+    if(conditionals.size() > f.conditionals) {
+      error(f, f.file->tokens.empty()? 1: f.file->tokens.back().line, "unterminated conditional directive");
+      conditionals.resize(f.conditionals);
+    }
+    if(f.guardState == OpenFile::Guard::after) {
+      files->set_guard(*f.file, f.guard);
+    }
+    auto silent = f.silent;
+    open.pop_back();
+    if(!open.empty() && !silent) {
+      auto& parent = open.back();
+      markers.push_back({parent.name, parent.resumeLine, parent.system? " 2 3": " 2"});
+    }
+  }
+
+// macro expansion
+
+  PPToken next_expanded() {
+    for(;;) {
+      auto token = next_raw();
+      if(token.kind != PPTokenKind::identifier) {
+        return token;
+      }
+      if(token.text == "_Pragma" && !macros.contains(token.text)) {
+        return pragma_operator(token);
+      }
+      if(!expand(token)) {
+        return token;
+      }
+    }
+  }
+
+  static bool contains(const Hideset* h, string_view name) {
+    for(; h; h = h->next) {
+      if(h->name == name) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const Hideset* add(const Hideset* h, string_view name) {
+    return &hidesets.emplace_back(Hideset{name, h});
+  }
+
+  const Hideset* unite(const Hideset* a, const Hideset* b) {
+    if(!a || a == b) {
+      return b;
+    }
+    if(!b) {
+      return a;
+    }
+    for(; a; a = a->next) {
+      if(!contains(b, a->name)) {
+        b = add(b, a->name);
+      }
+    }
+    return b;
+  }
+
+  const Hideset* intersect(const Hideset* a, const Hideset* b) {
+    const Hideset* h = nullptr;
+    for(; a; a = a->next) {
+      if(contains(b, a->name)) {
+        h = add(h, a->name);
+      }
+    }
+    return h;
+  }
+
+  bool dynamic_macro(string_view name) const {
+    return name == "__FILE__" || name == "__LINE__" || name == "__COUNTER__" || name == "__INCLUDE_LEVEL__" || name == "__BASE_FILE__" || name == "__DATE__" || name == "__TIME__";
+  }
+
+  bool defined(string_view name) const {
+    return macros.contains(name) || dynamic_macro(name) || name == "__has_include" || name == "__has_include_next";
+  }
+
+  PPToken made(const PPToken& at, PPTokenKind kind, string text) {
+    auto token = at;
+    token.kind = kind;
+    token.text = keep(std::move(text));
+    token.hideset = nullptr;
+    return token;
+  }
+
+  static string quote(string_view text) {
+    string s = "\"";
+    for(auto c: text) {
+      if(c == '"' || c == '\\') {
+        s += '\\';
+      }
+      s += c;
+    }
+    return s + '"';
+  }
+
+// pushes the expansion of an identifier naming a macro, false if it is not one or cannot be expanded here
+  bool expand(const PPToken& token) {
+    if(contains(token.hideset, token.text)) {
+      return false;
+    }
+    auto it = macros.find(token.text);
+    if(it == macros.end()) {
+      return dynamic_macro(token.text) && expand_dynamic(token);
+    }
+    auto& macro = it->second;
+    auto macroName = it->first;
+
+    vector<vector<PPToken>> args;
+    const Hideset* hideset;
+    if(macro.function) {
+      auto paren = next_raw();
+      if(!paren.is("(")) {
+        pending.push_back(paren);
+        return false;
+      }
+      PPToken rparen;
+      if(!read_args(token, paren, macro, args, rparen)) {
+        return false;
+      }
+      hideset = add(intersect(token.hideset, rparen.hideset), macroName);
+    } else {
+      hideset = add(token.hideset, macroName);
+    }
+
+    auto result = substitute(macro, args);
+    for(auto& t: result) {
+      t.hideset = unite(t.hideset, hideset);
+      t.filename = token.filename;
+      t.line = token.line;
+      t.column = token.column;
+      t.bol = false;
+    }
+    if(!result.empty()) {
+      result.front().space = token.space;
+    }
+    pending.insert(pending.end(), result.rbegin(), result.rend());
+    return true;
+  }
+
+  bool expand_dynamic(const PPToken& token) {
+    auto name = token.text;
+    PPToken result;
+    if(name == "__FILE__") {
+      result = made(token, PPTokenKind::string, quote(*token.filename));
+    } else if(name == "__BASE_FILE__") {
+      result = made(token, PPTokenKind::string, quote(*baseName));
+    } else if(name == "__LINE__") {
+      result = made(token, PPTokenKind::number, to_string(token.line));
+    } else if(name == "__COUNTER__") {
+      result = made(token, PPTokenKind::number, to_string(counter++));
+    } else if(name == "__INCLUDE_LEVEL__") {
+      result = made(token, PPTokenKind::number, to_string(max<size_t>(open.size(), 1) - 1));
+    } else {
+      auto now = chrono::system_clock::to_time_t(chrono::system_clock::now());
+      tm local;
+      localtime_r(&now, &local);
+      char buf[32];
+      strftime(buf, sizeof(buf), name == "__DATE__"? "\"%b %e %Y\"": "\"%H:%M:%S\"", &local);
+      result = made(token, PPTokenKind::string, buf);
+    }
+    pending.push_back(result);
+    return true;
+  }
+
+// an invocation that is not valid is left as it is, its tokens go back to be read again
+  bool read_args(const PPToken& token, const PPToken& paren, const Macro& macro, vector<vector<PPToken>>& args, PPToken& rparen) {
+    vector<PPToken> read;
+    auto put_back = [&] {
+      pending.insert(pending.end(), read.rbegin(), read.rend());
+      pending.push_back(paren);
+      return false;
+    };
+    args.emplace_back();
+    for(int depth = 0;;) {
+      auto t = next_raw();
+      if(t.kind == PPTokenKind::end) {
+        pending.push_back(t);
+        error(token, "unterminated argument list invoking macro \"" + string(token.text) + "\"");
+        return put_back();
+      }
+      read.push_back(t);
+      if(depth == 0 && t.is(")")) {
+        rparen = t;
+        break;
+      }
+      if(depth == 0 && t.is(",") && !(macro.variadic && args.size() == macro.params.size())) {
+        args.emplace_back();
+        continue;
+      }
+      if(t.is("(")) {
+        ++depth;
+      } else if(t.is(")")) {
+        --depth;
+      }
+      args.back().push_back(t);
+    }
+
+    auto n = macro.params.size();
+    if(n == 0 && args.size() == 1 && args[0].empty()) {
+      args.clear();
+    }
+    if(macro.variadic && args.size() + 1 == n) {
+      args.emplace_back();
+    }
+    if(args.size() != n) {
+      error(token, "macro \"" + string(token.text) + "\" passed " + to_string(args.size()) + " arguments, but takes " + to_string(n));
+      return put_back();
+    }
+    return true;
+  }
+
+  static bool is_paste(const PPToken& t) {
+    return t.is("##") || t.is("%:%:");
+  }
+
+// body of a macro with its parameters replaced, before rescanning
+  vector<PPToken> substitute(const Macro& macro, vector<vector<PPToken>>& args) {
+    vector<PPToken> result;
+    vector<optional<vector<PPToken>>> expanded(args.size());
+    auto& body = macro.body;
+    auto append = [&](const vector<PPToken>& tokens, bool space) {
+      auto first = result.size();
+      result.insert(result.end(), tokens.begin(), tokens.end());
+      if(first < result.size()) {
+        result[first].space = space;
+      }
+    };
+
+    for(size_t i = 0; i < body.size(); ++i) {
+      auto& t = body[i];
+      auto p = macro.param[i];
+
+      if(macro.function && (t.is("#") || t.is("%:")) && i + 1 < body.size() && macro.param[i + 1] >= 0) {
+        result.push_back(stringize(t, args[macro.param[i + 1]]));
+        ++i;
+        continue;
+      }
+
+// GNU extension dropping the comma before empty variable arguments
+      if(macro.variadic && t.is(",") && i + 2 < body.size() && is_paste(body[i + 1]) && macro.param[i + 2] == (int)args.size() - 1) {
+        auto& rest = args.back();
+        if(!rest.empty()) {
+          result.push_back(t);
+          append(rest, body[i + 2].space);
+        }
+        i += 2;
+        continue;
+      }
+
+      if(is_paste(t) && i + 1 < body.size()) {
+        auto& next = body[i + 1];
+        auto q = macro.param[i + 1];
+        ++i;
+        if(q >= 0) {
+          auto& rhs = args[q];
+          if(rhs.empty()) {
+            continue;
+          }
+          if(result.empty()) {
+            append(rhs, next.space);
+            continue;
+          }
+          paste(result, rhs.front());
+          result.insert(result.end(), rhs.begin() + 1, rhs.end());
+        } else if(result.empty()) {
+          result.push_back(next);
+        } else {
+          paste(result, next);
+        }
+        continue;
+      }
+
+      if(p >= 0) {
+        auto& arg = args[p];
+        if(i + 1 < body.size() && is_paste(body[i + 1])) {
+// an empty argument before ## is a placemarker and the right operand stands alone
+          if(arg.empty()) {
+            if(i + 2 < body.size()) {
+              auto q = macro.param[i + 2];
+              if(q >= 0) {
+                append(args[q], t.space);
+              } else {
+                result.push_back(body[i + 2]);
+                result.back().space = t.space;
+              }
+            }
+            i += 2;
+            continue;
+          }
+          append(arg, t.space);
+          continue;
+        }
+        if(!expanded[p]) {
+          expanded[p] = expand_list(arg);
+        }
+        append(*expanded[p], t.space);
+        continue;
+      }
+
+      result.push_back(t);
+    }
+    return result;
+  }
+
+  PPToken stringize(const PPToken& at, const vector<PPToken>& tokens) {
+    string s = "\"";
+    for(size_t k = 0; k < tokens.size(); ++k) {
+      auto& t = tokens[k];
+      if(k > 0 && (t.space || t.bol)) {
+        s += ' ';
+      }
+      if(t.kind == PPTokenKind::string || t.kind == PPTokenKind::character) {
+        for(auto c: t.text) {
+          if(c == '"' || c == '\\') {
+            s += '\\';
+          }
+          s += c;
+        }
+      } else {
+        s += t.text;
+      }
+    }
+    s += '"';
+    auto token = made(at, PPTokenKind::string, std::move(s));
+    token.space = at.space;
+    return token;
+  }
+
+// pastes rhs onto the last token of result
+  void paste(vector<PPToken>& result, const PPToken& rhs) {
+    auto& lhs = result.back();
+    auto text = string(lhs.text) + string(rhs.text);
+    auto tokens = pp_tokenize(text);
+    if(tokens.size() != 1) {
+      error(lhs, "pasting \"" + string(lhs.text) + "\" and \"" + string(rhs.text) + "\" does not give a valid preprocessing token");
+      result.push_back(rhs);
+      return;
+    }
+    lhs.kind = tokens[0].kind;
+    lhs.text = keep(std::move(text));
+  }
+
+// fully macro-expanded copy of a list of tokens, for arguments and #if lines
+  vector<PPToken> expand_list(const vector<PPToken>& tokens) {
+    pending.push_back(end_token());
+    pending.insert(pending.end(), tokens.rbegin(), tokens.rend());
+    vector<PPToken> result;
+    for(;;) {
+      auto t = next_raw();
+      if(t.kind == PPTokenKind::end) {
+        break;
+      }
+      if(t.kind == PPTokenKind::identifier && expand(t)) {
+        continue;
+      }
+      result.push_back(t);
+    }
+    return result;
+  }
+
+  PPToken pragma_operator(const PPToken& token) {
+    auto lparen = next_raw();
+    auto str = lparen.is("(")? next_raw(): lparen;
+    auto rparen = str.kind == PPTokenKind::string? next_raw(): str;
+    if(!lparen.is("(") || str.kind != PPTokenKind::string || !rparen.is(")")) {
+      error(token, "_Pragma takes a parenthesized string literal");
+      pending.push_back(rparen);
+      return next_expanded();
+    }
+    auto body = str.text.substr(str.text.find('"') + 1);
+    body.remove_suffix(1);
+    string text;
+    for(size_t i = 0; i < body.size(); ++i) {
+      if(body[i] == '\\' && i + 1 < body.size() && (body[i + 1] == '"' || body[i + 1] == '\\')) {
+        ++i;
+      }
+      text += body[i];
+    }
+    return made(token, PPTokenKind::pragma, std::move(text));
+  }
+
+// directives
+
+  static string line_text(span<const PPToken> tokens) {
+    string s;
+    for(auto& t: tokens) {
+      if(!s.empty() && t.space) {
+        s += ' ';
+      }
+      s += t.text;
+    }
+    return s;
+  }
+
+// processes the directive at the current position, returns a pragma token to output or an end token
+  PPToken directive() {
+    auto& f = open.back();
+    auto& tokens = f.file->tokens;
+    auto hash = f.pos;
+    auto end = hash + 1;
+    while(end < tokens.size() && !tokens[end].bol) {
+      ++end;
+    }
+    f.pos = end;
+    span<const PPToken> line(tokens.data() + hash + 1, end - hash - 1);
+    auto lineNo = tokens[hash].line + f.lineDelta;
+    if(line.empty()) {
+      return end_token();
+    }
+
+    auto name = line[0].text;
+    auto args = line.subspan(1);
+    track_guard(f, name, args);
+
+    if(line[0].kind == PPTokenKind::number) {
+      line_directive(line, tokens[hash].line);
+    } else if(name == "define") {
+      define(args);
+    } else if(name == "undef") {
+      if(args.empty() || args[0].kind != PPTokenKind::identifier) {
+        error(f, lineNo, "macro names must be identifiers");
+      } else {
+        macros.erase(args[0].text);
+      }
+    } else if(name == "include" || name == "include_next" || name == "import") {
+      include(args, name == "include_next", lineNo);
+    } else if(name == "if" || name == "ifdef" || name == "ifndef") {
+      bool value;
+      if(name == "if") {
+        value = evaluate(args, lineNo);
+      } else if(args.empty() || args[0].kind != PPTokenKind::identifier) {
+        error(f, lineNo, "no macro name given in #" + string(name) + " directive");
+        value = false;
+      } else {
+        value = defined(args[0].text) == (name == "ifdef");
+      }
+      conditionals.push_back({value, false});
+      if(!value) {
+        skip_group();
+      }
+    } else if(name == "elif" || name == "else") {
+      if(conditionals.size() <= f.conditionals) {
+        error(f, lineNo, "#" + string(name) + " without #if");
+        return end_token();
+      }
+      auto& c = conditionals.back();
+      if(c.sawElse) {
+        error(f, lineNo, "#" + string(name) + " after #else");
+      }
+      if(c.taken) {
+        skip_group();
+      } else if(name == "else" || evaluate(args, lineNo)) {
+        c.taken = true;
+      } else {
+        skip_group();
+      }
+      if(name == "else") {
+        conditionals.back().sawElse = true;
+      }
+    } else if(name == "endif") {
+      if(conditionals.size() <= f.conditionals) {
+        error(f, lineNo, "#endif without #if");
+        return end_token();
+      }
+      conditionals.pop_back();
+      if(f.guardState == OpenFile::Guard::inside && conditionals.size() == f.guardDepth) {
+        f.guardState = OpenFile::Guard::after;
+      }
+    } else if(name == "line") {
+      auto expanded = expand_list({args.begin(), args.end()});
+      line_directive(expanded, tokens[hash].line);
+    } else if(name == "error") {
+      error(f, lineNo, "#error " + line_text(args));
+    } else if(name == "warning") {
+      fprintf(stderr, "%s:%d: warning: #warning %s\n", f.name->c_str(), lineNo, line_text(args).c_str());
+    } else if(name == "pragma") {
+      if(args.size() == 1 && args[0].text == "once") {
+        once.insert(f.file->id);
+      } else {
+        auto text = line_text(args);
+        if(text.starts_with("GCC system_header")) {
+          f.system = true;
+        }
+        auto token = made(tokens[hash], PPTokenKind::pragma, std::move(text));
+        token.line = lineNo;
+        token.filename = f.name;
+        return token;
+      }
+    } else if(name != "ident" && name != "sccs" && name != "assert" && name != "unassert") {
+      error(f, lineNo, "invalid preprocessing directive #" + string(name));
+    }
+    return end_token();
+  }
+
+// whole file inside one #ifndef group, or #if !defined, with nothing outside it
+  void track_guard(OpenFile& f, string_view name, span<const PPToken> args) {
+    using enum OpenFile::Guard;
+    if(f.guardState == start) {
+      f.guardState = none;
+      if(name == "ifndef" && args.size() == 1) {
+        f.guard = args[0].text;
+      } else if(name == "if" && args.size() >= 3 && args[0].is("!") && args[1].text == "defined") {
+        auto paren = args[2].is("(");
+        if(args.size() == (paren? 5u: 3u) && (!paren || args[4].is(")"))) {
+          f.guard = args[paren? 3: 2].text;
+        }
+      }
+      if(!f.guard.empty()) {
+        f.guardState = inside;
+        f.guardDepth = conditionals.size();
+      }
+    } else if(f.guardState == after || (f.guardState == inside && (name == "elif" || name == "else") && conditionals.size() == f.guardDepth + 1)) {
+      f.guardState = none;
+    }
+  }
+
+// skips to the #elif, #else or #endif ending the current group, leaving it to be processed
+  void skip_group() {
+    auto& f = open.back();
+    auto& tokens = f.file->tokens;
+    for(int depth = 0; f.pos < tokens.size(); ++f.pos) {
+      auto& t = tokens[f.pos];
+      if(!t.bol || !(t.is("#") || t.is("%:")) || f.pos + 1 == tokens.size() || tokens[f.pos + 1].bol) {
+        continue;
+      }
+      auto d = tokens[f.pos + 1].text;
+      if(d == "if" || d == "ifdef" || d == "ifndef") {
+        ++depth;
+      } else if(d == "endif") {
+        if(depth == 0) {
+          return;
+        }
+        --depth;
+      } else if(depth == 0 && (d == "elif" || d == "else")) {
+        return;
+      }
+    }
+  }
+
+  void define(span<const PPToken> args) {
+    auto& f = open.back();
+    if(args.empty() || args[0].kind != PPTokenKind::identifier) {
+      error(f, args.empty()? 0: args[0].line + f.lineDelta, "macro names must be identifiers");
+      return;
+    }
+    Macro macro;
+    size_t i = 1;
+    if(i < args.size() && args[i].is("(") && !args[i].space) {
+      macro.function = true;
+      for(++i; i < args.size() && !args[i].is(")"); ++i) {
+        if(args[i].is(",")) {
+          continue;
+        }
+        if(args[i].is("...")) {
+          macro.variadic = true;
+          macro.params.push_back("__VA_ARGS__");
+        } else if(args[i].kind == PPTokenKind::identifier) {
+          macro.params.push_back(args[i].text);
+          if(i + 1 < args.size() && args[i + 1].is("...")) {
+            macro.variadic = true;
+            ++i;
+          }
+        } else {
+          error(f, args[i].line + f.lineDelta, "invalid macro parameter list");
+          return;
+        }
+      }
+      if(i == args.size()) {
+        error(f, args[0].line + f.lineDelta, "missing ')' in macro parameter list");
+        return;
+      }
+      ++i;
+    }
+    macro.body.assign(args.begin() + i, args.end());
+    if(!macro.body.empty()) {
+      macro.body.front().space = false;
+    }
+    for(auto& t: macro.body) {
+      int p = -1;
+      if(t.kind == PPTokenKind::identifier) {
+        for(size_t k = 0; k < macro.params.size(); ++k) {
+          if(macro.params[k] == t.text) {
+            p = k;
+            break;
+          }
+        }
+      }
+      macro.param.push_back(p);
+    }
+    macros.insert_or_assign(args[0].text, std::move(macro));
+  }
+
+  void line_directive(span<const PPToken> args, int physicalLine) {
+    auto& f = open.back();
+    if(args.empty() || args[0].kind != PPTokenKind::number) {
+      error(f, physicalLine + f.lineDelta, "#line directive requires a simple digit sequence");
+      return;
+    }
+    f.lineDelta = stoi(string(args[0].text)) - (physicalLine + 1);
+    if(args.size() > 1 && args[1].kind == PPTokenKind::string) {
+      auto text = args[1].text;
+      f.name = name(string(text.substr(1, text.size() - 2)));
+    }
+  }
+
+// includes
+
+  struct Found {
+    shared_ptr<const SourceFile> file;
+    int dir = -1;
+  };
+
+  Found find_include(string_view header, bool quoted, bool next) {
+    auto& f = open.back();
+    if(header.starts_with('/')) {
+      return {files->load(string(header)), -1};
+    }
+    size_t start = 0;
+    if(next && f.dir >= 0) {
+      start = f.dir + 1;
+    } else if(quoted) {
+      auto& path = f.file->path;
+      auto slash = path.rfind('/');
+      auto candidate = slash == string::npos? string(header): path.substr(0, slash + 1) + string(header);
+      if(auto file = files->load(candidate)) {
+        return {file, f.dir};
+      }
+    }
+    if(!quoted) {
+      start = max(start, angledStart);
+    }
+    for(auto i = start; i < dirs.size(); ++i) {
+      auto candidate = dirs[i];
+      if(!candidate.empty() && candidate.back() != '/') {
+        candidate += '/';
+      }
+      candidate += header;
+      if(auto file = files->load(candidate)) {
+        return {file, (int)i};
+      }
+    }
+    return {};
+  }
+
+// header name of an #include or __has_include, empty if the tokens do not form one
+  string header_name(span<const PPToken> args, bool& quoted, size_t& used) {
+    if(!args.empty() && args[0].kind == PPTokenKind::string && args[0].text.starts_with('"')) {
+      quoted = true;
+      used = 1;
+      return string(args[0].text.substr(1, args[0].text.size() - 2));
+    }
+    if(!args.empty() && args[0].is("<")) {
+      string header;
+      for(size_t i = 1; i < args.size(); ++i) {
+        if(args[i].is(">")) {
+          quoted = false;
+          used = i + 1;
+          return header;
+        }
+        if(i > 1 && args[i].space) {
+          header += ' ';
+        }
+        header += args[i].text;
+      }
+    }
+    return {};
+  }
+
+  void include(span<const PPToken> args, bool next, int lineNo) {
+    auto& f = open.back();
+    bool quoted;
+    size_t used;
+    auto header = header_name(args, quoted, used);
+    if(header.empty()) {
+      auto expanded = expand_list({args.begin(), args.end()});
+      header = header_name(expanded, quoted, used);
+    }
+    if(header.empty()) {
+      error(f, lineNo, "#include expects \"FILENAME\" or <FILENAME>");
+      return;
+    }
+    auto found = find_include(header, quoted, next);
+    if(!found.file) {
+      error(f, lineNo, header + ": No such file or directory");
+      return;
+    }
+    auto& path = found.file->path;
+    if(once.contains(found.file->id)) {
+      return;
+    }
+    if(auto guard = files->guard(*found.file); !guard.empty() && macros.contains(guard)) {
+      return;
+    }
+    if(open.size() > 200) {
+      error(f, lineNo, "#include nested depth exceeds 200");
+      return;
+    }
+
+    f.resumeLine = lineNo + 1;
+    auto system = found.dir >= (int)systemStart || f.system;
+    auto fileName = name(path);
+    open.push_back({.file = found.file, .name = fileName, .dir = found.dir, .system = system, .conditionals = conditionals.size()});
+    markers.push_back({fileName, 1, system? " 1 3": " 1"});
+  }
+
+// #if expressions
+
+  struct Value {
+    int64_t v = 0;
+    bool isUnsigned = false;
+  };
+
+  bool evaluate(span<const PPToken> args, int lineNo) {
+    auto& f = open.back();
+    vector<PPToken> tokens;
+    static const string_view one = "1", zero = "0";
+    for(size_t i = 0; i < args.size(); ++i) {
+      auto& t = args[i];
+      if(t.kind == PPTokenKind::identifier && t.text == "defined") {
+        auto paren = i + 1 < args.size() && args[i + 1].is("(");
+        auto k = i + (paren? 2: 1);
+        if(k >= args.size() || args[k].kind != PPTokenKind::identifier || (paren && (k + 1 >= args.size() || !args[k + 1].is(")")))) {
+          error(f, lineNo, "operator \"defined\" requires an identifier");
+          return false;
+        }
+        auto value = t;
+        value.kind = PPTokenKind::number;
+        value.text = defined(args[k].text)? one: zero;
+        tokens.push_back(value);
+        i = k + (paren? 1: 0);
+      } else if(t.kind == PPTokenKind::identifier && (t.text == "__has_include" || t.text == "__has_include_next")) {
+        bool quoted = false;
+        size_t used = 0;
+        auto header = i + 1 < args.size() && args[i + 1].is("(")? header_name(args.subspan(i + 2), quoted, used): string();
+        if(header.empty() || i + 2 + used >= args.size() || !args[i + 2 + used].is(")")) {
+          error(f, lineNo, "operator \"" + string(t.text) + "\" requires a header name");
+          return false;
+        }
+        auto value = t;
+        value.kind = PPTokenKind::number;
+        value.text = find_include(header, quoted, t.text == "__has_include_next").file? one: zero;
+        tokens.push_back(value);
+        i += 2 + used;
+      } else {
+        tokens.push_back(t);
+      }
+    }
+
+    tokens = expand_list(tokens);
+    Expression e{*this, tokens, lineNo};
+    auto value = e.comma(true);
+    if(e.ok && e.i < tokens.size()) {
+      e.fail("missing binary operator before token \"" + string(tokens[e.i].text) + "\"");
+    }
+    return e.ok && value.v != 0;
+  }
+
+  struct Expression {
+    CPreprocessor& pp;
+    const vector<PPToken>& tokens;
+    int lineNo;
+    size_t i = 0;
+    bool ok = true;
+
+    void fail(const string& message) {
+      if(ok) {
+        pp.error(pp.open.back(), lineNo, message);
+      }
+      ok = false;
+    }
+
+    bool at(string_view op) const {
+      return i < tokens.size() && tokens[i].is(op);
+    }
+
+    Value comma(bool eval) {
+      auto v = conditional(eval);
+      while(ok && at(",")) {
+        ++i;
+        v = conditional(eval);
+      }
+      return v;
+    }
+
+    Value conditional(bool eval) {
+      auto c = binary(1, eval);
+      if(!ok || !at("?")) {
+        return c;
+      }
+      ++i;
+      auto a = comma(eval && c.v);
+      if(!at(":")) {
+        fail("expected ':' in conditional expression");
+        return {};
+      }
+      ++i;
+      auto b = conditional(eval && !c.v);
+      auto u = a.isUnsigned || b.isUnsigned;
+      return {c.v? a.v: b.v, u};
+    }
+
+    static int precedence(const PPToken& t) {
+      if(t.kind != PPTokenKind::punctuator) {
+        return 0;
+      }
+      static const unordered_map<string_view, int> table = {
+        {"||", 1}, {"&&", 2}, {"|", 3}, {"^", 4}, {"&", 5}, {"==", 6}, {"!=", 6}, {"<", 7}, {">", 7}, {"<=", 7}, {">=", 7},
+        {"<<", 8}, {">>", 8}, {"+", 9}, {"-", 9}, {"*", 10}, {"/", 10}, {"%", 10},
+      };
+      auto it = table.find(t.text);
+      return it == table.end()? 0: it->second;
+    }
+
+    Value binary(int minPrecedence, bool eval) {
+      auto lhs = unary(eval);
+      while(ok && i < tokens.size()) {
+        auto p = precedence(tokens[i]);
+        if(p == 0 || p < minPrecedence) {
+          break;
+        }
+        auto op = tokens[i++].text;
+        if(op == "&&") {
+          auto rhs = binary(p + 1, eval && lhs.v);
+          lhs = {lhs.v && rhs.v, false};
+        } else if(op == "||") {
+          auto rhs = binary(p + 1, eval && !lhs.v);
+          lhs = {lhs.v || rhs.v, false};
+        } else {
+          lhs = apply(op, lhs, binary(p + 1, eval), eval);
+        }
+      }
+      return lhs;
+    }
+
+    Value apply(string_view op, Value a, Value b, bool eval) {
+      auto u = a.isUnsigned || b.isUnsigned;
+      auto x = (uint64_t)a.v, y = (uint64_t)b.v;
+      if(op == "*") {
+        return {(int64_t)(x * y), u};
+      }
+      if(op == "/" || op == "%") {
+        if(b.v == 0) {
+          if(eval) {
+            fail("division by zero in #if");
+          }
+          return {0, u};
+        }
+        if(u) {
+          return {(int64_t)(op == "/"? x / y: x % y), u};
+        }
+        if(a.v == INT64_MIN && b.v == -1) {
+          return {op == "/"? a.v: 0, u};
+        }
+        return {op == "/"? a.v / b.v: a.v % b.v, u};
+      }
+      if(op == "+") {
+        return {(int64_t)(x + y), u};
+      }
+      if(op == "-") {
+        return {(int64_t)(x - y), u};
+      }
+      if(op == "<<" || op == ">>") {
+        auto n = b.v;
+        auto left = op == "<<";
+        if(!b.isUnsigned && n < 0) {
+          n = -n;
+          left = !left;
+        }
+        if(n >= 64) {
+          return {left || a.isUnsigned || a.v >= 0? 0: -1, a.isUnsigned};
+        }
+        if(left) {
+          return {(int64_t)(x << n), a.isUnsigned};
+        }
+        return {a.isUnsigned? (int64_t)(x >> n): a.v >> n, a.isUnsigned};
+      }
+      if(op == "<" || op == ">" || op == "<=" || op == ">=") {
+        bool r;
+        if(u) {
+          r = op == "<"? x < y: op == ">"? x > y: op == "<="? x <= y: x >= y;
+        } else {
+          r = op == "<"? a.v < b.v: op == ">"? a.v > b.v: op == "<="? a.v <= b.v: a.v >= b.v;
+        }
+        return {r, false};
+      }
+      if(op == "==") {
+        return {x == y, false};
+      }
+      if(op == "!=") {
+        return {x != y, false};
+      }
+      if(op == "&") {
+        return {(int64_t)(x & y), u};
+      }
+      if(op == "^") {
+        return {(int64_t)(x ^ y), u};
+      }
+      return {(int64_t)(x | y), u};
+    }
+
+    Value unary(bool eval) {
+      if(i == tokens.size()) {
+        fail("#if with no expression");
+        return {};
+      }
+      auto& t = tokens[i];
+      if(t.is("+") || t.is("-") || t.is("~") || t.is("!")) {
+        ++i;
+        auto v = unary(eval);
+        if(t.is("-")) {
+          return {(int64_t)(0 - (uint64_t)v.v), v.isUnsigned};
+        }
+        if(t.is("~")) {
+          return {~v.v, v.isUnsigned};
+        }
+        if(t.is("!")) {
+          return {!v.v, false};
+        }
+        return v;
+      }
+      return primary(eval);
+    }
+
+    Value primary(bool eval) {
+      auto& t = tokens[i++];
+      if(t.is("(")) {
+        auto v = comma(eval);
+        if(!at(")")) {
+          fail("missing ')' in expression");
+          return {};
+        }
+        ++i;
+        return v;
+      }
+      if(t.kind == PPTokenKind::number) {
+        return number(t.text);
+      }
+      if(t.kind == PPTokenKind::character) {
+        return character(t.text);
+      }
+// identifiers left after expansion are 0
+      if(t.kind == PPTokenKind::identifier) {
+        return {0, false};
+      }
+      fail("token \"" + string(t.text) + "\" is not valid in preprocessor expressions");
+      return {};
+    }
+
+    Value number(string_view text) {
+      auto digits = text;
+      bool isUnsigned = false;
+      while(!digits.empty() && (digits.back() == 'u' || digits.back() == 'U' || digits.back() == 'l' || digits.back() == 'L')) {
+        isUnsigned |= digits.back() == 'u' || digits.back() == 'U';
+        digits.remove_suffix(1);
+      }
+      int base = 10;
+      if(digits.size() > 1 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+        base = 16;
+        digits.remove_prefix(2);
+      } else if(digits.size() > 1 && digits[0] == '0' && (digits[1] == 'b' || digits[1] == 'B')) {
+        base = 2;
+        digits.remove_prefix(2);
+      } else if(digits.size() > 1 && digits[0] == '0') {
+        base = 8;
+      }
+      uint64_t v = 0;
+      if(digits.empty()) {
+        fail("invalid integer constant \"" + string(text) + "\" in #if");
+        return {};
+      }
+      for(auto c: digits) {
+        int d = c >= '0' && c <= '9'? c - '0': c >= 'a' && c <= 'f'? c - 'a' + 10: c >= 'A' && c <= 'F'? c - 'A' + 10: 99;
+        if(d >= base) {
+          fail(text.find_first_of(".eEpP") != string_view::npos && base != 16? "floating constant in preprocessor expression": "invalid integer constant \"" + string(text) + "\" in #if");
+          return {};
+        }
+        v = v * base + d;
+      }
+      return {(int64_t)v, isUnsigned || v > (uint64_t)INT64_MAX};
+    }
+
+    Value character(string_view text) {
+      auto wide = text[0] != '\'';
+      auto body = text.substr(text.find('\'') + 1);
+      if(!body.empty()) {
+        body.remove_suffix(1);
+      }
+      int64_t v = 0;
+      for(size_t k = 0; k < body.size(); ++k) {
+        int64_t c = (unsigned char)body[k];
+        if(c == '\\' && k + 1 < body.size()) {
+          auto e = body[++k];
+          switch(e) {
+          case 'n': c = '\n'; break;
+          case 't': c = '\t'; break;
+          case 'r': c = '\r'; break;
+          case 'a': c = '\a'; break;
+          case 'b': c = '\b'; break;
+          case 'f': c = '\f'; break;
+          case 'v': c = '\v'; break;
+          case 'e': c = 27; break;
+          case 'x':
+            for(c = 0; k + 1 < body.size() && isxdigit((unsigned char)body[k + 1]); ++k) {
+              auto h = body[k + 1];
+              c = c * 16 + (h <= '9'? h - '0': (h | 0x20) - 'a' + 10);
+            }
+            break;
+          default:
+            if(e >= '0' && e <= '7') {
+              c = e - '0';
+              for(int n = 1; n < 3 && k + 1 < body.size() && body[k + 1] >= '0' && body[k + 1] <= '7'; ++n) {
+                c = c * 8 + (body[++k] - '0');
+              }
+            } else {
+              c = (unsigned char)e;
+            }
+          }
+        }
+        v = wide? c: (v << 8) | (c & 0xff);
+      }
+// a plain single character constant is a char, signed on the targets GCC parses for here
+      if(!wide && body.size() && v < 256) {
+        v = (signed char)v;
+      }
+      return {v, false};
+    }
+  };
+
+// output
+
+  void flush_markers() {
+    for(auto& m: markers) {
+      if(lineHasTokens) {
+        out += '\n';
+      }
+      out += "# ";
+      out += to_string(m.line);
+      out += ' ';
+      out += quote(*m.name);
+      out += m.flags;
+      out += '\n';
+      outName = m.name;
+      outLine = m.line;
+      lineHasTokens = false;
+    }
+    markers.clear();
+  }
+
+// tokens that would read as one if written together
+  static bool needs_space(const PPToken& prev, const PPToken& t) {
+    auto word = [](const PPToken& x) {
+      return x.kind == PPTokenKind::identifier || x.kind == PPTokenKind::number;
+    };
+    if(word(prev) && (word(t) || t.kind == PPTokenKind::string || t.kind == PPTokenKind::character)) {
+      return true;
+    }
+    if(prev.kind == PPTokenKind::number && (t.is(".") || t.is("+") || t.is("-") || t.text.starts_with('.'))) {
+      return true;
+    }
+    if(prev.kind != PPTokenKind::punctuator || t.kind != PPTokenKind::punctuator) {
+      return t.kind == PPTokenKind::number && prev.is(".");
+    }
+    if(prev.text.back() == '/' && (t.text[0] == '/' || t.text[0] == '*')) {
+      return true;
+    }
+    char joined[8];
+    auto n = min<size_t>(prev.text.size(), 4);
+    prev.text.copy(joined, n);
+    auto m = t.text.copy(joined + n, 4);
+    return pp_punctuator_length(string_view(joined, n + m)) > n;
+  }
+
+  void write(const PPToken& t) {
+    flush_markers();
+    if(t.filename != outName || t.line > outLine + 8 || t.line < outLine) {
+      markers.push_back({t.filename, t.line, ""});
+      flush_markers();
+    } else if(t.line > outLine) {
+      out.append(t.line - outLine, '\n');
+      outLine = t.line;
+      lineHasTokens = false;
+    }
+
+    if(t.kind == PPTokenKind::pragma) {
+      if(lineHasTokens) {
+        out += '\n';
+        ++outLine;
+      }
+      out += "#pragma ";
+      out += t.text;
+      out += '\n';
+      ++outLine;
+      lineHasTokens = false;
+      return;
+    }
+
+    if(!lineHasTokens) {
+      out.append(min(max(t.column - 1, 0), 256), ' ');
+    } else if(t.space || t.bol || needs_space(previous, t)) {
+      out += ' ';
+    }
+    out += t.text;
+    lineHasTokens = true;
+    previous = t;
+  }
+
+  void error(const PPToken& at, const string& message) {
+    fprintf(stderr, "%s:%d:%d: error: %s\n", at.filename? at.filename->c_str(): "<unknown>", at.line, at.column, message.c_str());
+    ++errors;
+  }
+
+  void error(const OpenFile& f, int line, const string& message) {
+    fprintf(stderr, "%s:%d: error: %s\n", f.name->c_str(), line, message.c_str());
+    ++errors;
+  }
+
+  BuiltinPreprocessorOptions options;
+  unique_ptr<SourceFileCache> ownFiles;
+  SourceFileCache* files = nullptr;
+  vector<string> dirs;
+  size_t angledStart = 0;
+  size_t systemStart = 0;
+
+  shared_ptr<const SourceFile> main;
+  shared_ptr<const SourceFile> builtin;
+  const string* baseName = nullptr;
+  vector<OpenFile> open;
+  vector<Conditional> conditionals;
+// files seen with #pragma once under any path
+  set<FileId> once;
+  unordered_map<string_view, Macro, hash<string_view>> macros;
+// stack of tokens to read before the current file, next at the back
+  vector<PPToken> pending;
+// text and hidesets made while preprocessing, kept until the end since tokens point into them
+  deque<string> strings;
+  deque<Hideset> hidesets;
+  int counter = 0;
+  size_t errors = 0;
+
+  string out;
+  vector<Marker> markers;
+  const string* outName = nullptr;
+  int outLine = 0;
+  bool lineHasTokens = false;
+  PPToken previous;
+  bool done = false;
+
+  OutputBuffer output_buf;
+  istream out_stream;
+};
+
+}
+
+#endif
@@ -0,0 +1,369 @@
+#ifndef C11PARSER_PP_TOKEN_H
+#define C11PARSER_PP_TOKEN_H
+// preprocessor/pp_token.h
+
+/*
+MIT License
+
+Copyright (c) 2024 Zartaj Majeed
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// preprocessing tokens of C11 6.4 and the source files they come from
+//
+// a file is read, its line splices removed and its text cut into tokens once, the tokens point into the file text
+// files are kept in a cache that many translation units and threads share, along with the macro guarding each if it has one
+// a file reached by several paths is read once and known by its device and inode, so guards and #pragma once hold for every path to it
+
+#include <sys/stat.h>
+
+#include <compare>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace c11parser {
+using namespace std;
+
+enum class PPTokenKind: uint8_t {
+  identifier,
+  number,
+  character,
+  string,
+  punctuator,
+// any other character
+  other,
+// a #pragma line made by the preprocessor from a directive or _Pragma, text is everything after pragma
+  pragma,
+// end of input or of a token list being expanded
+  end,
+};
+
+struct Hideset;
+
+struct PPToken {
+  string_view text{};
+  PPTokenKind kind = PPTokenKind::end;
+// first token on its line
+  bool bol = false;
+// whitespace or a comment before it
+  bool space = false;
+  int line = 0;
+  int column = 0;
+// presumed filename, set when the token is read from its file
+  const string* filename = nullptr;
+// macros not to expand again in this token, see the expansion algorithm in c_preprocessor.h
+  const Hideset* hideset = nullptr;
+
+  bool is(string_view punctuator) const {
+    return kind == PPTokenKind::punctuator && text == punctuator;
+  }
+};
+
+// file on disk under any path that reaches it, zero for text that is not a file
+struct FileId {
+  dev_t device = 0;
+  ino_t inode = 0;
+
+  auto operator<=>(const FileId&) const = default;
+};
+
+struct SourceFile {
+// path as spelled when loaded, quoted includes search its directory
+  string path;
+  FileId id{};
+// text with line splices removed, always ends with a newline
+  string text{};
+  vector<PPToken> tokens{};
+// same file loaded first under another path, its text is what the tokens point into
+  shared_ptr<const SourceFile> same{};
+};
+
+inline bool pp_identifier_start(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$' || (unsigned char)c >= 0x80;
+}
+
+inline bool pp_identifier_char(char c) {
+  return pp_identifier_start(c) || (c >= '0' && c <= '9');
+}
+
+// longest punctuator at the start of text, 0 if none
+inline size_t pp_punctuator_length(string_view text) {
+  static constexpr string_view punctuators[] = {
+    "%:%:", "...", "<<=", ">>=",
+    "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "*=", "/=", "%=", "+=", "-=", "&=", "^=", "|=", "##", "<:", ":>", "<%", "%>", "%:",
+  };
+  for(auto p: punctuators) {
+    if(text.starts_with(p)) {
+      return p.size();
+    }
+  }
+  return text.empty() || string_view("[](){}.&*+-~!/%<>^|?:;=,#").find(text[0]) == string_view::npos? 0: 1;
+}
+
+// tokens of text, which must have no line splices
+// line and column count from the given start, splices lists offsets in text where a removed splice ended a physical line
+inline vector<PPToken> pp_tokenize(string_view text, const vector<size_t>& splices = {}, int line = 1) {
+  vector<PPToken> tokens;
+  tokens.reserve(text.size() / 4);
+  size_t lineStart = 0;
+  size_t nextSplice = 0;
+  bool bol = true;
+  bool space = false;
+
+  auto newline = [&](size_t i) {
+    ++line;
+    lineStart = i + 1;
+    bol = true;
+    space = false;
+  };
+// splices inside a token are counted when the token is done
+  auto catch_up = [&](size_t i) {
+    for(; nextSplice < splices.size() && splices[nextSplice] <= i; ++nextSplice) {
+      ++line;
+      lineStart = splices[nextSplice];
+    }
+  };
+
+  for(size_t i = 0; i < text.size();) {
+    catch_up(i);
+    auto c = text[i];
+    if(c == '\n') {
+      newline(i++);
+      continue;
+    }
+    if(c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') {
+      space = true;
+      ++i;
+      continue;
+    }
+    if(c == '/' && i + 1 < text.size() && text[i + 1] == '*') {
+      auto end = text.find("*/", i + 2);
+      end = end == string_view::npos? text.size(): end + 2;
+// a comment is one space so the line it starts on goes on after it, a directive too
+      for(auto k = text.find('\n', i); k < end; k = text.find('\n', k + 1)) {
+        catch_up(k);
+        ++line;
+        lineStart = k + 1;
+      }
+      space = true;
+      i = end;
+      continue;
+    }
+    if(c == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+      i = text.find('\n', i);
+      i = i == string_view::npos? text.size(): i;
+      space = true;
+      continue;
+    }
+
+    PPToken token{.bol = bol, .space = space, .line = line, .column = (int)(i - lineStart + 1)};
+    auto start = i;
+    auto quoted = [&](char quote) {
+      for(++i; i < text.size() && text[i] != quote && text[i] != '\n'; ++i) {
+        if(text[i] == '\\' && i + 1 < text.size() && text[i + 1] != '\n') {
+          ++i;
+        }
+      }
+// an unterminated literal is left to the lexer to report
+      if(i < text.size() && text[i] == quote) {
+        ++i;
+      }
+    };
+
+    if(pp_identifier_start(c)) {
+      for(++i; i < text.size() && pp_identifier_char(text[i]); ++i) {
+      }
+      auto word = text.substr(start, i - start);
+      if(i < text.size() && (text[i] == '"' || text[i] == '\'') && (word == "L" || word == "u" || word == "U" || word == "u8")) {
+        token.kind = text[i] == '"'? PPTokenKind::string: PPTokenKind::character;
+        quoted(text[i]);
+      } else {
+        token.kind = PPTokenKind::identifier;
+      }
+    } else if((c >= '0' && c <= '9') || (c == '.' && i + 1 < text.size() && text[i + 1] >= '0' && text[i + 1] <= '9')) {
+      token.kind = PPTokenKind::number;
+      for(++i; i < text.size(); ++i) {
+        auto d = text[i];
+        if((d == '+' || d == '-') && (text[i - 1] == 'e' || text[i - 1] == 'E' || text[i - 1] == 'p' || text[i - 1] == 'P')) {
+          continue;
+        }
+        if(!pp_identifier_char(d) && d != '.') {
+          break;
+        }
+      }
+    } else if(c == '"' || c == '\'') {
+      token.kind = c == '"'? PPTokenKind::string: PPTokenKind::character;
+      quoted(c);
+    } else if(auto n = pp_punctuator_length(text.substr(i))) {
+      token.kind = PPTokenKind::punctuator;
+      i += n;
+    } else {
+      token.kind = PPTokenKind::other;
+      ++i;
+    }
+
+    token.text = text.substr(start, i - start);
+    tokens.push_back(token);
+    bol = false;
+    space = false;
+  }
+  return tokens;
+}
+
+// file text with line splices removed and the offsets where they were
+inline void pp_splice(string_view raw, string& text, vector<size_t>& splices) {
+  text.clear();
+  text.reserve(raw.size() + 1);
+  for(size_t i = 0; i < raw.size(); ++i) {
+    if(raw[i] == '\\') {
+      auto k = i + 1;
+      if(k < raw.size() && raw[k] == '\r') {
+        ++k;
+      }
+      if(k < raw.size() && raw[k] == '\n') {
+        splices.push_back(text.size());
+        i = k;
+        continue;
+      }
+    }
+    text += raw[i];
+  }
+  if(text.empty() || text.back() != '\n') {
+    text += '\n';
+  }
+}
+
+inline shared_ptr<SourceFile> make_source_file(string path, string_view raw) {
+  auto file = make_shared<SourceFile>();
+  file->path = std::move(path);
+  vector<size_t> splices;
+  pp_splice(raw, file->text, splices);
+  file->tokens = pp_tokenize(file->text, splices);
+  return file;
+}
+
+// source files by path, a path that could not be read is remembered as missing
+// a file already read under another path is not read again, the new path gets a copy of its tokens
+// shared by many preprocessors, all members lock
+class SourceFileCache {
+public:
+
+  shared_ptr<const SourceFile> load(const string& path) {
+    {
+      lock_guard guard(lock);
+      if(auto it = files.find(path); it != files.end()) {
+        return it->second;
+      }
+    }
+// read and tokenized without the lock, another thread loading the same file at once does the same work and the first one in wins
+    shared_ptr<SourceFile> file;
+    if(struct stat st; stat(path.c_str(), &st) == 0) {
+      FileId id{st.st_dev, st.st_ino};
+      if(auto same = loaded(id)) {
+        file = make_shared<SourceFile>(SourceFile{.path = path, .id = id, .tokens = same->tokens, .same = same});
+      } else if(ifstream in(path, ios::binary); in) {
+        string raw{istreambuf_iterator<char>(in), {}};
+        if(!in.bad()) {
+          file = make_source_file(path, raw);
+          file->id = id;
+        }
+      }
+    }
+    lock_guard guard(lock);
+    auto it = files.try_emplace(path, file).first;
+    if(it->second) {
+      ids.try_emplace(it->second->id, Identity{it->second});
+    }
+    return it->second;
+  }
+
+// macro whose definition guards the whole file, empty if none or not yet known
+  string guard(const SourceFile& file) const {
+    lock_guard guard(lock);
+    auto it = ids.find(file.id);
+    return it == ids.end()? string(): it->second.guard;
+  }
+
+  void set_guard(const SourceFile& file, string_view macro) {
+    lock_guard guard(lock);
+    if(auto it = ids.find(file.id); it != ids.end()) {
+      it->second.guard = macro;
+    }
+  }
+
+// drops the file read from path under any name so it is read again, for a file changed on disk
+  void forget(const string& path) {
+    error_code ec;
+    auto changed = filesystem::weakly_canonical(path, ec);
+    lock_guard guard(lock);
+    auto named = [&](const string& name) {
+      error_code e;
+      return name == path || (!ec && filesystem::weakly_canonical(name, e) == changed);
+    };
+    set<FileId> stale;
+    for(auto& [name, file]: files) {
+      if(file && named(name)) {
+        stale.insert(file->id);
+      }
+    }
+    erase_if(files, [&](auto& entry) {
+      return named(entry.first) || (entry.second && stale.contains(entry.second->id));
+    });
+    erase_if(ids, [&](auto& entry) {
+      return stale.contains(entry.first);
+    });
+  }
+
+  size_t size() const {
+    lock_guard guard(lock);
+    return files.size();
+  }
+
+private:
+
+// first file read with the id, the one others loaded under other paths share
+  shared_ptr<const SourceFile> loaded(FileId id) const {
+    lock_guard guard(lock);
+    auto it = ids.find(id);
+    return it == ids.end()? nullptr: it->second.file;
+  }
+
+  struct Identity {
+    shared_ptr<const SourceFile> file;
+    string guard{};
+  };
+
+  mutable mutex lock;
+  unordered_map<string, shared_ptr<const SourceFile>> files;
+  map<FileId, Identity> ids;
+};
+
+}
+
+#endif
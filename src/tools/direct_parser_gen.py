@@ -0,0 +1,739 @@
+#!/usr/bin/env python3
+
+# direct_parser_gen.py
+
+# generates a direct-coded LR parser from the automaton bison builds for a grammar
+# usage: direct_parser_gen.py grammar.y automaton.xml outdir [classname]
+#
+# automaton.xml is the report from bison --xml for grammar.y
+# the grammar file is read for rule actions, %initial-action, %parse-param and %code blocks since the xml report has no code
+#
+# output is <basename>.direct.h and <basename>.direct.cpp with a parser class that has the same constructor parameters as the bison parser
+# every LR state is a labelled block that switches on the lookahead token kind, every rule is a labelled block with its action
+# behaviour follows the bison lalr1.cc skeleton step for step: default reductions without lookahead in consistent states,
+# detailed syntax error messages, syntax_error exceptions from lexer and actions, and error token recovery
+# the bison generated header is still needed for token, symbol and location types
+
+import os
+import re
+import sys
+import xml.etree.ElementTree as ET
+
+
+def fail(msg):
+  sys.exit(f"direct_parser_gen.py: {msg}")
+
+
+# skip over a C/C++ string or character literal starting at i, returns index after it
+def skip_literal(text, i):
+  quote = text[i]
+  i += 1
+  while i < len(text) and text[i] != quote:
+    i += 2 if text[i] == "\\" else 1
+  return i + 1
+
+
+# skip over a comment starting at i if there is one, returns index after it
+def skip_comment(text, i):
+  if text.startswith("//", i):
+    end = text.find("\n", i)
+    return len(text) if end < 0 else end
+  if text.startswith("/*", i):
+    end = text.find("*/", i + 2)
+    if end < 0:
+      fail("unterminated comment")
+    return end + 2
+  return i
+
+
+# returns index after the brace matching the one at i
+def match_brace(text, i, open_brace="{", close_brace="}"):
+  depth = 0
+  while i < len(text):
+    c = text[i]
+    j = skip_comment(text, i)
+    if j != i:
+      i = j
+      continue
+    if c in "\"'":
+      i = skip_literal(text, i)
+      continue
+    if c == open_brace:
+      depth += 1
+    elif c == close_brace:
+      depth -= 1
+      if depth == 0:
+        return i + 1
+    i += 1
+  fail("unbalanced braces")
+
+
+class Grammar:
+  """rules, actions and code blocks read from the bison grammar file"""
+
+  def __init__(self, path):
+    text = open(path).read()
+    sections = re.split(r"^%%[ \t]*$", text, maxsplit=2, flags=re.M)
+    if len(sections) < 2:
+      fail(f"no rules section in {path}")
+    self.declarations = sections[0]
+    self.aliases = {}
+    self.parse_params = []
+    self.code = {"top": [], "": [], "prologue": []}
+    self.initial_action = ""
+    self.namespace = ""
+    self.parser_class = "parser"
+    self.read_declarations()
+    self.rules = []
+    self.read_rules(sections[1])
+
+  def read_declarations(self):
+    text = self.declarations
+    i = 0
+    while i < len(text):
+      j = skip_comment(text, i)
+      if j != i:
+        i = j
+        continue
+      if text.startswith("%{", i) and (i == 0 or text[i - 1] == "\n"):
+        end = text.index("%}", i)
+        self.code["prologue"].append(text[i + 2:end])
+        i = end + 2
+        continue
+      m = re.compile(r"%code(?:\s+(\w+))?\s*\{").match(text, i)
+      if m:
+        end = match_brace(text, m.end() - 1)
+        self.code.setdefault(m.group(1) or "", []).append(text[m.end():end - 1])
+        i = end
+        continue
+      m = re.compile(r"%initial-action\s*\{").match(text, i)
+      if m:
+        end = match_brace(text, m.end() - 1)
+        self.initial_action = text[m.end():end - 1]
+        i = end
+        continue
+      m = re.compile(r"%parse-param\s*\{").match(text, i)
+      if m:
+        end = match_brace(text, m.end() - 1)
+        self.parse_params.append(text[m.end():end - 1].strip())
+        i = end
+        continue
+      m = re.compile(r"%define\s+api\.namespace\s*\{([^}]*)\}").match(text, i)
+      if m:
+        self.namespace = m.group(1).strip()
+      m = re.compile(r"%define\s+api\.parser\.class\s*\{([^}]*)\}").match(text, i)
+      if m:
+        self.parser_class = m.group(1).strip()
+      m = re.compile(r"%token\s+(?:<[^>]*>\s+)?([A-Za-z_]\w*)\s+(\"(?:[^\"\\]|\\.)*\")").match(text, i)
+      if m:
+        self.aliases[m.group(1)] = m.group(2)
+      end = text.find("\n", i)
+      i = len(text) if end < 0 else end + 1
+
+  # split rules section into rules of alternatives, each a list of items
+  # item is ("symbol", name, alias) or ("action", code)
+  def read_rules(self, text):
+    tokens = []
+    i = 0
+    while i < len(text):
+      c = text[i]
+      j = skip_comment(text, i)
+      if j != i:
+        i = j
+        continue
+      if c.isspace():
+        i += 1
+        continue
+      if c == "{":
+        end = match_brace(text, i)
+        tokens.append(("action", text[i + 1:end - 1]))
+        i = end
+        continue
+      if c == "[":
+        end = text.index("]", i)
+        tokens.append(("alias", text[i + 1:end]))
+        i = end + 1
+        continue
+      if c in "\"'":
+        end = skip_literal(text, i)
+        tokens.append(("symbol", text[i:end]))
+        i = end
+        continue
+      if c in ":|;":
+        tokens.append((c, c))
+        i += 1
+        continue
+      m = re.compile(r"%(empty|prec|dprec|merge)").match(text, i)
+      if m:
+        tokens.append(("%" + m.group(1), m.group(0)))
+        i = m.end()
+        continue
+      m = re.compile(r"[A-Za-z_][\w.]*").match(text, i)
+      if m:
+        tokens.append(("symbol", m.group(0)))
+        i = m.end()
+        continue
+      fail(f"unexpected character {c!r} in rules section")
+
+    lhs = None
+    alternative = None
+    k = 0
+    while k < len(tokens):
+      kind, value = tokens[k]
+      if kind == "symbol" and k + 1 < len(tokens) and tokens[k + 1][0] == ":":
+        lhs = value
+        alternative = []
+        self.rules.append((lhs, alternative))
+        k += 2
+        continue
+      if kind == "symbol" and k + 2 < len(tokens) and tokens[k + 1][0] == "alias" and tokens[k + 2][0] == ":":
+        fail("named left hand side not supported")
+      if lhs is None:
+        fail(f"rule without left hand side at {value}")
+      if kind == "|":
+        alternative = []
+        self.rules.append((lhs, alternative))
+      elif kind == ";":
+        lhs = None
+      elif kind == "symbol":
+        alternative.append(["symbol", value, None])
+      elif kind == "alias":
+        if not alternative or alternative[-1][0] != "symbol":
+          fail(f"named reference [{value}] not after a symbol")
+        alternative[-1][2] = value
+      elif kind == "action":
+        alternative.append(["action", value])
+      elif kind == "%empty":
+        pass
+      elif kind in ("%prec", "%dprec", "%merge"):
+        k += 1
+      k += 1
+
+
+class Automaton:
+  """rules, symbols and states from bison xml report"""
+
+  def __init__(self, path):
+    root = ET.parse(path).getroot()
+    self.rules = {}
+    for rule in root.iter("rule"):
+      if rule.get("usefulness") != "useful":
+        fail(f"rule {rule.get('number')} is not useful")
+      rhs = [s.text for s in rule.find("rhs").findall("symbol")]
+      self.rules[int(rule.get("number"))] = (rule.find("lhs").text, rhs)
+    self.terminals = {}
+    self.types = {}
+    for t in root.iter("terminal"):
+      self.terminals[t.get("name")] = int(t.get("symbol-number"))
+      self.types[t.get("name")] = t.get("type")
+    for n in root.iter("nonterminal"):
+      self.types[n.get("name")] = n.get("type")
+    self.states = {}
+    for state in root.iter("state"):
+      actions = state.find("actions")
+      shifts = {}
+      gotos = {}
+      for t in actions.find("transitions").findall("transition"):
+        (shifts if t.get("type") == "shift" else gotos)[t.get("symbol")] = int(t.get("state"))
+      errors = [e.get("symbol") for e in actions.find("errors").findall("error")]
+      reductions = {}
+      default = None
+      accept = False
+      for r in actions.find("reductions").findall("reduction"):
+        if r.get("enabled") != "true":
+          continue
+        if r.get("rule") == "accept":
+          accept = True
+        elif r.get("symbol") == "$default":
+          default = int(r.get("rule"))
+        else:
+          reductions[r.get("symbol")] = int(r.get("rule"))
+      self.states[int(state.get("number"))] = {
+        "shifts": shifts, "gotos": gotos, "errors": errors,
+        "reductions": reductions, "default": default, "accept": accept,
+      }
+
+
+class Generator:
+
+  def __init__(self, grammar, automaton, classname):
+    self.g = grammar
+    self.a = automaton
+    self.classname = classname
+    self.actions = {}
+    self.match_rules()
+    self.types = sorted({t for t in automaton.types.values() if t})
+    code = "".join(c for blocks in grammar.code.values() for c in blocks)
+    # a YYLLOC_DEFAULT defined in the grammar replaces the built-in location computation same as in bison
+    self.lloc = "YYLLOC_DEFAULT" in code
+    # code written for bison can refer to its parser stack yystack_
+    self.uses_stack = "yystack_" in code + grammar.initial_action + "".join(a[1] for _, items in grammar.rules for a in items if a[0] == "action")
+
+  # pair grammar file rules with automaton rule numbers, midrule actions become their own rules just before the rule containing them
+  def match_rules(self):
+    number = 1
+    midrule = 0
+    for lhs, items in self.g.rules:
+      symbols = []
+      for pos, item in enumerate(items):
+        if item[0] == "action" and pos < len(items) - 1:
+          midrule += 1
+          name = f"$@{midrule}"
+          self.check_rule(number, name, [])
+          self.actions[number] = (item[1], lhs, symbols[:], len(symbols) + 1)
+          number += 1
+          symbols.append((name, None))
+        elif item[0] == "symbol":
+          symbols.append((item[1], item[2]))
+      code = items[-1][1] if items and items[-1][0] == "action" else None
+      self.check_rule(number, lhs, [self.xml_name(s) for s, _ in symbols])
+      self.actions[number] = (code, lhs, symbols, None)
+      number += 1
+    if number != len(self.a.rules):
+      fail(f"grammar has {number} rules but automaton has {len(self.a.rules)}")
+
+  def xml_name(self, symbol):
+    if symbol == "YYEOF":
+      return "$end"
+    return self.g.aliases.get(symbol, symbol)
+
+  def check_rule(self, number, lhs, rhs):
+    if self.a.rules.get(number) != (lhs, rhs):
+      fail(f"rule {number} {lhs}: {' '.join(rhs)} does not match automaton rule {self.a.rules.get(number)}")
+
+  def type_of(self, symbol):
+    return self.a.types.get(self.xml_name(symbol)) or None
+
+  # translate $ and @ references in action code to parser stack accesses
+  # symbols are the visible right hand side, midrule_pos is the position of a midrule action in its rule
+  def translate(self, code, lhs, symbols, midrule_pos):
+    n = len(symbols) if midrule_pos is None else 0
+    base = len(symbols)
+
+    def position(name):
+      if name.isdigit():
+        return int(name)
+      found = [k + 1 for k, (s, alias) in enumerate(symbols) if alias == name or (alias is None and s == name)]
+      if len(found) != 1:
+        if name == lhs and midrule_pos is None:
+          return 0
+        fail(f"cannot resolve ${name} in rule for {lhs}")
+      return found[0]
+
+    def element(k):
+      return f"yystack[yystack.size() - {base - k + 1}]"
+
+    out = []
+    i = 0
+    while i < len(code):
+      c = code[i]
+      j = skip_comment(code, i)
+      if j != i:
+        out.append(code[i:j])
+        i = j
+        continue
+      if c in "\"'":
+        j = skip_literal(code, i)
+        out.append(code[i:j])
+        i = j
+        continue
+      m = re.compile(r"([$@])(\$|\d+|[A-Za-z_]\w*|\[[A-Za-z_][\w.-]*\])").match(code, i)
+      if m:
+        kind, name = m.group(1), m.group(2).strip("[]")
+        k = 0 if name == "$" else position(name)
+        if kind == "@":
+          out.append("yylhs.loc" if k == 0 else f"{element(k)}.loc")
+        elif k == 0:
+          t = self.type_of(lhs) if midrule_pos is None else None
+          if not t:
+            fail(f"$$ used in untyped rule for {lhs}")
+          out.append(f"get<{t}>(yylhs.value)")
+        else:
+          t = self.type_of(symbols[k - 1][0])
+          if not t:
+            fail(f"${name} refers to untyped symbol {symbols[k - 1][0]}")
+          out.append(f"get<{t}>({element(k)}.value)")
+        i = m.end()
+        continue
+      out.append(c)
+      i += 1
+    return "".join(out), n
+
+  def header(self, basename):
+    ns = self.g.namespace
+    guard = re.sub(r"\W", "_", f"{ns}_{basename}_direct_h").upper()
+    params = self.g.parse_params
+    members = "\n".join(f"  {p};" for p in params)
+    ctor_args = ", ".join(f"{p}_yyarg" for p in params)
+    variant = ", ".join(["monostate"] + self.types)
+    return f"""// {basename}.direct.h
+// generated by direct_parser_gen.py from {basename}.y, do not edit
+
+#ifndef {guard}
+#define {guard}
+
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "{basename}.h"
+
+namespace {ns} {{
+using namespace std;
+
+// direct-coded LR parser for the same automaton as {self.g.parser_class}
+// every state and rule is a labelled block in parse() instead of a lookup in compressed tables
+class {self.classname} {{
+public:
+
+  using symbol_type = {self.g.parser_class}::symbol_type;
+  using symbol_kind = {self.g.parser_class}::symbol_kind;
+  using token = {self.g.parser_class}::token;
+  using syntax_error = {self.g.parser_class}::syntax_error;
+
+  {self.classname}({ctor_args});
+
+  int parse();
+
+  int operator()() {{
+    return parse();
+  }}
+
+  void error(const location& loc, const string& msg);
+
+  void error(const syntax_error& yyexc) {{
+    error(yyexc.location, yyexc.what());
+  }}
+
+private:
+
+  using value_type = variant<{variant}>;
+
+  struct stack_symbol {{
+    int state;
+    location loc;
+    value_type value;
+  }};
+
+// right hand side of a rule on the stack for YYLLOC_DEFAULT, index 0 is the symbol before it
+  struct yyslice {{
+    const vector<stack_symbol>& stack;
+    size_t n;
+
+    const stack_symbol& operator[](size_t k) const {{
+      return stack[stack.size() - n + k - 1];
+    }}
+  }};
+
+  static const location& yyrhsloc(const yyslice& rhs, size_t k) {{
+    return rhs[k].loc;
+  }}
+
+  static const location& yyrhsloc(const location* range, size_t k) {{
+    return range[k];
+  }}
+
+// kept across parses like the bison parser stack
+  vector<stack_symbol> yystack;
+
+{members}
+}};
+
+}}
+
+#endif
+"""
+
+  def state_block(self, number, state, lines, used):
+    lines.append(f"yystate_{number}:")
+    if state["accept"]:
+      lines.append("  goto yyacceptlab;")
+      return
+    terminal_actions = state["shifts"] or state["reductions"] or state["errors"]
+    if not terminal_actions:
+      if state["default"] is None:
+        lines.append("  goto yyerrlab;")
+      else:
+        used["reduce"].add(state["default"])
+        lines.append(f"  goto yyreduce_{state['default']};")
+      return
+    lines.append("  YYDIRECT_READ_LOOKAHEAD")
+    lines.append("  switch(yyla.kind()) {")
+    for symbol, target in sorted(state["shifts"].items(), key=lambda st: self.a.terminals[st[0]]):
+      used["shift"].add(target)
+      lines.append(f"  case {self.a.terminals[symbol]}: goto yyshift_{target}; // {symbol}")
+    for symbol, rule in sorted(state["reductions"].items(), key=lambda sr: self.a.terminals[sr[0]]):
+      used["reduce"].add(rule)
+      lines.append(f"  case {self.a.terminals[symbol]}: goto yyreduce_{rule}; // {symbol}")
+    for symbol in state["errors"]:
+      lines.append(f"  case {self.a.terminals[symbol]}: goto yyerrlab; // {symbol}")
+    if state["default"] is None:
+      lines.append("  default: goto yyerrlab;")
+    else:
+      used["reduce"].add(state["default"])
+      lines.append(f"  default: goto yyreduce_{state['default']};")
+    lines.append("  }")
+
+  def shift_block(self, target, lines):
+    symbols = {s for st in self.a.states.values() for s, t in st["shifts"].items() if t == target}
+    if len(symbols) != 1:
+      fail(f"state {target} is reached by shifting {symbols}")
+    t = self.a.types.get(symbols.pop())
+    value = f"value_type(in_place_type<{t}>, std::move(yyla.value.as<{t}>()))" if t else "value_type()"
+    lines.append(f"yyshift_{target}:")
+    lines.append(f"  yystack.push_back({{{target}, yyla.location, {value}}});")
+    lines.append("  yyla.clear();")
+    lines.append("  if(yyerrstatus) {")
+    lines.append("    --yyerrstatus;")
+    lines.append("  }")
+    lines.append(f"  goto yystate_{target};")
+
+  def reduce_block(self, number, lines, used):
+    lhs, rhs = self.a.rules[number]
+    code, rule_lhs, symbols, midrule_pos = self.actions[number]
+    used["goto"].add(lhs)
+    n = len(rhs)
+    lines.append(f"yyreduce_{number}: {{ // {lhs}: {' '.join(rhs)}")
+    if self.lloc:
+      lines.append(f"  YYLLOC_DEFAULT(yylhs.loc, (yyslice{{yystack, {n}}}), {n});")
+    elif n:
+      lines.append(f"  yylhs.loc = location(yystack[yystack.size() - {n}].loc.begin, yystack.back().loc.end);")
+    else:
+      lines.append("  yylhs.loc = location(yystack.back().loc.end);")
+    lines.append("  yyerror_range[1] = yylhs.loc;")
+    t = self.a.types.get(lhs)
+    lines.append(f"  yylhs.value.emplace<{t}>();" if t else "  yylhs.value = monostate();")
+    if code is not None:
+      body, _ = self.translate(code, rule_lhs if midrule_pos is None else lhs, symbols, midrule_pos)
+      # same as bison the right hand side of the rule whose action ends the parse or raises an error is popped without reclaiming it
+      pop = f"yystack.erase(yystack.end() - {n}, yystack.end()); " if n else ""
+      body = re.sub(r"\bYYABORT\b", f"{{ {pop}goto yyabortlab; }}", body)
+      body = re.sub(r"\bYYACCEPT\b", f"{{ {pop}goto yyacceptlab; }}", body)
+      body = re.sub(r"\bYYERROR\b", f"{{ {pop}goto yyerrlab1; }}", body)
+      lines.append("  try {")
+      lines.append("    {" + body + "}")
+      lines.append("  } catch(const syntax_error& yyexc) {")
+      lines.append("    error(yyexc);")
+      if n:
+        lines.append(f"    yystack.erase(yystack.end() - {n}, yystack.end());")
+      lines.append("    goto yyerrlab1;")
+      lines.append("  }")
+    if n:
+      lines.append(f"  yystack.erase(yystack.end() - {n}, yystack.end());")
+    lines.append(f"  goto yygoto_{self.label(lhs)};")
+    lines.append("}")
+
+  def label(self, symbol):
+    return re.sub(r"\W", "_", symbol)
+
+  def goto_block(self, lhs, lines):
+    lines.append(f"yygoto_{self.label(lhs)}:")
+    lines.append("  switch(yystack.back().state) {")
+    for number, state in sorted(self.a.states.items()):
+      if lhs in state["gotos"]:
+        target = state["gotos"][lhs]
+        lines.append(f"  case {number}: yylhs.state = {target}; yystack.push_back(std::move(yylhs)); goto yystate_{target};")
+    lines.append("  default: unreachable();")
+    lines.append("  }")
+
+  # expected tokens listed in syntax error messages, same as bison expected_tokens for states where errors are detected
+  def expected(self, state):
+    kinds = sorted(self.a.terminals[s] for s in list(state["shifts"]) + list(state["reductions"]) if s != "error")
+    return kinds if len(kinds) <= 4 else []
+
+  def source(self, basename):
+    ns = self.g.namespace
+    params = self.g.parse_params
+    names = [re.search(r"(\w+)\s*$", p).group(1) for p in params]
+    ctor_args = ", ".join(f"{p}_yyarg" for p in params)
+    inits = ",\n  ".join(f"{n}({n}_yyarg)" for n in names)
+
+    used = {"shift": set(), "reduce": set(), "goto": set()}
+    states = []
+    for number, state in sorted(self.a.states.items()):
+      self.state_block(number, state, states, used)
+    shifts = []
+    for target in sorted(used["shift"]):
+      self.shift_block(target, shifts)
+    reductions = []
+    for number in sorted(used["reduce"]):
+      self.reduce_block(number, reductions, used)
+    gotos = []
+    for lhs in sorted(used["goto"]):
+      self.goto_block(lhs, gotos)
+
+    error_shifts = sorted((n, st["shifts"]["error"]) for n, st in self.a.states.items() if "error" in st["shifts"])
+    errlab1 = ["yyerrlab1:", "  yyerrstatus = 3;", "  for(;;) {"]
+    if error_shifts:
+      errlab1.append("    switch(yystack.back().state) {")
+      for number, target in error_shifts:
+        errlab1.append(f"    case {number}: yyerrstate = {target}; goto yyerrshift;")
+      errlab1.append("    default: break;")
+      errlab1.append("    }")
+    errlab1 += [
+      "    if(yystack.size() == 1) {",
+      "      goto yyabortlab;",
+      "    }",
+      "    yyerror_range[1] = yystack.back().loc;",
+      "    yystack.pop_back();",
+      "  }",
+    ]
+    if error_shifts:
+      errlab1 += [
+        "yyerrshift:",
+        "  yyerror_range[2] = yyla.location;",
+      ] + ([
+        "  {",
+        "    location yyerrloc;",
+        "    YYLLOC_DEFAULT(yyerrloc, yyerror_range, 2);",
+        "    yystack.push_back({yyerrstate, yyerrloc, value_type()});",
+        "  }",
+      ] if self.lloc else [
+        "  yystack.push_back({yyerrstate, location(yyerror_range[1].begin, yyerror_range[2].end), value_type()});",
+      ]) + [
+        "  switch(yyerrstate) {",
+      ]
+      for target in sorted({t for _, t in error_shifts}):
+        errlab1.append(f"  case {target}: goto yystate_{target};")
+      errlab1 += ["  default: unreachable();", "  }"]
+
+    offsets = [0]
+    kinds = []
+    for number, state in sorted(self.a.states.items()):
+      kinds += self.expected(state)
+      offsets.append(len(kinds))
+
+    lloc_macros = "\n// names used by YYLLOC_DEFAULT\n#define YYRHSLOC(Rhs, K) yyrhsloc(Rhs, K)\n#define YYABORT goto yyabortlab\n" if self.lloc else ""
+    initial_action = re.sub(r"@\$", "yyla.location", self.g.initial_action)
+    code_top = "\n".join(self.g.code.get("top", []))
+    prologue = "\n".join(self.g.code.get("prologue", []))
+    code = "\n".join(self.g.code.get("", []))
+    code = code.replace(f"{ns}::{self.g.parser_class}::", f"{ns}::{self.classname}::")
+
+    return f"""// {basename}.direct.cpp
+// generated by direct_parser_gen.py from {basename}.y, do not edit
+{code_top}
+#include "{basename}.direct.h"
+{prologue}
+{code}
+
+#include <utility>
+{lloc_macros}
+namespace {ns} {{
+
+namespace {{
+
+// expected tokens for syntax error messages in each state
+constexpr int yyexpected_offsets[] = {{{", ".join(map(str, offsets))}}};
+constexpr int yyexpected[] = {{{", ".join(map(str, kinds)) if kinds else "0"}}};
+
+string yysyntax_error(int state, const {self.g.parser_class}::symbol_type& yyla) {{
+  if(yyla.empty()) {{
+    return "syntax error";
+  }}
+  auto msg = "syntax error, unexpected "s + {self.g.parser_class}::symbol_name(yyla.kind());
+  for(auto i = yyexpected_offsets[state]; i < yyexpected_offsets[state + 1]; ++i) {{
+    msg += i == yyexpected_offsets[state]? ", expecting ": " or ";
+    msg += {self.g.parser_class}::symbol_name({self.g.parser_class}::symbol_kind_type(yyexpected[i]));
+  }}
+  return msg;
+}}
+
+}}
+
+{self.classname}::{self.classname}({ctor_args}):
+  {inits} {{
+  yystack.reserve(200);
+}}
+
+// read lookahead token unless there is one, same as bison yybackup
+#define YYDIRECT_READ_LOOKAHEAD \\
+  if(yyla.empty()) {{ \\
+    try {{ \\
+      symbol_type yylookahead(yylex(lexParam)); \\
+      yyla.move(yylookahead); \\
+    }} catch(const syntax_error& yyexc) {{ \\
+      error(yyexc); \\
+      goto yyerrlab1; \\
+    }} \\
+  }} \\
+  if(yyla.kind() == symbol_kind::S_YYerror) {{ \\
+    yyla.kind_ = symbol_kind::S_YYUNDEF; \\
+    goto yyerrlab1; \\
+  }}
+
+int {self.classname}::parse() {{
+  symbol_type yyla;
+  int yyerrstatus = 0;
+  location yyerror_range[3];
+  stack_symbol yylhs;
+  int yyresult;
+{"  int yyerrstate;" if error_shifts else ""}
+{"  auto& yystack_ = yystack;" if self.uses_stack else ""}
+
+  {{{initial_action}}}
+
+  yystack.clear();
+  yystack.push_back({{0, yyla.location, value_type()}});
+  goto yystate_0;
+
+{chr(10).join(states)}
+
+{chr(10).join(shifts)}
+
+{chr(10).join(reductions)}
+
+{chr(10).join(gotos)}
+
+yyerrlab:
+  if(!yyerrstatus) {{
+    error(yyla.location, yysyntax_error(yystack.back().state, yyla));
+  }}
+  yyerror_range[1] = yyla.location;
+  if(yyerrstatus == 3) {{
+    if(yyla.kind() == symbol_kind::S_YYEOF) {{
+      goto yyabortlab;
+    }} else if(!yyla.empty()) {{
+      yyla.clear();
+    }}
+  }}
+  goto yyerrlab1;
+
+{chr(10).join(errlab1)}
+
+yyacceptlab:
+  yyresult = 0;
+  goto yyreturn;
+
+yyabortlab:
+  yyresult = 1;
+  goto yyreturn;
+
+yyreturn:
+  yystack.clear();
+  return yyresult;
+}}
+
+#undef YYDIRECT_READ_LOOKAHEAD
+
+}}
+"""
+
+
+def main():
+  if len(sys.argv) < 4:
+    fail("usage: direct_parser_gen.py grammar.y automaton.xml outdir [classname]")
+  grammar = Grammar(sys.argv[1])
+  automaton = Automaton(sys.argv[2])
+  outdir = sys.argv[3]
+  classname = sys.argv[4] if len(sys.argv) > 4 else "Direct" + grammar.parser_class
+  basename = os.path.splitext(os.path.basename(sys.argv[1]))[0]
+  generator = Generator(grammar, automaton, classname)
+  for suffix, text in ((".direct.h", generator.header(basename)), (".direct.cpp", generator.source(basename))):
+    path = os.path.join(outdir, basename + suffix)
+    with open(path + ".tmp", "w") as f:
+      f.write(text)
+    os.replace(path + ".tmp", path)
+
+
+main()